@@ -0,0 +1,238 @@
+/*
+False sharing benchmark for the session and ghost layouts.
+
+Every thread hammers the fields its game thread writes (session flags / ghost
+position) on its own element of a shared array, first with the old packed
+layouts and then with the cache line aligned ones from session.h / board.h.
+When the kernel allows it the cache misses of each run are counted through
+perf_event_open, which is the coherence traffic caused by the layout.
+
+Usage: false_sharing [threads] [iterations]
+*/
+#define _GNU_SOURCE
+#include "board.h"
+#include "session.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/*
+session_data_t as it was before, packed, with the board embedded between the identity and
+the pipes. The embedded board keeps the hot flags of neighbouring sessions far apart, so
+this measures the old layout as it really was rather than a worst case
+*/
+typedef struct {
+    int active;
+    int client_id;
+    board_t board;
+    int client_req_pipe;
+    int client_notif_pipe;
+    char client_req_path[MAX_PIPE_PATH_LENGTH];
+    char client_notif_path[MAX_PIPE_PATH_LENGTH];
+    pthread_t pacman_tid;
+    pthread_t session_tid;
+    pthread_t *ghost_tids;
+    int thread_shutdown;
+    pthread_mutex_t session_lock;
+    int current_level;
+    int total_levels;
+    int victory;
+    int accumulated_points;
+    int level_change_pending;
+    int new_level_index;
+} legacy_session_t;
+
+// ghost_t as it was before, packed: neighbours share their boundary lines
+typedef struct {
+    int pos_x, pos_y;
+    int passo;
+    command_t moves[MAX_MOVES];
+    int n_moves;
+    int current_move;
+    int waiting;
+    int charged;
+} legacy_ghost_t;
+
+typedef struct {
+    const char *name;
+    const char *layout;
+    void *(*worker)(void *);
+} bench_case_t;
+
+typedef struct {
+    int id;
+    long iterations;
+} worker_arg_t;
+
+static pthread_barrier_t start_barrier;
+static legacy_session_t *legacy_sessions;
+static session_data_t *sessions;
+static legacy_ghost_t *legacy_ghosts;
+static ghost_t *ghosts;
+
+// Same access pattern as the pacman and manager threads: flags under the lock, the level change
+// flag the manager polls, pipe fd read from the cold head
+#define SESSION_LOOP(s, pending, n) \
+    for (long i = 0; i < (n); i++) { \
+        pthread_mutex_lock(&(s)->session_lock); \
+        if (!(s)->thread_shutdown) (s)->accumulated_points++; \
+        (s)->current_level = (int)(i & 1); \
+        (s)->pending = (int)(i & 1); \
+        pthread_mutex_unlock(&(s)->session_lock); \
+        sink += *(volatile int *)&(s)->client_notif_pipe; \
+    }
+
+// Same access pattern as move_ghost: position and script cursor of one ghost
+#define GHOST_LOOP(g, cursor, n) \
+    for (long i = 0; i < (n); i++) { \
+        volatile int *x = &(g)->pos_x; \
+        *x = *x + 1; \
+        (g)->pos_y = (int)i; \
+        (g)->cursor++; \
+        *(volatile int *)&(g)->waiting = (int)(i & 3); \
+    }
+
+static void *legacy_session_worker(void *arg) {
+    worker_arg_t *w = arg;
+    legacy_session_t *s = &legacy_sessions[w->id];
+    int sink = 0;
+    pthread_barrier_wait(&start_barrier);
+    SESSION_LOOP(s, level_change_pending, w->iterations);
+    return (void *)(long)sink;
+}
+
+static void *session_worker(void *arg) {
+    worker_arg_t *w = arg;
+    session_data_t *s = &sessions[w->id];
+    int sink = 0;
+    pthread_barrier_wait(&start_barrier);
+    SESSION_LOOP(s, next_ready, w->iterations);
+    return (void *)(long)sink;
+}
+
+static void *legacy_ghost_worker(void *arg) {
+    worker_arg_t *w = arg;
+    legacy_ghost_t *g = &legacy_ghosts[w->id];
+    pthread_barrier_wait(&start_barrier);
+    GHOST_LOOP(g, current_move, w->iterations);
+    return NULL;
+}
+
+static void *ghost_worker(void *arg) {
+    worker_arg_t *w = arg;
+    ghost_t *g = &ghosts[w->id];
+    pthread_barrier_wait(&start_barrier);
+    GHOST_LOOP(g, script.pc, w->iterations);
+    return NULL;
+}
+
+// Helper private function to open a cache miss counter inherited by the worker threads, -1 if not allowed
+static int open_cache_miss_counter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run_case(const bench_case_t *c, int threads, long iterations, int first) {
+    pthread_t tids[threads];
+    worker_arg_t args[threads];
+    pthread_barrier_init(&start_barrier, NULL, threads + 1);
+
+    int counter = open_cache_miss_counter();
+    for (int t = 0; t < threads; t++) {
+        args[t].id = t;
+        args[t].iterations = iterations;
+        pthread_create(&tids[t], NULL, c->worker, &args[t]);
+    }
+
+    if (counter != -1) {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    double start = now_ns();
+    pthread_barrier_wait(&start_barrier);
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    double elapsed = now_ns() - start;
+
+    long long misses = -1;
+    if (counter != -1) {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &misses, sizeof(misses)) != sizeof(misses)) misses = -1;
+        close(counter);
+    }
+    pthread_barrier_destroy(&start_barrier);
+
+    printf("%s    {\"case\": \"%s\", \"layout\": \"%s\", \"ns_per_op\": %.2f, ",
+           first ? "" : ",\n", c->name, c->layout, elapsed / ((double)iterations * threads));
+    if (misses >= 0) printf("\"cache_misses\": %lld}", misses);
+    else printf("\"cache_misses\": null}");
+}
+
+int main(int argc, char **argv) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = argc > 1 ? atoi(argv[1]) : (cpus < 2 ? 2 : (cpus > 16 ? 16 : (int)cpus));
+    long iterations = argc > 2 ? atol(argv[2]) : 2000000;
+    if (threads < 1 || iterations < 1) {
+        fprintf(stderr, "Usage: %s [threads] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    legacy_sessions = calloc(threads, sizeof(legacy_session_t));
+    sessions = aligned_alloc(CACHE_LINE_SIZE, threads * sizeof(session_data_t));
+    memset(sessions, 0, threads * sizeof(session_data_t));
+    legacy_ghosts = calloc(threads, sizeof(legacy_ghost_t));
+    ghosts = aligned_alloc(CACHE_LINE_SIZE, threads * sizeof(ghost_t));
+    memset(ghosts, 0, threads * sizeof(ghost_t));
+    for (int t = 0; t < threads; t++) {
+        pthread_mutex_init(&legacy_sessions[t].session_lock, NULL);
+        pthread_mutex_init(&sessions[t].session_lock, NULL);
+    }
+
+    const bench_case_t cases[] = {
+        {"sessions", "packed", legacy_session_worker},
+        {"sessions", "cache_line", session_worker},
+        {"ghosts", "packed", legacy_ghost_worker},
+        {"ghosts", "cache_line", ghost_worker},
+    };
+
+    printf("{\n  \"bench\": \"false_sharing\",\n  \"threads\": %d,\n  \"cpus\": %ld,\n"
+           "  \"iterations\": %ld,\n  \"sizeof\": {\"legacy_session\": %zu, \"session\": %zu, "
+           "\"legacy_ghost\": %zu, \"ghost\": %zu},\n  \"results\": [\n",
+           threads, cpus, iterations, sizeof(legacy_session_t), sizeof(session_data_t),
+           sizeof(legacy_ghost_t), sizeof(ghost_t));
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        run_case(&cases[i], threads, iterations, i == 0);
+    }
+    printf("\n  ]\n}\n");
+
+    for (int t = 0; t < threads; t++) {
+        pthread_mutex_destroy(&legacy_sessions[t].session_lock);
+        pthread_mutex_destroy(&sessions[t].session_lock);
+    }
+    free(legacy_sessions);
+    free(sessions);
+    free(legacy_ghosts);
+    free(ghosts);
+    return 0;
+}
@@ -0,0 +1,428 @@
+/*
+Microbenchmarks of the server hot paths, to compare a change against a baseline.
+
+Every case runs at several board sizes and thread counts, `repetitions` times,
+and reports the median and the best ns per operation as JSON: same keys in the
+same order on every run, one result per line, so two runs diff cleanly. The
+work of a run is fixed, the operations are split between its threads.
+
+Boards come from levels generated into a temporary directory: a walled square
+of dots, one ghost per row walking between the walls and the pacman on the
+last row.
+
+    move_pacman          pacman steps right and left, one board per thread
+    move_ghost           one ghost per thread on a shared board, D A script
+    move_ghost_charged   same with C D C A, every dash goes from wall to wall
+    get_board_displayed  frame of the board as a new string, one board per thread
+    read_level           parses the level files, one arena per thread
+    load_level           instantiates the prepared level and unloads it
+    read_line            reads lines as wide as the board, one file descriptor per thread
+    request_buffer       as many producers as consumers through one request_buffer_t
+
+Usage: microbench [case] [repetitions]
+*/
+#include "board.h"
+#include "parser.h"
+#include "buffer.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#define BENCH_WORK 1000000L // cost units of a run, about 100 ns each with the default flags
+#define BENCH_MIN_OPS 16
+#define BENCH_REPETITIONS 5
+#define BENCH_LINES 4096 // lines of the read_line files
+#define BENCH_MAX_THREADS 8
+
+static const int sizes[] = {16, 64, 256}; // width and height of the generated boards
+static const int thread_counts[] = {1, 2, 4, BENCH_MAX_THREADS};
+#define N_SIZES (int)(sizeof(sizes) / sizeof(sizes[0]))
+#define N_THREAD_COUNTS (int)(sizeof(thread_counts) / sizeof(thread_counts[0]))
+
+typedef struct {
+    int id;
+    long ops;
+    int size;
+    board_t *board; // shared by the ghost cases, the thread's own otherwise
+    arena_t arena;
+    int fd;
+    long sink; // keeps results alive
+} worker_arg_t;
+
+typedef struct {
+    const char *name;
+    void *(*worker)(void *);
+    long (*cost)(int size); // cost units of one operation
+    const char *level; // generated level the case runs on: walk or dash ghosts
+    int shared_board; // ghost cases: every thread moves its own ghost of one board
+    int sized; // whether the size changes anything
+} bench_case_t;
+
+static char level_dir[] = "/tmp/microbench.XXXXXX";
+static arena_t template_arena;
+static level_template_t template_level; // prepared level being benchmarked
+static const char *current_level; // file name of the level being benchmarked
+static char *current_lines; // path of the read_line file being benchmarked
+static request_buffer_t requests;
+static pthread_barrier_t start_barrier;
+
+static void *move_pacman_worker(void *arg) {
+    worker_arg_t *w = arg;
+    command_t commands[2] = {{'D', 1, 1}, {'A', 1, 1}};
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < w->ops; i++) {
+        w->sink += move_pacman(w->board, 0, &commands[i & 1]);
+    }
+    return NULL;
+}
+
+static void *move_ghost_worker(void *arg) {
+    worker_arg_t *w = arg;
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < w->ops; i++) {
+        w->sink += move_ghost(w->board, w->id);
+    }
+    return NULL;
+}
+
+static void *render_worker(void *arg) {
+    worker_arg_t *w = arg;
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < w->ops; i++) {
+        char *frame = get_board_displayed(w->board);
+        w->sink += frame[i % (w->size * w->size)];
+        free(frame);
+    }
+    return NULL;
+}
+
+static void *read_level_worker(void *arg) {
+    worker_arg_t *w = arg;
+    level_template_t level;
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < w->ops; i++) {
+        memset(&level, 0, sizeof(level));
+        w->sink += read_level(&level, &w->arena, (char *)current_level, level_dir);
+        arena_reset(&w->arena);
+    }
+    return NULL;
+}
+
+static void *load_level_worker(void *arg) {
+    worker_arg_t *w = arg;
+    board_t *board = w->board;
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < w->ops; i++) {
+        w->sink += load_level(board, &template_level, 0);
+        unload_level(board);
+    }
+    return NULL;
+}
+
+static void *read_line_worker(void *arg) {
+    worker_arg_t *w = arg;
+    line_reader_t *reader = malloc(sizeof(line_reader_t)); // Too big for the stack
+    char line[MAX_COMMAND_LENGTH];
+    if (reader) reader_init(reader, w->fd);
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; reader && i < w->ops; i++) {
+        int length = read_line(reader, line);
+        if (length == 0) {
+            reader_rewind(reader);
+            length = read_line(reader, line);
+        }
+        w->sink += length;
+    }
+    free(reader);
+    return NULL;
+}
+
+// Producers are the even ids, each one paired with the next consumer
+static void *request_buffer_worker(void *arg) {
+    worker_arg_t *w = arg;
+    connection_request_t request;
+    memset(&request, 0, sizeof(request));
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < w->ops; i++) {
+        if (w->id % 2 == 0) {
+            request.client_id = (int)i;
+            buffer_insert(&requests, request);
+        }
+        else {
+            w->sink += buffer_remove(&requests).client_id;
+        }
+    }
+    return NULL;
+}
+
+static long unit_cost(int size) {
+    (void)size;
+    return 1;
+}
+
+static long dash_cost(int size) {
+    return size / 4; // every other step is a C, a dash locks two cells per step
+}
+
+static long line_cost(int size) {
+    return 1 + size / 4;
+}
+
+static long board_cost(int size) {
+    return (long)size * size / 2;
+}
+
+static long parse_cost(int size) {
+    return 2000 + (long)size * size / 20; // one open and mmap per file dominates small levels
+}
+
+static long load_cost(int size) {
+    return 2 + (long)size * size / 800;
+}
+
+static long buffer_cost(int size) {
+    (void)size;
+    return 8; // semaphores put waiters to sleep
+}
+
+static const bench_case_t cases[] = {
+    {"move_pacman", move_pacman_worker, unit_cost, "walk", 0, 1},
+    {"move_ghost", move_ghost_worker, unit_cost, "walk", 1, 1},
+    {"move_ghost_charged", move_ghost_worker, dash_cost, "dash", 1, 1},
+    {"get_board_displayed", render_worker, board_cost, "walk", 0, 1},
+    {"read_level", read_level_worker, parse_cost, "walk", 0, 1},
+    {"load_level", load_level_worker, load_cost, "walk", 0, 1},
+    {"read_line", read_line_worker, line_cost, "walk", 0, 1},
+    {"request_buffer", request_buffer_worker, buffer_cost, "walk", 0, 0},
+};
+
+// Helper private function to write a file of the level directory, -1 on error
+static int write_file(const char *name, const char *text) {
+    char path[MAX_FILENAME];
+    snprintf(path, sizeof(path), "%s/%s", level_dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fputs(text, f);
+    return fclose(f);
+}
+
+// Helper private function, level <ghost_name><size>.lvl with BENCH_MAX_THREADS ghosts running script, plus its entity files
+static int write_level(int size, const char *ghost_name, const char *script) {
+    char name[64], text[512];
+    snprintf(text, sizeof(text), "PASSO 0\nPOS 1 %d\nD\nA\n", size - 2);
+    snprintf(name, sizeof(name), "pacman%d.p", size);
+    if (write_file(name, text) != 0) return -1;
+
+    size_t capacity = 64 + (size_t)BENCH_MAX_THREADS * 32 + (size_t)size * (size + 1);
+    char *level = malloc(capacity);
+    if (!level) return -1;
+    int n = snprintf(level, capacity, "DIM %d %d\nTEMPO 1\nPAC pacman%d.p\nMON", size, size, size);
+    for (int g = 0; g < BENCH_MAX_THREADS; g++) {
+        snprintf(text, sizeof(text), "PASSO 0\nPOS 1 %d\n%s", g + 1, script); // One row per ghost
+        snprintf(name, sizeof(name), "%s%d.%d.m", ghost_name, size, g);
+        if (write_file(name, text) != 0) {
+            free(level);
+            return -1;
+        }
+        n += snprintf(level + n, capacity - n, " %s", name);
+    }
+    level[n++] = '\n';
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            level[n++] = (y == 0 || y == size - 1 || x == 0 || x == size - 1) ? 'X' : 'o';
+        }
+        level[n++] = '\n';
+    }
+    level[n] = '\0';
+
+    snprintf(name, sizeof(name), "%s%d.lvl", ghost_name, size);
+    int result = write_file(name, level);
+    free(level);
+    return result;
+}
+
+// Helper private function, BENCH_LINES lines of min(size, MAX_COMMAND_LENGTH - 1) characters
+static int write_lines(int size) {
+    int width = size < MAX_COMMAND_LENGTH - 1 ? size : MAX_COMMAND_LENGTH - 1;
+    char name[64], path[MAX_FILENAME];
+    snprintf(name, sizeof(name), "lines%d.txt", size);
+    snprintf(path, sizeof(path), "%s/%s", level_dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    for (int i = 0; i < BENCH_LINES; i++) {
+        for (int c = 0; c < width; c++) fputc('a' + (i + c) % 26, f);
+        fputc('\n', f);
+    }
+    return fclose(f);
+}
+
+// Helper private function to create and prepare every level, -1 on error
+static int generate_levels(void) {
+    if (!mkdtemp(level_dir)) return -1;
+
+    arena_init(&template_arena);
+    for (int s = 0; s < N_SIZES; s++) {
+        if (write_level(sizes[s], "walk", "D\nA\n") != 0 || write_level(sizes[s], "dash", "C\nD\nC\nA\n") != 0 ||
+            write_lines(sizes[s]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void remove_levels(void) {
+    char path[MAX_FILENAME];
+    for (int s = 0; s < N_SIZES; s++) {
+        const char *names[] = {"walk", "dash"};
+        for (int k = 0; k < 2; k++) {
+            for (int g = 0; g < BENCH_MAX_THREADS; g++) {
+                snprintf(path, sizeof(path), "%s/%s%d.%d.m", level_dir, names[k], sizes[s], g);
+                unlink(path);
+            }
+            snprintf(path, sizeof(path), "%s/%s%d.lvl", level_dir, names[k], sizes[s]);
+            unlink(path);
+        }
+        snprintf(path, sizeof(path), "%s/pacman%d.p", level_dir, sizes[s]);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/lines%d.txt", level_dir, sizes[s]);
+        unlink(path);
+    }
+    rmdir(level_dir);
+}
+
+// Helper private function to parse and prepare the level of one case, -1 on error
+static int prepare_template(level_template_t *level, const char *name) {
+    memset(level, 0, sizeof(level_template_t));
+    if (read_level(level, &template_arena, (char *)name, level_dir) != 0) return -1;
+    return prepare_level(level, &template_arena);
+}
+
+// Helper private function, one run of a case. Returns the elapsed ns, -1 on error
+static double run_case(const bench_case_t *c, int size, int threads, long ops) {
+    pthread_t tids[BENCH_MAX_THREADS];
+    worker_arg_t args[BENCH_MAX_THREADS];
+    board_t boards[BENCH_MAX_THREADS];
+    int n_boards = c->shared_board ? 1 : threads;
+    int result = 0;
+
+    memset(args, 0, sizeof(args));
+    memset(boards, 0, sizeof(boards));
+    for (int t = 0; t < threads; t++) {
+        args[t].id = t;
+        args[t].ops = ops;
+        args[t].size = size;
+        args[t].board = &boards[c->shared_board ? 0 : t];
+        args[t].fd = -1;
+        arena_init(&args[t].arena);
+        if (c->worker == read_line_worker && (args[t].fd = open(current_lines, O_RDONLY)) == -1) result = -1;
+    }
+    for (int b = 0; b < n_boards; b++) {
+        boards[b].arena = &args[b].arena;
+        if (load_level(&boards[b], &template_level, 0) != 0) result = -1;
+    }
+    if (c->worker == load_level_worker) {
+        for (int b = 0; b < n_boards; b++) unload_level(&boards[b]);
+    }
+    if (c->worker == request_buffer_worker) buffer_init(&requests);
+
+    double elapsed = -1;
+    if (result == 0) {
+        pthread_barrier_init(&start_barrier, NULL, threads + 1);
+        for (int t = 0; t < threads; t++) {
+            pthread_create(&tids[t], NULL, c->worker, &args[t]);
+        }
+        pthread_barrier_wait(&start_barrier);
+        long long start = monotonic_ns();
+        for (int t = 0; t < threads; t++) {
+            pthread_join(tids[t], NULL);
+        }
+        elapsed = (double)(monotonic_ns() - start);
+        pthread_barrier_destroy(&start_barrier);
+    }
+
+    if (c->worker == request_buffer_worker) buffer_destroy(&requests);
+    for (int t = 0; t < threads; t++) {
+        if (args[t].fd != -1) close(args[t].fd);
+        arena_destroy(&args[t].arena);
+    }
+    return elapsed;
+}
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+    const char *only = argc > 1 ? argv[1] : NULL;
+    int repetitions = argc > 2 ? atoi(argv[2]) : BENCH_REPETITIONS;
+    if (repetitions < 1) {
+        fprintf(stderr, "Usage: %s [case] [repetitions]\n", argv[0]);
+        return 1;
+    }
+
+    if (generate_levels() != 0) {
+        perror("Error generating the benchmark levels");
+        remove_levels();
+        return 1;
+    }
+
+    printf("{\n  \"bench\": \"microbench\",\n  \"cpus\": %ld,\n  \"repetitions\": %d,\n  \"results\": [\n",
+           sysconf(_SC_NPROCESSORS_ONLN), repetitions);
+
+    int first = 1, failed = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const bench_case_t *c = &cases[i];
+        if (only && strcmp(only, c->name) != 0) continue;
+
+        for (int s = 0; s < (c->sized ? N_SIZES : 1); s++) {
+            int size = c->sized ? sizes[s] : 0;
+            char level_name[64], lines_path[MAX_FILENAME];
+            snprintf(level_name, sizeof(level_name), "%s%d.lvl", c->level, sizes[s]);
+            snprintf(lines_path, sizeof(lines_path), "%s/lines%d.txt", level_dir, sizes[s]);
+            current_level = level_name;
+            current_lines = lines_path;
+            if (prepare_template(&template_level, level_name) != 0) {
+                fprintf(stderr, "Error preparing %s\n", level_name);
+                failed = 1;
+                break;
+            }
+
+            for (int k = 0; k < N_THREAD_COUNTS; k++) {
+                int threads = thread_counts[k];
+                if (c->worker == request_buffer_worker && threads < 2) continue; // Needs a producer and a consumer
+
+                long ops = BENCH_WORK / c->cost(sizes[s]) / threads;
+                if (ops < BENCH_MIN_OPS) ops = BENCH_MIN_OPS;
+                double runs[repetitions];
+                for (int r = 0; r < repetitions && !failed; r++) {
+                    runs[r] = run_case(c, sizes[s], threads, ops) / ((double)ops * threads);
+                    failed = runs[r] < 0;
+                }
+                if (failed) {
+                    fprintf(stderr, "Error running %s\n", c->name);
+                    break;
+                }
+                qsort(runs, repetitions, sizeof(double), by_value);
+
+                printf("%s    {\"case\": \"%s\", \"size\": %d, \"threads\": %d, \"ops\": %ld, "
+                       "\"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f}",
+                       first ? "" : ",\n", c->name, size, threads, ops * threads, runs[repetitions / 2], runs[0]);
+                fflush(stdout);
+                first = 0;
+            }
+            arena_reset(&template_arena);
+            if (failed) break;
+        }
+        if (failed) break;
+    }
+    printf("\n  ]\n}\n");
+
+    arena_destroy(&template_arena);
+    remove_levels();
+    return failed;
+}
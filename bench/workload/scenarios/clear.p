@@ -0,0 +1,19 @@
+# Straight to the portal of each shipped level: victory with 5 points a level
+D
+D
+D
+D
+S
+S
+D
+D
+D
+D
+S
+S
+D
+D
+D
+D
+S
+S
@@ -0,0 +1,6 @@
+# Down the first column into the ghost of level 1
+S
+S
+S
+S
+T 3
@@ -0,0 +1,10 @@
+# Waits and a move into the wall on level 1, the game goes on
+D
+D
+T 2
+A
+W
+S
+D
+D
+D
@@ -0,0 +1,77 @@
+PASSO 0
+POS 1 1
+# A game that clears the three shipped levels (server/niveis), 46 points,
+# as played by a client at one command per tempo. loadgen replays it (make pgo)
+S
+W
+T 1
+D
+S
+T 1
+S
+T 1
+S
+T 2
+S
+D
+A
+W
+A
+T 1
+W
+T 1
+A
+D
+W
+D
+W
+D
+A
+S
+S
+T 2
+D
+W
+D
+W
+D
+A
+S
+S
+S
+W
+D
+D
+S
+D
+S
+D
+S
+W
+T 1
+D
+D
+S
+S
+S
+S
+A
+T 2
+W
+W
+T 1
+A
+S
+W
+D
+D
+D
+W
+W
+D
+S
+D
+W
+S
+A
+S
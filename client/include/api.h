@@ -8,16 +8,34 @@ typedef struct {
   int victory;
   int game_over;
   int accumulated_points;
+  int input_seq; // last pacman_play_seq input applied to this board, -1 if none
   char* data;
 } Board;
 
+typedef struct {
+  int client_id;
+  int points;
+} LeaderboardEntry;
+
 int pacman_connect(char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path);
 
 void pacman_play(char command);
 
+/// Same as pacman_play, the boards drawn after the server applies the command carry seq in input_seq.
+/// seq must not be negative.
+void pacman_play_seq(char command, int seq);
+
 /// @return 0 if the disconnection was successful, 1 otherwise.
 int pacman_disconnect();
 
 Board receive_board_update(void);
 
+/// Asks the server for its best clients, needs no session. reply_pipe_path is created and removed here.
+/// @return number of entries stored in entries (at most max), -1 on error.
+int pacman_leaderboard(char const *reply_pipe_path, char const *server_pipe_path, LeaderboardEntry *entries, int max);
+
+/// All time best results kept by the server: whole games for level -1, a single level otherwise.
+/// @return number of entries stored in entries (at most max), -1 on error.
+int pacman_highscores(char const *reply_pipe_path, char const *server_pipe_path, int level, LeaderboardEntry *entries, int max);
+
 #endif
\ No newline at end of file
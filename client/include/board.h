@@ -89,4 +89,8 @@ void unload_level(board_t * board);
 
 void print_board(board_t* board);
 
+static inline int board_has_portal(const board_t* board, int index) {
+    return board->board[index].has_portal;
+}
+
 #endif
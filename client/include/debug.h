@@ -1,13 +1,7 @@
 #ifndef DEBUG_H
 #define DEBUG_H
 
-// DEBUG FILE
-
-void open_debug_file(char *filename);
-
-void close_debug_file();
-
-void debug(const char * format, ...);
+#include "log.h" // debug() and the other log levels
 
 void sleep_ms(int milliseconds);
 
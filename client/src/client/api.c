@@ -134,6 +134,24 @@ void pacman_play(char command) {
 }
 
 
+void pacman_play_seq(char command, int seq) {
+
+  if (session.req_pipe == -1) {
+    return;
+  }
+
+  char message[PLAY_SEQ_MESSAGE_SIZE]; // Op code + command + sequence number, one write so it is never split
+
+  message[0] = OP_CODE_PLAY_SEQ;
+  message[1] = command;
+  memcpy(message + 2, &seq, sizeof(int));
+
+  if (write(session.req_pipe, message, sizeof(message)) != sizeof(message)) {
+    fprintf(stderr, "Error sending play command: %s\n", strerror(errno));
+  }
+}
+
+
 int pacman_disconnect() {
   if (session.req_pipe == -1) {
     return -1;
@@ -167,7 +185,7 @@ Board receive_board_update(void) {
 
     int n = read(session.notif_pipe, &op_code, 1); // Read operation code
 
-    if (n <= 0 || op_code != OP_CODE_BOARD) {
+    if (n <= 0 || (op_code != OP_CODE_BOARD && op_code != OP_CODE_BOARD_SEQ)) {
       board.data = NULL;
       return board;
     }
@@ -179,6 +197,10 @@ Board receive_board_update(void) {
     read(session.notif_pipe, &board.victory, sizeof(int));
     read(session.notif_pipe, &board.game_over, sizeof(int));
     read(session.notif_pipe, &board.accumulated_points, sizeof(int));
+    board.input_seq = -1;
+    if (op_code == OP_CODE_BOARD_SEQ) {
+      read(session.notif_pipe, &board.input_seq, sizeof(int));
+    }
 
     int data_size = board.width * board.height; // Calculate the size of board data
     board.data = malloc(data_size * sizeof(char)); // Allocate memory for board data
@@ -193,4 +215,86 @@ Board receive_board_update(void) {
     }
 
     return board;
-}
\ No newline at end of file
+}
+
+// Helper private function to send a query and read its (client_id, points) reply through reply_pipe_path
+static int query_scores(char const *reply_pipe_path, char const *server_pipe_path, char const *request, size_t request_size,
+                        LeaderboardEntry *entries, int max) {
+  if (unlink(reply_pipe_path) != 0 && errno != ENOENT) {
+    fprintf(stderr, "Error removing fifo %s: %s\n", reply_pipe_path, strerror(errno));
+    return -1;
+  }
+
+  if (mkfifo(reply_pipe_path, 0666) != 0) {
+    fprintf(stderr, "Error creating fifo %s: %s\n", reply_pipe_path, strerror(errno));
+    return -1;
+  }
+
+  // Opened for reading and writing so the server finds a reader when it answers
+  int reply_pipe = open(reply_pipe_path, O_RDWR);
+  if (reply_pipe == -1) {
+    fprintf(stderr, "Error opening: %s\n", strerror(errno));
+    unlink(reply_pipe_path);
+    return -1;
+  }
+
+  int server_pipe = open(server_pipe_path, O_WRONLY);
+  if (server_pipe == -1) {
+    fprintf(stderr, "Error opening: %s\n", strerror(errno));
+    close(reply_pipe);
+    unlink(reply_pipe_path);
+    return -1;
+  }
+
+  // The whole request in one write so it never interleaves with other requests
+  int sent = write(server_pipe, request, request_size) == (ssize_t)request_size;
+  close(server_pipe);
+
+  char op_code;
+  int count = -1;
+  if (sent &&
+      read(reply_pipe, &op_code, 1) == 1 && op_code == request[0] &&
+      read(reply_pipe, &count, sizeof(int)) == sizeof(int)) {
+    for (int i = 0; i < count; i++) {
+      LeaderboardEntry entry;
+      if (read(reply_pipe, &entry.client_id, sizeof(int)) != sizeof(int) ||
+          read(reply_pipe, &entry.points, sizeof(int)) != sizeof(int)) {
+        count = -1;
+        break;
+      }
+      if (i < max) {
+        entries[i] = entry;
+      }
+    }
+    if (count > max) {
+      count = max;
+    }
+  }
+  else {
+    fprintf(stderr, "Error reading scores: %s\n", strerror(errno));
+    count = -1;
+  }
+
+  close(reply_pipe);
+  unlink(reply_pipe_path);
+  return count;
+}
+
+int pacman_leaderboard(char const *reply_pipe_path, char const *server_pipe_path, LeaderboardEntry *entries, int max) {
+  // Op code + reply path
+  char request[1 + MAX_PIPE_PATH_LENGTH] = {0};
+  request[0] = OP_CODE_LEADERBOARD;
+  strncpy(request + 1, reply_pipe_path, MAX_PIPE_PATH_LENGTH - 1);
+
+  return query_scores(reply_pipe_path, server_pipe_path, request, sizeof(request), entries, max);
+}
+
+int pacman_highscores(char const *reply_pipe_path, char const *server_pipe_path, int level, LeaderboardEntry *entries, int max) {
+  // Op code + reply path + level
+  char request[1 + MAX_PIPE_PATH_LENGTH + sizeof(int)] = {0};
+  request[0] = OP_CODE_HIGHSCORES;
+  strncpy(request + 1, reply_pipe_path, MAX_PIPE_PATH_LENGTH - 1);
+  memcpy(request + 1 + MAX_PIPE_PATH_LENGTH, &level, sizeof(int));
+
+  return query_scores(reply_pipe_path, server_pipe_path, request, sizeof(request), entries, max);
+}
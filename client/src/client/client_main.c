@@ -18,6 +18,70 @@ bool stop_execution = false;
 int tempo = 0;
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Input to display latency, every input is sent with a sequence number the server echoes in its frames
+#define INPUTS_IN_FLIGHT 256 // send times kept, an input echoed later than this is not measured
+static long long sent_us[INPUTS_IN_FLIGHT];
+static int next_seq = 0;
+static int last_echoed = -1;
+static long long *latencies = NULL; // microseconds, one per echoed input
+static size_t n_latencies = 0, latencies_capacity = 0;
+
+// Helper private function to send a command and remember when it left
+static void play(char command) {
+    pthread_mutex_lock(&mutex);
+    int seq = next_seq++;
+    sent_us[seq % INPUTS_IN_FLIGHT] = monotonic_us();
+    pthread_mutex_unlock(&mutex);
+
+    pacman_play_seq(command, seq);
+}
+
+// Helper private function, every input up to the one echoed by a drawn board has reached the screen, mutex is held
+static void record_latency(int input_seq, long long drawn_us) {
+    for (int seq = last_echoed + 1; seq <= input_seq; seq++) {
+        if (next_seq - seq > INPUTS_IN_FLIGHT) continue; // Its send time was overwritten
+
+        if (n_latencies == latencies_capacity) {
+            size_t grown = latencies_capacity ? latencies_capacity * 2 : 1024;
+            long long *resized = realloc(latencies, grown * sizeof(long long));
+            if (!resized) break; // Out of memory, the rest of the range goes unmeasured
+            latencies = resized;
+            latencies_capacity = grown;
+        }
+        latencies[n_latencies++] = drawn_us - sent_us[seq % INPUTS_IN_FLIGHT];
+    }
+    if (input_seq > last_echoed) last_echoed = input_seq;
+}
+
+static int by_value(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Helper private function, nearest rank percentile of the sorted latencies in milliseconds
+static double percentile_ms(double fraction) {
+    return latencies[(size_t)(fraction * (n_latencies - 1) + 0.5)] / 1000.0;
+}
+
+// Helper private function to print the latency summary once the terminal is restored
+static void report_latency(void) {
+    if (n_latencies == 0) {
+        printf("Input latency: no input was echoed by the server\n");
+        return;
+    }
+
+    qsort(latencies, n_latencies, sizeof(long long), by_value);
+    long long total = 0;
+    for (size_t i = 0; i < n_latencies; i++) total += latencies[i];
+
+    char summary[160];
+    snprintf(summary, sizeof(summary), "Input latency over %zu inputs (ms): mean %.1f p50 %.1f p90 %.1f p99 %.1f max %.1f\n",
+             n_latencies, total / 1000.0 / n_latencies, percentile_ms(0.50), percentile_ms(0.90), percentile_ms(0.99),
+             latencies[n_latencies - 1] / 1000.0);
+    printf("%s", summary);
+    log_info("%s", summary);
+}
+
 static void *receiver_thread(void *arg) {
     (void)arg;
     while (true) {
@@ -43,6 +107,7 @@ static void *receiver_thread(void *arg) {
 
         draw_board_client(board);
         refresh_screen();
+        if (board.input_seq != -1) record_latency(board.input_seq, monotonic_us());
 
         // Check for game over or victory to stop execution
         if (board.game_over || board.victory)
@@ -68,12 +133,14 @@ int main(int argc, char *argv[]) {
 
     // If commands_file is provided, open it
     int cmd_fd = (commands_file) ? open(commands_file, O_RDONLY) : -1;
+    static line_reader_t cmd_reader;
+    reader_init(&cmd_reader, cmd_fd);
 
     char req_pipe_path[MAX_PIPE_PATH_LENGTH], notif_pipe_path[MAX_PIPE_PATH_LENGTH]; // Paths for the named pipes
     snprintf(req_pipe_path, MAX_PIPE_PATH_LENGTH, "/tmp/%s_request", client_id); // Create request pipe path
     snprintf(notif_pipe_path, MAX_PIPE_PATH_LENGTH, "/tmp/%s_notification", client_id); // Create notification pipe path
 
-    open_debug_file("client-debug.log");
+    log_open("client-debug.log", LOG_DEBUG);
     if (pacman_connect(req_pipe_path, notif_pipe_path, register_pipe) != 0) return 1; // Connect to server
 
     memset(&board, 0, sizeof(Board)); // Initialize board
@@ -106,7 +173,7 @@ int main(int argc, char *argv[]) {
 
         if (cmd_fd != -1) {
             // Read command from file
-            int bytes = read_line(cmd_fd, line_buffer);
+            int bytes = read_line(&cmd_reader, line_buffer);
             
             if (bytes > 0) {
                 // Ignore the comments and empty lines
@@ -133,7 +200,7 @@ int main(int argc, char *argv[]) {
                         int t = tempo;
                         pthread_mutex_unlock(&mutex);
 
-                        pacman_play('T'); // Send 'T' command to server
+                        play('T'); // Send 'T' command to server
                         sleep_ms(t);      // Wait for the tempo
                     }
                     continue; // Continue to next iteration 
@@ -142,7 +209,7 @@ int main(int argc, char *argv[]) {
                 command = cmd_char; 
             } else if (bytes == 0) {
                 // Rewind the file to read commands again
-                lseek(cmd_fd, 0, SEEK_SET); 
+                reader_rewind(&cmd_reader);
                 continue;
             }
         } else {
@@ -157,7 +224,7 @@ int main(int argc, char *argv[]) {
         }
         
         // Send the command to the server
-        pacman_play(command);
+        play(command);
         
         // If command is 'Q', set game_over to true and exit loop
         if (command == 'Q') {
@@ -190,7 +257,9 @@ int main(int argc, char *argv[]) {
     if (board.data) free(board.data);
 
     terminal_cleanup();
-    close_debug_file();
+    report_latency();
+    free(latencies);
+    log_close();
 
     return 0;
 }
\ No newline at end of file
@@ -4,25 +4,6 @@
 #include <stdarg.h>
 #include <time.h>
 
-FILE * debugfile;
-
-void open_debug_file(char *filename) {
-    debugfile = fopen(filename, "w");
-}
-
-void close_debug_file() {
-    fclose(debugfile);
-}
-
-void debug(const char * format, ...) {
-    va_list args;
-    va_start(args, format);
-    vfprintf(debugfile, format, args);
-    va_end(args);
-
-    fflush(debugfile);
-}
-
 void sleep_ms(int milliseconds) {
     struct timespec ts;
     ts.tv_sec = milliseconds / 1000;
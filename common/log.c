@@ -0,0 +1,204 @@
+#include "log.h"
+#include <stdalign.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <time.h>
+
+#define LOG_MAX_RINGS 4096 // threads that ever logged at the same time
+#define LOG_CACHE_LINE 64
+
+// Single producer, single consumer ring of text, handed to another thread once its owner exits
+typedef struct {
+    alignas(LOG_CACHE_LINE) atomic_ulong head; // written by the producer
+    unsigned long cached_tail; // producer's last look at tail
+    atomic_ulong dropped; // lines lost to a full ring
+    atomic_int owned;
+    alignas(LOG_CACHE_LINE) atomic_ulong tail; // written by the flusher
+    char data[LOG_RING_SIZE];
+} log_ring_t;
+
+atomic_int log_level = -1;
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER; // only taken to add a ring
+static log_ring_t *rings[LOG_MAX_RINGS];
+static atomic_int n_rings;
+static pthread_key_t ring_key; // releases the ring of a thread when it exits
+static _Thread_local log_ring_t *thread_ring;
+
+// Owned by the flusher thread
+static FILE *log_file;
+static pthread_t flusher_tid;
+static atomic_int stopping;
+static int running;
+static unsigned long reported_dropped;
+
+static const char *level_names[] = {"error", "warn", "info", "debug"};
+
+// Helper private function, called at thread exit with the ring of the thread
+static void release_ring(void *ring) {
+    atomic_store_explicit(&((log_ring_t *)ring)->owned, 0, memory_order_release);
+}
+
+// Helper private function to give the calling thread a ring, a free one first, NULL if none is left
+static log_ring_t *claim_ring(void) {
+    int count = atomic_load_explicit(&n_rings, memory_order_acquire);
+    for (int i = 0; i < count && !thread_ring; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong_explicit(&rings[i]->owned, &expected, 1,
+                                                    memory_order_acquire, memory_order_relaxed)) {
+            thread_ring = rings[i];
+            thread_ring->cached_tail = atomic_load_explicit(&thread_ring->tail, memory_order_acquire);
+        }
+    }
+
+    if (!thread_ring) {
+        pthread_mutex_lock(&rings_lock);
+        count = atomic_load_explicit(&n_rings, memory_order_relaxed);
+        if (count < LOG_MAX_RINGS) {
+            log_ring_t *ring = aligned_alloc(LOG_CACHE_LINE, sizeof(log_ring_t));
+            if (ring) {
+                memset(ring, 0, sizeof(log_ring_t));
+                atomic_store_explicit(&ring->owned, 1, memory_order_relaxed);
+                rings[count] = ring;
+                atomic_store_explicit(&n_rings, count + 1, memory_order_release); // Flusher sees the ring initialized
+                thread_ring = ring;
+            }
+        }
+        pthread_mutex_unlock(&rings_lock);
+    }
+
+    if (thread_ring) {
+        pthread_setspecific(ring_key, thread_ring);
+    }
+    return thread_ring;
+}
+
+void log_write(const char *format, ...) {
+    char line[LOG_LINE_MAX];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length <= 0) return;
+    if (length >= (int)sizeof(line)) length = sizeof(line) - 1; // Truncated
+
+    log_ring_t *ring = thread_ring ? thread_ring : claim_ring();
+    if (!ring) return;
+
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - ring->cached_tail > LOG_RING_SIZE - (unsigned long)length) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->cached_tail > LOG_RING_SIZE - (unsigned long)length) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return;
+        }
+    }
+
+    size_t start = head & (LOG_RING_SIZE - 1);
+    size_t first = LOG_RING_SIZE - start < (size_t)length ? LOG_RING_SIZE - start : (size_t)length;
+    memcpy(ring->data + start, line, first);
+    memcpy(ring->data, line + first, length - first); // Wrapped around
+    atomic_store_explicit(&ring->head, head + length, memory_order_release);
+}
+
+// Helper private function to move every ring's pending text to the file, whether anything was written
+static int drain_rings(void) {
+    int wrote = 0;
+    unsigned long dropped = 0;
+    int count = atomic_load_explicit(&n_rings, memory_order_acquire);
+
+    for (int r = 0; r < count; r++) {
+        log_ring_t *ring = rings[r];
+        unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        if (tail == head) continue;
+
+        size_t start = tail & (LOG_RING_SIZE - 1);
+        size_t pending = head - tail;
+        size_t first = LOG_RING_SIZE - start < pending ? LOG_RING_SIZE - start : pending;
+        fwrite(ring->data + start, 1, first, log_file);
+        fwrite(ring->data, 1, pending - first, log_file);
+        atomic_store_explicit(&ring->tail, head, memory_order_release); // The bytes can be reused
+        wrote = 1;
+    }
+
+    if (dropped > reported_dropped) {
+        fprintf(log_file, "%lu log lines dropped on full rings\n", dropped - reported_dropped);
+        reported_dropped = dropped;
+        wrote = 1;
+    }
+    if (wrote) fflush(log_file);
+    return wrote;
+}
+
+static void *flusher_thread(void *arg) {
+    (void)arg;
+    struct timespec interval = {0, LOG_FLUSH_MS * 1000000L};
+    while (1) {
+        int stop = atomic_load(&stopping);
+        drain_rings();
+        if (stop) break;
+        nanosleep(&interval, NULL);
+    }
+    return NULL;
+}
+
+int log_open(const char *path, int level) {
+    log_file = fopen(path, "w");
+    if (!log_file) return -1;
+
+    if (pthread_key_create(&ring_key, release_ring) != 0) {
+        fclose(log_file);
+        log_file = NULL;
+        return -1;
+    }
+
+    atomic_store(&stopping, 0);
+    if (pthread_create(&flusher_tid, NULL, flusher_thread, NULL) != 0) {
+        pthread_key_delete(ring_key);
+        fclose(log_file);
+        log_file = NULL;
+        return -1;
+    }
+    running = 1;
+    log_set_level(level);
+    return 0;
+}
+
+void log_close(void) {
+    if (!running) return;
+
+    atomic_store(&log_level, -1);
+    atomic_store(&stopping, 1);
+    pthread_join(flusher_tid, NULL); // Its last pass writes whatever is left
+    running = 0;
+
+    fclose(log_file);
+    log_file = NULL;
+}
+
+void log_set_level(int level) {
+    if (level < -1) level = -1;
+    if (level > LOG_DEBUG) level = LOG_DEBUG;
+    atomic_store(&log_level, level);
+}
+
+int log_level_parse(const char *name) {
+    for (int level = LOG_ERROR; level <= LOG_DEBUG; level++) {
+        if (strcasecmp(name, level_names[level]) == 0) return level;
+    }
+
+    char *end;
+    long level = strtol(name, &end, 10);
+    if (*name && *end == '\0' && level >= LOG_ERROR && level <= LOG_DEBUG) return (int)level;
+    return -1;
+}
+
+const char *log_level_name(int level) {
+    return level >= LOG_ERROR && level <= LOG_DEBUG ? level_names[level] : "off";
+}
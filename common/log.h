@@ -0,0 +1,69 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdatomic.h>
+
+/*
+Leveled debug log shared by the server, the client and the tools.
+Every thread that logs formats into its own single producer ring, no lock and
+no syscall; one flusher thread writes the rings to the log file every
+LOG_FLUSH_MS. Lines come grouped by thread within a flush, and are dropped
+(and counted) when a thread's ring is full.
+
+Levels above LOG_COMPILE_LEVEL (e.g. -DLOG_COMPILE_LEVEL=LOG_INFO) are compiled
+out, the rest cost one relaxed load when disabled at runtime: the arguments are
+not even evaluated.
+*/
+
+#define LOG_ERROR 0
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+
+#define LOG_RING_SIZE 16384 // bytes per thread, power of two
+#define LOG_LINE_MAX 1024 // longer lines are truncated
+#define LOG_FLUSH_MS 50 // how often the flusher drains the rings
+
+extern atomic_int log_level; // runtime level, -1 (nothing) until log_open
+
+#define LOG_AT(level, ...)                                                                   \
+    do {                                                                                     \
+        if ((level) <= LOG_COMPILE_LEVEL &&                                                  \
+            (level) <= atomic_load_explicit(&log_level, memory_order_relaxed)) {             \
+            log_write(__VA_ARGS__);                                                          \
+        }                                                                                    \
+    } while (0)
+
+#define log_error(...) LOG_AT(LOG_ERROR, __VA_ARGS__)
+#define log_warn(...) LOG_AT(LOG_WARN, __VA_ARGS__)
+#define log_info(...) LOG_AT(LOG_INFO, __VA_ARGS__)
+#define log_debug(...) LOG_AT(LOG_DEBUG, __VA_ARGS__)
+
+// The old synchronous debug(), now the debug level of the log
+#define debug(...) log_debug(__VA_ARGS__)
+
+/*
+Opens path and starts the flusher, lines of level and below are kept.
+-1 on error, nothing is logged then
+*/
+int log_open(const char *path, int level);
+
+// Stops the flusher after writing every pending line, closes the file
+void log_close(void);
+
+// Changes the runtime level, clamped to the known levels (-1 silences the log)
+void log_set_level(int level);
+
+// Level named error, warn, info or debug (or its number), -1 if unknown
+int log_level_parse(const char *name);
+
+const char *log_level_name(int level);
+
+// Appends one printf formatted line to the calling thread's ring, use the log_* macros
+void log_write(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
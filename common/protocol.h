@@ -3,11 +3,21 @@
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 
+// Most entries in a leaderboard or high scores reply, keeps the reply below PIPE_BUF so it is written atomically
+#define MAX_LEADERBOARD_SIZE 256
+
+// Bytes of an OP_CODE_PLAY_SEQ request: op code, command, int sequence number
+#define PLAY_SEQ_MESSAGE_SIZE (2 + sizeof(int))
+
 enum {
   OP_CODE_CONNECT = 1,
   OP_CODE_DISCONNECT = 2,
   OP_CODE_PLAY = 3,
   OP_CODE_BOARD = 4,
+  OP_CODE_LEADERBOARD = 5,
+  OP_CODE_HIGHSCORES = 6,
+  OP_CODE_PLAY_SEQ = 7, // play + int input sequence number, echoed by the frames that follow
+  OP_CODE_BOARD_SEQ = 8, // board + int sequence number of the last input applied to it
 };
 
 #endif
\ No newline at end of file
@@ -1,7 +1,12 @@
 #include "utils.h"
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>  
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
 
 char* get_board_displayed(board_t* board) {
     size_t buffer_size = (board->width * board->height) + 1; 
@@ -11,6 +16,10 @@ char* get_board_displayed(board_t* board) {
         return NULL;
     }
     
+    return get_board_displayed_into(board, output);
+}
+
+char* get_board_displayed_into(board_t* board, char* output) {
     int pos = 0;
     
     for (int y = 0; y < board->height; y++) {
@@ -49,7 +58,7 @@ char* get_board_displayed(board_t* board) {
                     break;
 
                 case ' ': // Empty space
-                    if (board->board[index].has_portal) {
+                    if (board_has_portal(board, index)) {
                         output[pos++] = '@';
                     }
                     else if (board->board[index].has_dot) {
@@ -72,12 +81,30 @@ char* get_board_displayed(board_t* board) {
 }
 
 
-int read_line(int fd, char *buf) {
+void reader_init(line_reader_t *reader, int fd) {
+    reader->fd = fd;
+    reader->pos = 0;
+    reader->len = 0;
+}
+
+int read_line(line_reader_t *reader, char *buf) {
     int i = 0;
-    char c;
-    ssize_t n;
+    int got_any = 0;
 
-    while ((n = read(fd, &c, 1)) == 1) {
+    while (1) {
+        if (reader->pos == reader->len) {
+            ssize_t n = read(reader->fd, reader->buf, READER_BUFFER_SIZE);
+            if (n == -1) {
+                buf[i] = '\0';
+                return -1;
+            }
+            if (n == 0) break; // end of file
+            reader->pos = 0;
+            reader->len = n;
+        }
+
+        char c = reader->buf[reader->pos++];
+        got_any = 1;
         if (c == '\r') continue; 
         if (c == '\n') break;
         buf[i++] = c; 
@@ -85,7 +112,111 @@ int read_line(int fd, char *buf) {
     }
 
     buf[i] = '\0';
-    if (n == -1) return -1;
-    if (n == 0 && i == 0) return 0;
+    if (!got_any) return 0;
     return i;                         
-}
\ No newline at end of file
+}
+
+void reader_rewind(line_reader_t *reader) {
+    lseek(reader->fd, 0, SEEK_SET);
+    reader->pos = 0;
+    reader->len = 0;
+}
+
+static inline int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+span_t span_next_line(span_t *text, int *ok) {
+    span_t line = {text->ptr, 0};
+    *ok = text->len > 0;
+
+    const char *end = text->len ? memchr(text->ptr, '\n', text->len) : NULL;
+    size_t consumed = end ? (size_t)(end - text->ptr) + 1 : text->len;
+    line.len = end ? (size_t)(end - text->ptr) : text->len;
+    if (line.len > 0 && line.ptr[line.len - 1] == '\r') line.len--;
+
+    text->ptr += consumed;
+    text->len -= consumed;
+    return line;
+}
+
+span_t span_next_token(span_t *line) {
+    while (line->len > 0 && is_blank(*line->ptr)) {
+        line->ptr++;
+        line->len--;
+    }
+
+    span_t token = {line->ptr, 0};
+    while (token.len < line->len && !is_blank(token.ptr[token.len])) {
+        token.len++;
+    }
+
+    line->ptr += token.len;
+    line->len -= token.len;
+    return token;
+}
+
+int span_equals(span_t span, const char *word) {
+    size_t len = strlen(word);
+    return span.len == len && memcmp(span.ptr, word, len) == 0;
+}
+
+int span_atoi(span_t span) {
+    int value = 0;
+    int sign = 1;
+    size_t i = 0;
+
+    if (i < span.len && (span.ptr[i] == '-' || span.ptr[i] == '+')) {
+        sign = span.ptr[i] == '-' ? -1 : 1;
+        i++;
+    }
+    for (; i < span.len && span.ptr[i] >= '0' && span.ptr[i] <= '9'; i++) {
+        value = value * 10 + (span.ptr[i] - '0');
+    }
+    return sign * value;
+}
+
+int map_file(const char *path, span_t *out) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    out->len = st.st_size;
+    out->ptr = NULL;
+    if (out->len > 0) {
+        void *data = mmap(NULL, out->len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        out->ptr = data;
+    }
+
+    close(fd); // The mapping stays valid
+    return 0;
+}
+
+void unmap_file(span_t *file) {
+    if (file->ptr && file->len > 0) {
+        munmap((void *)file->ptr, file->len);
+    }
+    file->ptr = NULL;
+    file->len = 0;
+}
+
+long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
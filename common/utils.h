@@ -2,6 +2,7 @@
 #define UTILS_H
 
 #include "board.h"
+#include <stddef.h>
 #define MAX_COMMAND_LENGTH 256
 
 /**
@@ -12,6 +13,72 @@
  * @return Dynamically allocated string with board representation
  */
 char* get_board_displayed(board_t* board);
-int read_line(int fd, char *buf);
+
+/**
+ * Same as get_board_displayed but writes into a caller owned buffer
+ * of at least width * height + 1 bytes (e.g. board->frame).
+ *
+ * @return output
+ */
+char* get_board_displayed_into(board_t* board, char* output);
+#define READER_BUFFER_SIZE 65536
+
+/**
+ * Buffered line reader, refills with one read() per READER_BUFFER_SIZE bytes
+ * instead of one per byte.
+ */
+typedef struct {
+    int fd;
+    size_t pos; // next unread byte in buf
+    size_t len; // valid bytes in buf
+    char buf[READER_BUFFER_SIZE];
+} line_reader_t;
+
+void reader_init(line_reader_t *reader, int fd);
+
+/**
+ * Reads the next line (without '\r' / '\n') into buf, at most MAX_COMMAND_LENGTH - 1 chars.
+ *
+ * @return length of the line, 0 at end of file, -1 on error
+ */
+int read_line(line_reader_t *reader, char *buf);
+
+// Goes back to the beginning of the file
+void reader_rewind(line_reader_t *reader);
+
+/**
+ * Non owning slice of a text buffer. Tokenizing with spans never writes to
+ * the text, so unlike strtok it is reentrant and works on mmap'd read-only files.
+ */
+typedef struct {
+    const char *ptr;
+    size_t len;
+} span_t;
+
+// Pops the next line from text (without '\r' / '\n'), sets *ok to 0 once text is exhausted
+span_t span_next_line(span_t *text, int *ok);
+
+// Pops the next whitespace separated token from line, empty span when there is none
+span_t span_next_token(span_t *line);
+
+// Whether the span holds exactly word
+int span_equals(span_t span, const char *word);
+
+// atoi for spans, stops at the first non digit
+int span_atoi(span_t span);
+
+/**
+ * Maps a whole file read-only. Empty files give an empty span.
+ *
+ * @return 0 on success, -1 on error
+ */
+int map_file(const char *path, span_t *out);
+void unmap_file(span_t *file);
+
+// Microseconds of CLOCK_MONOTONIC, for measuring intervals
+long long monotonic_us(void);
+
+// Same clock in nanoseconds, for the latency histograms
+long long monotonic_ns(void);
 
 #endif
\ No newline at end of file
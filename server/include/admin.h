@@ -0,0 +1,41 @@
+#ifndef ADMIN_H
+#define ADMIN_H
+
+#include <pthread.h>
+#include "session.h"
+#include "buffer.h"
+
+/*
+Admin control socket, a UNIX stream socket next to the register pipe (<register_pipe>.admin).
+One command per connection, one JSON object back, e.g. `echo sessions | socat - UNIX-CONNECT:<path>`:
+
+    sessions          active sessions: id, level, points, ticks, frames, frame rate, queued commands
+    kill <client_id>  ends the session of a client as if it had disconnected
+    drain             stops accepting clients, running games go on; reply counts the games left
+    pause-accept      stops accepting clients for a while
+    resume-accept     accepts clients again, after a pause or a drain
+    stats             slot states, pending connects and the server counters (stats.h)
+    trace <seconds>   records a timeline of every thread for that long into a Chrome trace file (trace.h)
+    flight <client_id> writes the flight recorder of a session: its last inputs and frames (flight.h)
+    latency           tick lateness, lock wait, render and send percentiles, per slot (histogram.h)
+    locks             wait and hold time of every lock call site, LOCK_PROFILE builds only (lockprof.h)
+    log-level [level] shows or changes what server-debug.log keeps: error, warn, info or debug (log.h)
+*/
+
+typedef enum {
+    ACCEPT_OPEN = 0,
+    ACCEPT_PAUSED,
+    ACCEPT_DRAINING,
+} accept_mode_t;
+
+// Starts the admin thread on path, the sessions are only read (with their locks) and signalled. -1 on error
+int admin_init(const char *path, session_data_t *sessions, int n_sessions, pthread_mutex_t *sessions_mutex,
+               request_buffer_t *requests);
+
+// Whether new clients should be bound, checked by the workers for every connect request
+int admin_accepting(void);
+
+// Stops the admin thread and removes the socket
+void admin_shutdown(void);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#define ARENA_ALIGN 64 // cache line, arrays written by different threads never share one
+#define ARENA_MIN_BLOCK 4096
+
+typedef struct arena_block {
+    struct arena_block *next; // older block, NULL for the first one
+    size_t capacity; // usable bytes after the header
+    size_t used; // bytes already handed out from this block
+} arena_block_t;
+
+/*
+Bump allocator that owns every level-lifetime allocation of a session slot
+(cells, entities, move scripts, frame buffer). Nothing is freed individually,
+arena_reset drops everything at once and keeps the memory for the next level.
+*/
+typedef struct {
+    arena_block_t *head; // block currently being bumped
+    size_t used; // bytes handed out since the last reset
+    size_t capacity; // bytes reserved across all blocks
+    size_t high_water; // largest `used` ever seen in this arena
+    unsigned long resets; // number of resets (level unloads)
+    unsigned long block_allocs; // number of times the arena had to call malloc
+
+    pthread_mutex_t *locks; // cell lock pool, initialised once and reused
+    int n_locks; // locks initialised so far (lock high water mark)
+} arena_t;
+
+void arena_init(arena_t *arena);
+
+// Returns zeroed memory aligned to ARENA_ALIGN (a cache line), NULL if out of memory
+void *arena_alloc(arena_t *arena, size_t size);
+
+// Same as arena_alloc but filled with a copy of src instead of zeros
+void *arena_copy(arena_t *arena, const void *src, size_t size);
+
+// Returns `count` initialised cell mutexes, growing the pool if needed
+pthread_mutex_t *arena_locks(arena_t *arena, int count);
+
+// Forgets every allocation, keeps the memory (and the locks) for reuse
+void arena_reset(arena_t *arena);
+
+// Frees every block and destroys the lock pool
+void arena_destroy(arena_t *arena);
+
+#endif
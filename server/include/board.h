@@ -5,8 +5,16 @@
 #define MAX_LEVELS 20
 #define MAX_FILENAME 256
 #define MAX_GHOSTS 25
+#define CACHE_LINE_SIZE 64
 
 #include <pthread.h>
+#include "log.h"
+#include <stdalign.h>
+#include <stdint.h>
+#include "arena.h"
+#include "chase.h"
+#include "script.h"
+#include "rng.h"
 
 typedef enum {
     REACHED_PORTAL = 1,
@@ -21,6 +29,11 @@ typedef struct {
     int turns_left;
 } command_t;
 
+// Flags of a cell in a level template grid, one byte per cell
+#define CELL_WALL 0x1
+#define CELL_DOT 0x2
+#define CELL_PORTAL 0x4
+
 typedef struct {
     int pos_x, pos_y; //current position
     int alive; // if is alive
@@ -30,37 +43,77 @@ typedef struct {
     int current_move;
     int n_moves;
     int waiting;
+    rng_t rng; // for R moves
 } pacman_t;
 
 typedef struct {
-    int pos_x, pos_y; //current position
+    alignas(CACHE_LINE_SIZE) int pos_x; // one cache line per ghost, each one is written by its own thread
+    int pos_y; //current position
     int passo; // number of plays to wait before starting
-    command_t moves[MAX_MOVES];
-    int n_moves;
-    int current_move;
     int waiting;
     int charged;
+    script_vm_t script; // program counter over the bytecode shared with the level template
+    rng_t rng; // for R moves, owned by the thread of the ghost
 } ghost_t;
 
+// Mutable plane of a cell, walls and portals live in the read-only grid of the level
 typedef struct {
     char content; // stuff like 'P' for pacman 'M' for monster and 'W' for wall
-    int has_dot; // whether there is a dot in this position or not
-    int has_portal; // whether there is a portal in this position or not
-    pthread_mutex_t lock;
+    uint8_t has_dot; // whether there is a dot in this position or not
 } board_pos_t;
 
+typedef struct {
+    int pos_x, pos_y; // spawn position
+    int placed; // whether the spawn position was given (or found)
+    int passo; // number of plays to wait before starting
+    const uint8_t* script; // ghost bytecode, owned by the catalog (or the mmap'd pack)
+    uint32_t script_len;
+} entity_spec_t;
+
+/*
+Parsed level, immutable once in the catalog.
+Boards are instantiated from it without touching the filesystem
+*/
+typedef struct {
+    char name[MAX_FILENAME]; // level file name without .lvl
+    int width, height; // dimensions of the board
+    int tempo; // duration of each play in ms
+    const uint8_t* grid; // CELL_* flags, row-major, entities are placed on load
+    entity_spec_t pacman;
+    int n_ghosts;
+    entity_spec_t* ghosts;
+
+    // Ready-to-play image built once by prepare_level, boards are memcpy'd from it
+    int prepared;
+    board_pos_t* cells; // mutable plane with dots, pacman and ghosts in place
+    pacman_t pacman_image;
+    ghost_t* ghost_images;
+    int has_chasers; // some ghost script uses H
+    const uint8_t* distances; // all-pairs fields for chasers on small levels (chase.h), NULL otherwise
+} level_template_t;
+
 typedef struct {
     int width, height; //dimensions of the board
+    const uint8_t* grid; // walls and portals, shared read-only with the level template
     board_pos_t* board; //actual board, most likely a row-major matrix
+    pthread_mutex_t* cell_locks; // one lock per cell, same indexing as board (pooled by the arena)
     int n_pacmans; //number of pacmans in the board
     pacman_t* pacmans; // array containing every pacman in the board to iterate through when processing
     int n_ghosts; //number of ghosts in the board
     ghost_t* ghosts; // array containing every ghost in the board to iterate through when processing
     char level_name[256]; //name for the level file to keep track of which will be the next
-    char pacman_file[256]; // file with pacman movements
-    char ghosts_files[MAX_GHOSTS][256]; // files with monster movements
+    int level_index; // position in the catalog, set by the session that loads it
     int tempo; // Duracao de cada jogada???
-    pthread_rwlock_t state_lock;
+    arena_t* arena; // owns every allocation of the loaded level, must be set before load_level
+    char* frame; // width * height + 1 bytes for get_board_displayed_into
+
+    // Steps to the pacman from every cell (chase.h), read by chasing ghosts with state_lock held
+    const uint8_t* chase_field; // field of the all-pairs table or chase_fields[0], NULL if no ghost chases
+    int chase_target; // pacman cell of chase_field, -1 before the first one
+    const uint8_t* distances; // all-pairs table of the level
+    uint8_t* chase_fields[2]; // without a table: the published BFS field and the one chase_build fills
+    int chase_pending; // pacman cell chase_build searches from, -1 when chase_field is up to date
+    chase_queue_t chase_queue; // BFS scratch of the pacman thread, freed by unload_level
 } board_t;
 
 /*Move pacman/monster in a certain direction on the board must check for boundaries, walls and other monsters
@@ -68,7 +121,25 @@ Maybe do 1 function for pacman and 1 for monsters if required
 Maybe do 1 function for each direction
 */
 int move_pacman(board_t* board, int pacman_index, command_t* command);
-int move_ghost(board_t* board, int ghost_index, command_t* command);
+// Runs the script of the ghost for one turn
+int move_ghost(board_t* board, int ghost_index);
+
+/*
+Points the chase field at the pacman after it moved, with state_lock held for writing.
+Levels with an all-pairs table are done, on the others a pacman on a new cell returns 1:
+the thread that moves the pacman then runs chase_build without the lock, ghosts keep
+chasing the previous cell meanwhile, and chase_publish with the lock held for writing
+*/
+int chase_update(board_t* board);
+void chase_build(board_t* board);
+void chase_publish(board_t* board);
+
+// Gives the pacman and every ghost their own generator derived from seed
+void seed_board(board_t* board, uint64_t seed);
+
+static inline int board_has_portal(const board_t* board, int index) {
+    return board->grid[index] & CELL_PORTAL;
+}
 
 /*Remove an object (Pacman)*/
 void kill_pacman(board_t* board, int pacman_index);
@@ -80,21 +151,17 @@ int load_pacman(board_t* board);
 int load_ghost(board_t* board);
 
 
+// Builds the ready-to-play image of a level template, memory comes from arena
+int prepare_level(level_template_t* level, arena_t* arena);
+
 /*
-Fils the board with the information coming from the file
+Fils the board with the information coming from a prepared level (no file I/O)
+Only the mutable planes are copied, all the memory comes from board->arena
 */
-int load_level(board_t* board, char* filename, char* dirname, int accumulated_points);
-// Unloads levels loaded by load_level
+int load_level(board_t* board, const level_template_t* level, int accumulated_points);
+// Unloads levels loaded by load_level, resetting the arena for the next one
 void unload_level(board_t * board);
 
-// DEBUG FILE
-
-void open_debug_file(char *filename);
-
-void close_debug_file();
-
-void debug(const char * format, ...);
-
 void print_board(board_t* board);
 
 void sleep_ms(int milliseconds);
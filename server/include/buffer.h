@@ -11,6 +11,7 @@ typedef struct {
     int client_id;
     char req_pipe_path[MAX_PIPE_PATH_LENGTH];
     char notif_pipe_path[MAX_PIPE_PATH_LENGTH];
+    long long received_us; // monotonic_us() when the host thread read the request
 } connection_request_t;
 
 typedef struct {
@@ -27,6 +28,7 @@ typedef struct {
 void buffer_init(request_buffer_t *buf); 
 void buffer_insert(request_buffer_t *buf, connection_request_t req); 
 connection_request_t buffer_remove(request_buffer_t *buf);
+int buffer_count(request_buffer_t *buf); // Requests waiting for a worker
 void buffer_destroy(request_buffer_t *buf);
 
 #endif
@@ -0,0 +1,55 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include "board.h"
+#include "arena.h"
+#include "utils.h"
+
+#define CATALOG_MAX_LOADERS 8 // threads parsing the levels directory in parallel
+
+/*
+Every level of the levels directory, parsed once.
+A catalog is immutable: a change in the directory builds a new version and the
+sessions keep playing on the version they acquired when they started.
+*/
+typedef struct {
+    unsigned long version; // increases on every reload
+    atomic_int refs; // sessions pinned to this version + 1 while it is the current one
+    int n_levels;
+    int n_skipped; // level files that failed to parse or validate and were left out
+    level_template_t* levels; // sorted by file name
+    int max_ghosts; // ghosts of the busiest level, sizes the ghost workers of a session
+    size_t bytes; // memory used by the templates
+    arena_t arena; // owns the levels array
+    int n_arenas;
+    arena_t arenas[CATALOG_MAX_LOADERS]; // one per loader thread, own the templates
+    span_t pack; // mapping of a compiled level pack, grids and scripts point into it
+    pthread_mutex_t prepare_lock; // guards the lazy board images of the levels and `arena`
+} level_catalog_t;
+
+/*
+Loads the levels and starts watching them for changes, -1 on error
+levels_path is either a levels directory or a pack compiled by levelc
+*/
+int catalog_init(char *levels_path);
+
+// Pins the current version, must be paired with catalog_release
+level_catalog_t* catalog_acquire(void);
+
+void catalog_release(level_catalog_t* catalog);
+
+// Whether no reload happened since catalog was acquired
+int catalog_is_current(const level_catalog_t* catalog);
+
+/*
+Returns level `index` ready to be instantiated by load_level, NULL on error
+The board image is built on first use, so levels nobody plays cost nothing
+*/
+const level_template_t* catalog_level(level_catalog_t* catalog, int index);
+
+// Stops the watcher and drops the current version
+void catalog_shutdown(void);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef CHASE_H
+#define CHASE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+/*
+Distance fields for chasing ghosts (script command H).
+Distances are steps over the walls of a level grid (CELL_WALL), other entities
+do not block them, so they only change when the chased cell changes.
+
+A field keeps the steps of every cell mod 3, in 2 bits. Next to a cell the steps
+only go one down, stay or go one up, so mod 3 is enough to find a closer neighbour
+and a field costs a quarter of a byte per cell, however long the paths are.
+*/
+
+#define CHASE_UNREACHABLE 3 // walls and cells with no path to the target
+#define CHASE_FIELD_BYTES(n_cells) (((size_t)(n_cells) + 3) / 4)
+#define CHASE_ALL_PAIRS_MAX_CELLS 1024 // up to 256 KiB of fields per level
+
+// Steps from cell to the target of field, mod 3, or CHASE_UNREACHABLE
+static inline int chase_steps(const uint8_t* field, int cell) {
+    return (field[cell >> 2] >> ((cell & 3) * 2)) & 3;
+}
+
+// BFS scratch, a ring that grows with the widest frontier instead of holding every cell
+typedef struct {
+    int* cells;
+    unsigned capacity; // power of two, 0 until the first search
+} chase_queue_t;
+
+void chase_queue_free(chase_queue_t* queue);
+
+/*
+Breadth first search from target over the grid into field (CHASE_FIELD_BYTES of width * height)
+-1 if the queue could not grow, every cell is then left unreachable
+*/
+int chase_bfs(const uint8_t* grid, int width, int height, int target, uint8_t* field, chase_queue_t* queue);
+
+/*
+Fields towards every cell, the one towards cell t starts at t * CHASE_FIELD_BYTES(width * height)
+Returns NULL if the level is too big (CHASE_ALL_PAIRS_MAX_CELLS) or on allocation failure
+*/
+const uint8_t* chase_all_pairs(const uint8_t* grid, int width, int height, arena_t* arena);
+
+#endif
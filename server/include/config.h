@@ -0,0 +1,40 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+#include "log.h"
+
+#define DEFAULT_PREWARM_SLOTS 4
+#define DEFAULT_LEADERBOARD_K 5
+#define DEFAULT_HIGHSCORES_N 10
+#define DEFAULT_SCORE_COMPACT_SEC 30
+#define DEFAULT_EVENTS_ROTATE_MB 64
+#define DEFAULT_TRACE_SEC 0
+#define DEFAULT_LOG_LEVEL LOG_DEBUG
+
+/*
+Server tuning knobs, read once at startup from PACMAN_* environment variables
+so the command line stays <levels> <max_games> <register_pipe>
+*/
+typedef struct {
+    int prewarm_slots; // PACMAN_PREWARM_SLOTS: idle slots kept with level 0 loaded and threads parked
+    int fixed_seed; // whether PACMAN_SEED was given
+    uint64_t seed; // PACMAN_SEED: every session uses it, to replay a logged session
+    int leaderboard_k; // PACMAN_LEADERBOARD_K: clients kept in the leaderboard, at most MAX_LEADERBOARD_SIZE
+    const char *score_dir; // PACMAN_SCORE_DIR: where the high score log and index live, the working directory by default
+    int highscores_n; // PACMAN_HIGHSCORES_N: best results kept per table, at most MAX_LEADERBOARD_SIZE
+    int score_compact_sec; // PACMAN_SCORE_COMPACT_SEC: how often the score log is folded into the index
+    const char *events_dir; // PACMAN_EVENTS_DIR: where the game event stream goes, NULL (off) by default
+    long events_rotate_bytes; // PACMAN_EVENTS_ROTATE_MB: size of each events file
+    const char *trace_dir; // PACMAN_TRACE_DIR: where trace windows are written, the working directory by default
+    int trace_sec; // PACMAN_TRACE_SEC: trace window opened at startup, 0 (none) by default
+    const char *flight_dir; // PACMAN_FLIGHT_DIR: where flight recorder dumps go, the working directory by default
+    int log_level; // PACMAN_LOG_LEVEL: error, warn, info or debug, what server-debug.log keeps
+} server_config_t;
+
+extern server_config_t server_config;
+
+// Fills server_config, values are clamped to what max_games and the protocol allow
+void config_load(int max_games);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+
+/*
+Binary game event stream for offline analytics.
+Every thread that emits owns a single producer ring, so recording an event is a
+few stores and a release, no lock and no syscall. One writer thread drains every
+ring into events.<n>.bin files of the events directory, rotated by size, which
+`make eventdump` decodes. Records come grouped by thread rather than in time
+order, the decoder sorts them.
+
+File layout (native byte order): event_file_header_t, then event_t records
+*/
+
+#define EVENTS_MAGIC "PACEVTS" // 8 bytes with the terminator
+#define EVENTS_VERSION 1
+#define EVENTS_RING_SIZE 512 // per thread, power of two
+#define EVENTS_MAX_RINGS 4096 // threads that ever emitted at the same time
+#define EVENTS_FLUSH_MS 50 // how often the writer drains the rings
+
+typedef enum {
+    EVENT_CONNECT = 1, // value: 1 if the slot was pre-warmed
+    EVENT_DISCONNECT, // the client left, value: event_reason_t
+    EVENT_DEATH, // pacman killed at x, y, value: ghost index or -1 when the pacman walked into a ghost
+    EVENT_PORTAL, // level completed at x, y, value: points of the level
+    EVENT_CHARGE, // charged dash ending at x, y, value: ghost index
+    EVENT_GAME_END, // session over, value: total points
+} event_type_t;
+
+typedef enum {
+    EVENT_BY_CLIENT = 0, // disconnect op code
+    EVENT_PIPE_CLOSED, // request pipe closed or unreadable
+} event_reason_t;
+
+typedef struct {
+    uint64_t time_us; // monotonic_us()
+    int32_t client_id;
+    uint16_t type; // event_type_t
+    uint16_t level;
+    int16_t x, y;
+    int32_t value;
+} event_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size; // sizeof(event_t)
+} event_file_header_t;
+
+/*
+Starts the writer, files of at most rotate_bytes go to dir.
+Without a call every event_emit returns right away. -1 on error
+*/
+int events_init(const char *dir, long rotate_bytes);
+
+// Records an event from the calling thread, drops it if the thread's ring is full
+void event_emit(event_type_t type, int client_id, int level, int x, int y, int value);
+
+// Drains what is left and stops the writer
+void events_shutdown(void);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "board.h"
+
+/*
+Flight recorder, always on: every session slot keeps its last FLIGHT_RING_SIZE
+inputs and frames (with the position of every entity) in a fixed ring. Recording
+is one atomic add and plain stores, no lock and no syscall. The ring is written
+out as text on SIGSEGV/SIGABRT, on the admin `flight` command and when a session
+ends abnormally, to <dir>/flight.<client_id>.<unix time>.<n>.txt
+*/
+
+#define FLIGHT_RING_SIZE 256 // records per slot, power of two
+
+typedef enum {
+    FLIGHT_INPUT = 1, // command applied by the pacman thread
+    FLIGHT_FRAME, // board sent by the manager thread
+} flight_type_t;
+
+typedef struct {
+    atomic_ulong stamp; // position in the ring + 1 once the record is complete, 0 while it is written
+    int64_t time_us; // monotonic_us()
+    uint8_t type; // flight_type_t
+    char command; // FLIGHT_INPUT
+    int8_t result; // FLIGHT_INPUT: move_t
+    uint8_t n_ghosts; // FLIGHT_FRAME
+    int16_t level;
+    int32_t value; // input sequence number (-1 if none) or frame number
+    int32_t points; // points of the level (input) or of the game (frame)
+    int16_t pacman[2];
+    int16_t ghosts[MAX_GHOSTS][2];
+} flight_record_t;
+
+// Allocates the rings of n_slots slots and installs the crash handlers, dumps go to dir. -1 on error
+int flight_init(int n_slots, const char *dir);
+void flight_destroy(void);
+
+// Starts recording a new session in slot, what the last one recorded is dropped
+void flight_begin(int slot, int client_id, uint64_t seed);
+
+// Recorders, the board must be locked against moves (state_lock)
+void flight_input(int slot, const board_t *board, char command, int seq, int result);
+void flight_frame(int slot, const board_t *board, long frame, int points);
+
+// The session of slot is ending on an error, flight_end will dump it
+void flight_abnormal(int slot);
+
+// Session over, dumps the ring if flight_abnormal was called
+void flight_end(int slot);
+
+/*
+Writes the ring of slot to a new file, path gets its name (may be NULL).
+Async-signal-safe. -1 on error or if no session is recorded in slot
+*/
+int flight_dump(int slot, const char *reason, char *path, int path_size);
+
+// Slot recording client_id, -1 if none
+int flight_slot_of(int client_id);
+
+#endif
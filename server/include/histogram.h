@@ -0,0 +1,93 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "board.h"
+
+/*
+Log-bucketed latency histograms (HDR style): every power of two of nanoseconds
+is split in 2^HIST_SUB_BITS buckets, so any value is kept within 12.5% up to
+2^HIST_MAX_EXP ns. Each session thread records into its own histograms with
+plain relaxed stores, no lock and no shared line; readers sum the threads of a
+slot (and all slots) when dumping.
+*/
+
+#define HIST_SUB_BITS 3
+#define HIST_MAX_EXP 36 // about 68 s, longer values land in the last bucket
+#define HIST_BUCKETS ((HIST_MAX_EXP - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+typedef enum {
+    HIST_TICK_LATE, // how long past its deadline a sleeping session thread woke up
+    HIST_LOCK_WAIT, // time to acquire a state, session or cell lock (lockprof.h), 0 when it was free
+    HIST_RENDER, // building a frame with get_board_displayed_into
+    HIST_SEND, // writing a frame to the notification pipe
+    HIST_METRICS,
+} hist_metric_t;
+
+// Recording threads of a session slot
+enum {
+    HIST_PACMAN = 0,
+    HIST_MANAGER,
+    HIST_GHOST, // + ghost worker index
+    HIST_THREADS = HIST_GHOST + MAX_GHOSTS,
+};
+
+typedef struct {
+    atomic_uint counts[HIST_BUCKETS];
+    atomic_ullong total_ns;
+    atomic_ullong max_ns;
+} histogram_t;
+
+// Sum of histograms, a snapshot the recording threads keep moving past
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} hist_merged_t;
+
+// Histograms of one thread, written by that thread only
+typedef struct {
+    alignas(CACHE_LINE_SIZE) histogram_t metrics[HIST_METRICS];
+} hist_thread_t;
+
+// Allocates the histograms of n_slots session slots, -1 on error
+int hist_init(int n_slots);
+void hist_destroy(void);
+
+// Makes the calling thread record into thread `role` of slot, for its whole life
+void hist_bind(int slot, int role);
+
+/*
+Starts the histograms of slot over for a new client, shown next to them.
+Called while no thread of the slot runs, what the last session recorded stays in the totals
+*/
+void hist_tag(int slot, int client_id);
+
+// Adds a value to the calling thread's histogram, nothing if the thread is not bound
+void hist_record(hist_metric_t metric, long long ns);
+
+// Adds a value to a histogram shared by several threads, such as the server wide ones of stats.c
+void hist_add(histogram_t *hist, long long ns);
+
+// Adds the current counts of hist to merged
+void hist_merge(hist_merged_t *merged, const histogram_t *hist);
+
+// Upper bound of the bucket holding the given fraction of the samples, at most the max
+uint64_t hist_percentile(const hist_merged_t *merged, double fraction);
+
+// Lock acquisitions that record their wait as HIST_LOCK_WAIT, 1 if the lock was held by another thread
+int hist_mutex_lock(pthread_mutex_t *mutex);
+int hist_rwlock_rdlock(pthread_rwlock_t *lock);
+int hist_rwlock_wrlock(pthread_rwlock_t *lock);
+
+// Percentiles of every metric, for all slots and then for each slot, -1 on error
+int hist_dump(const char *path);
+
+// Same numbers as one JSON object, for the admin socket
+void hist_write_json(FILE *f);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+/*
+Top K clients by total points, kept up to date as scores change.
+Writers (pacman threads, session cleanup) are serialized by a mutex and only
+touch the top K, readers copy a seqlock snapshot without taking any lock.
+*/
+
+typedef struct {
+    int client_id;
+    int points;
+} leaderboard_entry_t;
+
+// One score per session slot, k entries kept, -1 on allocation failure
+int leaderboard_init(int n_slots, int k);
+void leaderboard_destroy(void);
+
+// Score of the client playing in slot, scores of a session never go down
+void leaderboard_update(int slot, int client_id, int points);
+
+// The session of slot ended
+void leaderboard_remove(int slot);
+
+// Copies at most max entries of the current snapshot, best first, returns how many
+int leaderboard_read(leaderboard_entry_t *entries, int max);
+
+#endif
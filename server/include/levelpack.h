@@ -0,0 +1,67 @@
+#ifndef LEVELPACK_H
+#define LEVELPACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "board.h"
+#include "utils.h"
+
+/*
+Compiled level pack, produced offline by `make levelc` and mmap'd by the server.
+Native byte order, every offset is from the start of the file and 8 byte aligned.
+
+    levelpack_header_t
+    levelpack_level_t[n_levels]
+    per level: grid (width * height CELL_* bytes), levelpack_entity_t[n_ghosts], ghost bytecode (script.h)
+*/
+
+#define LEVELPACK_MAGIC "PACLVLS" // 8 bytes with the terminator
+#define LEVELPACK_VERSION 2 // 2: ghost scripts as bytecode
+#define LEVELPACK_NAME_LENGTH 64
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_levels;
+    uint64_t size; // size of the whole file
+} levelpack_header_t;
+
+typedef struct {
+    int32_t pos_x, pos_y;
+    int32_t placed;
+    int32_t passo;
+    uint32_t script_len;
+    uint32_t reserved;
+    uint64_t script_offset; // script_len bytes of bytecode
+} levelpack_entity_t;
+
+typedef struct {
+    char name[LEVELPACK_NAME_LENGTH];
+    int32_t width, height;
+    int32_t tempo;
+    int32_t n_ghosts;
+    uint64_t grid_offset; // width * height bytes
+    uint64_t ghosts_offset; // n_ghosts levelpack_entity_t
+    levelpack_entity_t pacman;
+} levelpack_level_t;
+
+/*
+Checks that a level can be played: dimensions, spawns inside the board and off walls,
+ghosts with a script and a portal reachable from the pacman spawn.
+Returns 0 if valid, -1 with the reason in err otherwise
+*/
+int levelpack_validate(const level_template_t *level, char *err, size_t err_size);
+
+// Writes levels into a pack at path (through a temporary file + rename), -1 on error
+int levelpack_write(const char *path, const level_template_t *levels, int n_levels);
+
+/*
+Maps a pack and checks its header and every offset.
+On success pack holds the mapping and the level table points into it
+*/
+int levelpack_open(const char *path, span_t *pack, const levelpack_level_t **levels, int *n_levels);
+
+// Template of a level of an open pack; grid and scripts stay in the mapping, entity specs come from arena
+int levelpack_template(const span_t *pack, const levelpack_level_t *packed, level_template_t *level, arena_t *arena);
+
+#endif
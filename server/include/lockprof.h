@@ -0,0 +1,77 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "histogram.h"
+
+/*
+Lock contention profiler, built in with `make LOCK_PROFILE=1`.
+Every MUTEX_LOCK/RWLOCK_*LOCK call site keeps its own counters: acquisitions,
+acquisitions that found the lock held, total and max wait, total and max hold
+time (until the matching *_UNLOCK of the same thread). The sites are reported by
+lock name and function on SIGUSR1 (server_locks.txt) and by the admin `locks`
+command. In a normal build the macros are the plain lock calls and nothing of
+this is compiled.
+*/
+
+typedef struct lock_site {
+    const char *name; // lock name given at the call site
+    const char *function;
+    int line;
+    atomic_int registered;
+    struct lock_site *next; // list of every site that was used
+    atomic_ulong acquisitions;
+    atomic_ulong contended;
+    atomic_ullong wait_ns, wait_max_ns;
+    atomic_ullong hold_ns, hold_max_ns;
+} lock_site_t;
+
+#ifdef LOCK_PROFILE
+
+#define LOCK_SITE_INIT(lock_name) {.name = (lock_name), .function = __func__, .line = __LINE__}
+
+#define PROFILED_LOCK(lock_name, lock, acquire)                                       \
+    do {                                                                              \
+        static lock_site_t lock_site_ = LOCK_SITE_INIT(lock_name);                   \
+        long long lock_start_ = lockprof_now();                                       \
+        int lock_contended_ = (acquire);                                              \
+        lockprof_acquired(&lock_site_, (lock), lock_start_, lock_contended_);        \
+    } while (0)
+
+#define PROFILED_UNLOCK(lock, release) \
+    do {                               \
+        lockprof_released(lock);       \
+        release;                       \
+    } while (0)
+
+#else
+
+#define PROFILED_LOCK(lock_name, lock, acquire) ((void)(acquire))
+#define PROFILED_UNLOCK(lock, release) ((void)(release))
+
+#endif
+
+// Lock calls of the profiled locks, they also feed the HIST_LOCK_WAIT histogram
+#define MUTEX_LOCK(lock_name, mutex) PROFILED_LOCK(lock_name, mutex, hist_mutex_lock(mutex))
+#define MUTEX_UNLOCK(mutex) PROFILED_UNLOCK(mutex, pthread_mutex_unlock(mutex))
+#define RWLOCK_RDLOCK(lock_name, rwlock) PROFILED_LOCK(lock_name, rwlock, hist_rwlock_rdlock(rwlock))
+#define RWLOCK_WRLOCK(lock_name, rwlock) PROFILED_LOCK(lock_name, rwlock, hist_rwlock_wrlock(rwlock))
+#define RWLOCK_UNLOCK(rwlock) PROFILED_UNLOCK(rwlock, pthread_rwlock_unlock(rwlock))
+
+// Helpers of the macros
+long long lockprof_now(void);
+void lockprof_acquired(lock_site_t *site, const void *lock, long long start_ns, int contended);
+void lockprof_released(const void *lock);
+
+// Whether the server was built with LOCK_PROFILE
+int lockprof_enabled(void);
+
+// Every used site by total wait, -1 if not profiling or on error
+int lockprof_dump(const char *path);
+
+// Same numbers as one JSON object, for the admin socket
+void lockprof_write_json(FILE *f);
+
+#endif
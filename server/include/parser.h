@@ -4,12 +4,20 @@
 #include "board.h"
 #define MAX_COMMAND_LENGTH 256
 
-int read_level(board_t* board, char* filename, char* dirname);
-int read_pacman(board_t* board, int points);
-int read_ghosts(board_t* board);
+/*
+Parses a level file (and its pacman and ghost files) into a template allocated from arena
+Files are mmap'd and tokenized with spans, so several levels can be parsed at the same time
+as long as every thread uses its own arena
+*/
+int read_level(level_template_t* level, arena_t* arena, char* filename, char* dirname);
+int read_pacman(level_template_t* level, char* pacman_file);
+/*
+Ghost files: PASSO / POS header, then one command per line compiled to bytecode (script.h):
+W A S D C R, H to step towards the pacman, T n to wait n turns, REPEAT k ... END blocks (nested up to SCRIPT_MAX_DEPTH)
+and LOOP, the point the script restarts from once it ends (the beginning by default)
+*/
+int read_ghost(entity_spec_t* ghost, arena_t* arena, char* ghost_file);
 char** sort_levels(char *levels_dir, int *count_out);
 void free_level_names(char **level_names, int count);
-int count_levels(char *levels_dir);
-int load_sorted_level(board_t *board, char *levels_dir, int level_index, int accumulated_points);
 
 #endif
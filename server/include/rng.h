@@ -0,0 +1,46 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/*
+PCG32 generator (single stream, XSH-RR output). 8 bytes of state, so every
+entity owns one: random moves never touch shared state or a lock, and a
+session replays the same moves from the same seed
+*/
+typedef struct {
+    uint64_t state;
+} rng_t;
+
+#define RNG_MULTIPLIER 6364136223846793005ULL
+#define RNG_INCREMENT 1442695040888963407ULL
+
+static inline uint32_t rng_next(rng_t* rng) {
+    uint64_t old = rng->state;
+    rng->state = old * RNG_MULTIPLIER + RNG_INCREMENT;
+    uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    uint32_t rot = (uint32_t)(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+static inline void rng_seed(rng_t* rng, uint64_t seed) {
+    rng->state = 0;
+    rng_next(rng);
+    rng->state += seed;
+    rng_next(rng);
+}
+
+// Uniform in [0, bound) for the small bounds of the game, the modulo bias is negligible
+static inline uint32_t rng_below(rng_t* rng, uint32_t bound) {
+    return rng_next(rng) % bound;
+}
+
+// splitmix64 finalizer, derives independent entity seeds from a session seed
+static inline uint64_t rng_mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef SCORES_H
+#define SCORES_H
+
+#include <stdint.h>
+
+/*
+Persistent high scores.
+Session threads only queue results in memory; a background thread appends them
+to a log with one write and one fsync per batch, and periodically compacts the
+log into an index of the best results, which queries read through an mmap.
+
+Files in the score directory (native byte order):
+    scores.<gen>.log  score_record_t appended as games end, gen increases on every compaction
+    scores.idx        scores_index_header_t, then 1 + n_levels tables (all time, then each level)
+                      of a uint32 count, a uint32 pad and top_n score_record_t, best first
+*/
+
+#define SCORES_MAGIC "PACSCOR" // 8 bytes with the terminator
+#define SCORES_VERSION 1
+#define SCORES_MAX_LEVELS 1024 // per level tables kept in the index
+#define SCORES_QUEUE_SIZE 1024 // results waiting for the writer, more are dropped
+#define SCORES_SYNC_MS 100 // batching window of the writer, at most one fsync per window
+
+typedef enum {
+    SCORE_GAME = 1, // a finished game, level holds the levels completed
+    SCORE_LEVEL = 2, // a completed level, points scored in that level only
+} score_kind_t;
+
+typedef struct {
+    int32_t kind;
+    int32_t client_id;
+    int32_t level;
+    int32_t points;
+    int64_t time; // unix seconds, filled by scores_record
+    uint64_t seed; // session seed, to replay the game
+} score_record_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t top_n; // entries per table
+    uint32_t n_levels;
+    uint32_t reserved;
+    uint64_t next_gen; // first log not folded into this index
+    uint64_t records; // results folded so far
+} scores_index_header_t;
+
+/*
+Opens the store in dir, folding any log left by a previous run, and starts the writer.
+top_n results are kept per table, a new index is built every compact_sec seconds. -1 on error
+*/
+int scores_init(const char *dir, int top_n, int compact_sec);
+
+// Queues a result, never waits for I/O
+void scores_record(score_kind_t kind, int client_id, int level, int points, uint64_t seed);
+
+// Best results of level (-1 for whole games) from the index, best first, returns how many
+int scores_top(int level, score_record_t *out, int max);
+
+// Flushes the queue, compacts once more and stops the writer
+void scores_shutdown(void);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdint.h>
+#include "arena.h"
+
+/*
+Ghost scripts compiled to bytecode: one opcode byte, followed by a native uint32
+operand for the opcodes that take one. A script always ends with SCRIPT_JUMP back
+to its loop point, so the interpreter never runs off the end.
+*/
+
+#define SCRIPT_MAX_DEPTH 4 // nested REPEAT blocks
+
+typedef enum {
+    SCRIPT_UP = 1, // W
+    SCRIPT_LEFT, // A
+    SCRIPT_DOWN, // S
+    SCRIPT_RIGHT, // D
+    SCRIPT_CHARGE, // C
+    SCRIPT_RANDOM, // R
+    SCRIPT_WAIT, // T n, operand: turns to wait
+    SCRIPT_REPEAT, // REPEAT k, operand: times the block runs
+    SCRIPT_END_REPEAT, // END, operand: offset of the block body
+    SCRIPT_JUMP, // operand: offset to continue from, last instruction only
+    SCRIPT_CHASE, // H, one step towards the pacman (appended to keep compiled packs valid)
+} script_op_t;
+
+// Interpreter state of one ghost, the code is shared read-only by every ghost running it
+typedef struct {
+    const uint8_t* code;
+    uint32_t pc; // offset of the next instruction
+    uint32_t turns_left; // turns still to wait in the current SCRIPT_WAIT, 0 when not waiting
+    uint16_t depth; // open REPEAT blocks
+    uint16_t repeat_left[SCRIPT_MAX_DEPTH];
+} script_vm_t;
+
+// Incremental compiler, fed one command at a time by the ghost file parser
+typedef struct {
+    uint8_t* code; // malloc'd until script_finish
+    uint32_t len, capacity;
+    uint32_t loop_at; // target of the final jump
+    uint32_t open[SCRIPT_MAX_DEPTH]; // body offsets of the open REPEAT blocks
+    uint32_t depth;
+    int actions; // actions after loop_at, a script needs at least one
+    const char* error; // why the last call failed
+} script_builder_t;
+
+void script_builder_init(script_builder_t* builder);
+void script_builder_destroy(script_builder_t* builder);
+
+// Appends an action (SCRIPT_UP .. SCRIPT_WAIT or SCRIPT_CHASE), operand is only used by SCRIPT_WAIT
+int script_emit(script_builder_t* builder, script_op_t op, uint32_t operand);
+
+// REPEAT k ... END, -1 on bad nesting or k outside [1, UINT16_MAX]
+int script_begin_repeat(script_builder_t* builder, uint32_t times);
+int script_end_repeat(script_builder_t* builder);
+
+// LOOP: once the script ends it continues from here instead of from the beginning
+int script_mark_loop(script_builder_t* builder);
+
+/*
+Closes the script and copies it into arena. Returns -1 (and builder->error) if the
+script cannot run: open blocks or no action to loop over
+*/
+int script_finish(script_builder_t* builder, arena_t* arena, const uint8_t** code, uint32_t* len);
+
+// Checks bytecode coming from outside (a level pack), 0 if it is safe to run
+int script_validate(const uint8_t* code, uint32_t len);
+
+// Whether a valid script contains op
+int script_uses(const uint8_t* code, uint32_t len, script_op_t op);
+
+void script_start(script_vm_t* vm, const uint8_t* code);
+
+/*
+Runs the control instructions up to the next action of the ghost and returns it:
+W, A, S, D, C, R, H, or T for a turn spent waiting
+*/
+char script_step(script_vm_t* vm);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include "board.h"
+#include "arena.h"
+#include "catalog.h"
+#include "protocol.h"
+
+// Lifecycle of a session slot, changed only with sessions_mutex held
+typedef enum {
+    SLOT_FREE = 0,
+    SLOT_WARMING, // being prepared ahead of any client
+    SLOT_WARM, // level 0 loaded and threads parked on the start gate, waiting for a client
+    SLOT_BINDING, // taken by a worker for a client, not bound yet
+    SLOT_ACTIVE, // bound to a client, the session can be inspected
+    SLOT_CLOSING, // game over, being cleaned up
+} slot_state_t;
+
+/*
+Struct for session data
+The sessions array is shared by every worker, so the struct is split in cache lines:
+ - cold part: identity, pipes, thread ids and start gate, written only on warm up, connect and cleanup
+ - control line: session_lock together with the flags it protects (pacman and manager threads)
+ - board line: state_lock and the pointer to the played board
+ - counter lines: ticks (pacman thread) and frames (manager thread), one line each
+ - boards: the played one and the prefetched next level, after the counter lines
+Being cache line aligned, two neighbouring sessions never share a line.
+*/
+typedef struct {
+    alignas(CACHE_LINE_SIZE) slot_state_t slot_state;
+    int client_id;
+    int client_req_pipe;
+    int client_notif_pipe;
+    char client_req_path[MAX_PIPE_PATH_LENGTH];
+    char client_notif_path[MAX_PIPE_PATH_LENGTH];
+    pthread_t pacman_tid;
+    pthread_t session_tid;
+    pthread_t ghost_tids[MAX_GHOSTS];
+    int total_levels;
+    level_catalog_t *catalog; // levels version pinned for the whole session
+    arena_t arenas[2]; // level memory of the two boards, reused by every session that runs here
+    int n_ghost_threads; // ghost workers, as many as ghosts in the busiest level of the catalog
+    long long connect_us; // monotonic_us() of the connect request, for the first frame latency
+    uint64_t seed; // every random move of the session derives from it, logged at connect
+
+    // Start gate of a pre-warmed slot, opened once per session with session_lock held
+    int started;
+    pthread_cond_t start_cond;
+
+    // Hot control line, every field is only touched with session_lock held
+    struct {
+        alignas(CACHE_LINE_SIZE) pthread_mutex_t session_lock;
+        int thread_shutdown;
+        int victory;
+        int current_level;
+        int accumulated_points;
+        int next_ready; // the spare board holds level current_level + 1
+    };
+
+    // Board line, `board` is read with state_lock held and swapped with both locks held
+    struct {
+        alignas(CACHE_LINE_SIZE) pthread_rwlock_t state_lock;
+        board_t *board; // board being played, one of boards
+        int input_seq; // last OP_CODE_PLAY_SEQ input applied to the board, -1 while the client sends none
+    };
+
+    // Counters read by the admin socket, each on its own line as two threads bump them
+    alignas(CACHE_LINE_SIZE) atomic_ulong ticks; // play requests handled, by the pacman thread
+    alignas(CACHE_LINE_SIZE) atomic_ulong frames; // boards sent to the client, by the manager thread
+
+    board_t boards[2]; // played board and the spare one the next level is prefetched into
+} session_data_t;
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/*
+Server wide counters, updated lock free by the session threads
+and written to a text file on demand (SIGUSR1). Latencies go to a
+histogram_t (histogram.h), read with the same percentiles as its dumps
+*/
+
+// A client was bound to a slot, warm if the slot was pre-warmed
+void stats_connect(int warm);
+
+// Time from reading the connect request to writing the first frame
+void stats_first_frame(long long latency_us);
+
+// Writes the counters and latency percentiles to path, -1 on error
+int stats_dump(const char *path);
+
+// Same counters as one JSON object, for the admin socket
+void stats_write_json(FILE *f);
+
+#endif
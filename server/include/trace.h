@@ -0,0 +1,60 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+Timeline tracer for stutter hunting.
+While a window is open every thread records begin/end events of the hot stages
+into its own ring (a few stores, no lock); when the window ends they are
+written as Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev), one
+timeline row per thread. Outside a window each trace_begin/trace_end is a
+single relaxed load.
+*/
+
+#define TRACE_RING_SIZE 8192 // records per thread, power of two, the oldest are overwritten
+#define TRACE_MAX_RINGS 1024 // threads traced in one window
+#define TRACE_THREAD_NAME_LENGTH 32
+#define TRACE_MAX_WINDOW_SEC 60
+
+typedef enum {
+    TRACE_MOVE_PACMAN = 0,
+    TRACE_MOVE_GHOST,
+    TRACE_MOVE_GHOST_CHARGED,
+    TRACE_RENDER, // get_board_displayed_into
+    TRACE_SEND_FRAME,
+    TRACE_LOAD_LEVEL,
+    TRACE_UNLOAD_LEVEL,
+    TRACE_HANDSHAKE, // binding a connect request to a session
+    TRACE_LOCK_WAIT, // blocked on a held state_lock or cell lock
+    TRACE_NAMES,
+} trace_name_t;
+
+extern atomic_int trace_enabled;
+
+// Helper of trace_begin/trace_end, use those
+void trace_record(trace_name_t name, char phase);
+
+static inline void trace_begin(trace_name_t name) {
+    if (atomic_load_explicit(&trace_enabled, memory_order_relaxed)) trace_record(name, 'B');
+}
+
+static inline void trace_end(trace_name_t name) {
+    if (atomic_load_explicit(&trace_enabled, memory_order_relaxed)) trace_record(name, 'E');
+}
+
+// Row label of the calling thread in the next traces, printf style
+void trace_thread_name(const char *format, ...);
+
+/*
+Opens a window of `seconds` (at most TRACE_MAX_WINDOW_SEC) that ends by writing
+<dir>/trace.<unix time>.json, path gets the file name.
+-1 if a window is already open or on error
+*/
+int trace_start(const char *dir, int seconds, char *path, int path_size);
+
+// Closes an open window without writing it, at server shutdown
+void trace_shutdown(void);
+
+#endif
@@ -0,0 +1,306 @@
+#include "admin.h"
+#include "stats.h"
+#include "histogram.h"
+#include "lockprof.h"
+#include "trace.h"
+#include "flight.h"
+#include "config.h"
+#include "utils.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+
+#define ADMIN_COMMAND_LENGTH 128
+
+static atomic_int accept_mode; // accept_mode_t
+static session_data_t *slots;
+static int n_slots;
+static pthread_mutex_t *slots_mutex;
+static request_buffer_t *pending;
+
+static int listen_fd = -1;
+static char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static pthread_t admin_tid;
+
+static const char *accept_names[] = {
+    [ACCEPT_OPEN] = "open",
+    [ACCEPT_PAUSED] = "paused",
+    [ACCEPT_DRAINING] = "draining",
+};
+
+int admin_accepting(void) {
+    return atomic_load_explicit(&accept_mode, memory_order_relaxed) == ACCEPT_OPEN;
+}
+
+// Helper private function, slots in each state, sessions_mutex is taken
+static void count_slots(int *active, int *warm) {
+    *active = *warm = 0;
+    MUTEX_LOCK("sessions_mutex", slots_mutex);
+    for (int i = 0; i < n_slots; i++) {
+        if (slots[i].slot_state == SLOT_ACTIVE) (*active)++;
+        else if (slots[i].slot_state == SLOT_WARM) (*warm)++;
+    }
+    MUTEX_UNLOCK(slots_mutex);
+}
+
+static void list_sessions(FILE *out) {
+    long long now = monotonic_us();
+    int first = 1;
+
+    fprintf(out, "{\"sessions\":[");
+    MUTEX_LOCK("sessions_mutex", slots_mutex); // Keeps the slots bound while they are read
+    for (int i = 0; i < n_slots; i++) {
+        session_data_t *session = &slots[i];
+        if (session->slot_state != SLOT_ACTIVE) continue;
+
+        MUTEX_LOCK("session_lock", &session->session_lock);
+        int level = session->current_level;
+        int points = session->accumulated_points;
+        MUTEX_UNLOCK(&session->session_lock);
+
+        RWLOCK_RDLOCK("state_lock", &session->state_lock);
+        points += session->board->pacmans[0].points;
+        RWLOCK_UNLOCK(&session->state_lock);
+
+        unsigned long ticks = atomic_load_explicit(&session->ticks, memory_order_relaxed);
+        unsigned long frames = atomic_load_explicit(&session->frames, memory_order_relaxed);
+        double seconds = (now - session->connect_us) / 1e6;
+
+        // Commands the client sent that the pacman thread has not read yet, clients send them as PLAY_SEQ
+        int queued = 0;
+        if (ioctl(session->client_req_pipe, FIONREAD, &queued) == -1) queued = 0;
+
+        fprintf(out, "%s{\"slot\":%d,\"client_id\":%d,\"level\":%d,\"points\":%d,\"ticks\":%lu,\"frames\":%lu,"
+                     "\"frame_rate\":%.1f,\"queue_depth\":%d,\"uptime_s\":%.1f}",
+                first ? "" : ",", i, session->client_id, level, points, ticks, frames,
+                frames > 1 && seconds > 0 ? (frames - 1) / seconds : 0.0, (int)(queued / PLAY_SEQ_MESSAGE_SIZE), seconds); // First frame is sent at connect
+        first = 0;
+    }
+    MUTEX_UNLOCK(slots_mutex);
+    fprintf(out, "],\"accept\":\"%s\"}\n", accept_names[atomic_load(&accept_mode)]);
+}
+
+// Helper private function to end a client's session through its own request pipe, as a disconnect would
+static void kill_client(FILE *out, int client_id) {
+    char req_path[MAX_PIPE_PATH_LENGTH];
+    int found = 0;
+
+    MUTEX_LOCK("sessions_mutex", slots_mutex);
+    for (int i = 0; i < n_slots && !found; i++) {
+        if (slots[i].slot_state == SLOT_ACTIVE && slots[i].client_id == client_id) {
+            memcpy(req_path, slots[i].client_req_path, MAX_PIPE_PATH_LENGTH);
+            found = 1;
+        }
+    }
+    MUTEX_UNLOCK(slots_mutex);
+
+    if (!found) {
+        fprintf(out, "{\"ok\":false,\"error\":\"no session for client %d\"}\n", client_id);
+        return;
+    }
+
+    // One byte is below PIPE_BUF, so it never splits a play request of the client
+    char op_code = OP_CODE_DISCONNECT;
+    int fd = open(req_path, O_WRONLY | O_NONBLOCK);
+    if (fd == -1 || write(fd, &op_code, 1) != 1) {
+        fprintf(out, "{\"ok\":false,\"error\":\"%s\"}\n", strerror(errno));
+    }
+    else {
+        fprintf(out, "{\"ok\":true,\"client_id\":%d}\n", client_id);
+    }
+    if (fd != -1) close(fd);
+}
+
+// Helper private function to change the accept mode and report it with the games still running
+static void set_accept(FILE *out, accept_mode_t mode) {
+    atomic_store(&accept_mode, mode);
+
+    int active, warm;
+    count_slots(&active, &warm);
+    fprintf(out, "{\"ok\":true,\"accept\":\"%s\",\"active\":%d}\n", accept_names[mode], active);
+}
+
+static void server_stats(FILE *out) {
+    int active, warm;
+    count_slots(&active, &warm);
+
+    fprintf(out, "{\"accept\":\"%s\",\"slots\":%d,\"active\":%d,\"warm\":%d,\"pending_connects\":%d,\"counters\":",
+            accept_names[atomic_load(&accept_mode)], n_slots, active, warm, buffer_count(pending));
+    stats_write_json(out);
+    fprintf(out, "}\n");
+}
+
+// Helper private function to run one command line and write its reply
+static void run_command(char *line, FILE *out) {
+    char *save;
+    char *command = strtok_r(line, " \t\r\n", &save);
+    char *arg = strtok_r(NULL, " \t\r\n", &save);
+
+    if (!command) {
+        fprintf(out, "{\"ok\":false,\"error\":\"empty command\"}\n");
+    }
+    else if (strcmp(command, "sessions") == 0) {
+        list_sessions(out);
+    }
+    else if (strcmp(command, "kill") == 0) {
+        char *end;
+        long id = arg ? strtol(arg, &end, 10) : 0;
+        if (!arg || *end != '\0') {
+            fprintf(out, "{\"ok\":false,\"error\":\"usage: kill <client_id>\"}\n");
+        }
+        else {
+            kill_client(out, (int)id);
+        }
+    }
+    else if (strcmp(command, "drain") == 0) {
+        set_accept(out, ACCEPT_DRAINING);
+    }
+    else if (strcmp(command, "pause-accept") == 0) {
+        set_accept(out, ACCEPT_PAUSED);
+    }
+    else if (strcmp(command, "resume-accept") == 0) {
+        set_accept(out, ACCEPT_OPEN);
+    }
+    else if (strcmp(command, "stats") == 0) {
+        server_stats(out);
+    }
+    else if (strcmp(command, "trace") == 0) {
+        char *end;
+        long seconds = arg ? strtol(arg, &end, 10) : 0;
+        char path[MAX_FILENAME];
+        if (!arg || *end != '\0' || seconds < 1) {
+            fprintf(out, "{\"ok\":false,\"error\":\"usage: trace <seconds>\"}\n");
+        }
+        else if (trace_start(server_config.trace_dir, (int)seconds, path, sizeof(path)) != 0) {
+            fprintf(out, "{\"ok\":false,\"error\":\"%s\"}\n", errno == EBUSY ? "a trace is already running" : strerror(errno));
+        }
+        else {
+            fprintf(out, "{\"ok\":true,\"seconds\":%ld,\"path\":\"%s\"}\n",
+                    seconds > TRACE_MAX_WINDOW_SEC ? TRACE_MAX_WINDOW_SEC : seconds, path);
+        }
+    }
+    else if (strcmp(command, "flight") == 0) {
+        char *end;
+        long id = arg ? strtol(arg, &end, 10) : 0;
+        char path[MAX_FILENAME];
+        int slot = arg && *end == '\0' ? flight_slot_of((int)id) : -1;
+        if (!arg || *end != '\0') {
+            fprintf(out, "{\"ok\":false,\"error\":\"usage: flight <client_id>\"}\n");
+        }
+        else if (slot == -1 || flight_dump(slot, "admin request", path, sizeof(path)) != 0) {
+            fprintf(out, "{\"ok\":false,\"error\":\"no flight recorder for client %ld\"}\n", id);
+        }
+        else {
+            fprintf(out, "{\"ok\":true,\"client_id\":%ld,\"path\":\"%s\"}\n", id, path);
+        }
+    }
+    else if (strcmp(command, "latency") == 0) {
+        hist_write_json(out);
+        fprintf(out, "\n");
+    }
+    else if (strcmp(command, "locks") == 0) {
+        lockprof_write_json(out);
+        fprintf(out, "\n");
+    }
+    else if (strcmp(command, "log-level") == 0) {
+        int level = arg ? log_level_parse(arg) : atomic_load(&log_level);
+        if (arg && level == -1) {
+            fprintf(out, "{\"ok\":false,\"error\":\"usage: log-level [error|warn|info|debug]\"}\n");
+        }
+        else {
+            log_set_level(level);
+            fprintf(out, "{\"ok\":true,\"level\":\"%s\"}\n", log_level_name(level));
+        }
+    }
+    else {
+        fprintf(out, "{\"ok\":false,\"error\":\"unknown command\"}\n");
+    }
+}
+
+static void *admin_thread(void *arg) {
+    (void)arg;
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, NULL); // SIGUSR1 is for the host thread
+
+    while (1) {
+        int conn = accept(listen_fd, NULL, NULL);
+        if (conn == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break; // Socket shut down
+        }
+
+        // An idle admin client must not hold the socket forever
+        struct timeval timeout = {.tv_sec = 1};
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        char line[ADMIN_COMMAND_LENGTH];
+        size_t len = 0;
+        while (len < sizeof(line) - 1) {
+            ssize_t n = read(conn, line + len, sizeof(line) - 1 - len);
+            if (n <= 0) break;
+            len += n;
+            if (memchr(line + len - n, '\n', n)) break;
+        }
+        line[len] = '\0';
+
+        FILE *out = fdopen(conn, "w");
+        if (!out) {
+            close(conn);
+            continue;
+        }
+        run_command(line, out);
+        fclose(out); // Closes conn
+    }
+    return NULL;
+}
+
+int admin_init(const char *path, session_data_t *sessions, int n_sessions, pthread_mutex_t *sessions_mutex,
+               request_buffer_t *requests) {
+    slots = sessions;
+    n_slots = n_sessions;
+    slots_mutex = sessions_mutex;
+    pending = requests;
+    atomic_store(&accept_mode, ACCEPT_OPEN);
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    strcpy(socket_path, path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) return -1;
+
+    unlink(path); // Left by a previous run
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(listen_fd, 8) == -1 ||
+        pthread_create(&admin_tid, NULL, admin_thread, NULL) != 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void admin_shutdown(void) {
+    if (listen_fd == -1) return;
+
+    shutdown(listen_fd, SHUT_RDWR); // Wakes the accept
+    pthread_join(admin_tid, NULL);
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path);
+}
@@ -0,0 +1,130 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Block header rounded so that the payload keeps the arena alignment
+#define BLOCK_HEADER ((sizeof(arena_block_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static inline size_t align_up(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static inline char *block_data(arena_block_t *block) {
+    return (char *)block + BLOCK_HEADER;
+}
+
+// Helper private function to push a fresh block of at least `size` bytes
+static arena_block_t *arena_new_block(arena_t *arena, size_t size) {
+    size_t capacity = size < ARENA_MIN_BLOCK ? ARENA_MIN_BLOCK : align_up(size);
+    arena_block_t *block = aligned_alloc(ARENA_ALIGN, BLOCK_HEADER + capacity);
+    if (!block) return NULL;
+
+    block->next = arena->head;
+    block->capacity = capacity;
+    block->used = 0;
+
+    arena->head = block;
+    arena->capacity += capacity;
+    arena->block_allocs++;
+    return block;
+}
+
+void arena_init(arena_t *arena) {
+    memset(arena, 0, sizeof(arena_t));
+}
+
+// Helper private function to bump without initialising the memory
+static void *arena_bump(arena_t *arena, size_t size) {
+    size = align_up(size ? size : 1);
+
+    arena_block_t *block = arena->head;
+    if (!block || block->capacity - block->used < size) {
+        // Grow geometrically so a big level settles in a few blocks
+        size_t want = arena->capacity > size ? arena->capacity : size;
+        block = arena_new_block(arena, want);
+        if (!block) return NULL;
+    }
+
+    void *ptr = block_data(block) + block->used;
+    block->used += size;
+    arena->used += size;
+    if (arena->used > arena->high_water) {
+        arena->high_water = arena->used;
+    }
+
+    return ptr;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    void *ptr = arena_bump(arena, size);
+    if (ptr) memset(ptr, 0, size); // Same contract as calloc
+    return ptr;
+}
+
+void *arena_copy(arena_t *arena, const void *src, size_t size) {
+    void *ptr = arena_bump(arena, size);
+    if (ptr && size) memcpy(ptr, src, size);
+    return ptr;
+}
+
+pthread_mutex_t *arena_locks(arena_t *arena, int count) {
+    if (count <= arena->n_locks) {
+        return arena->locks;
+    }
+
+    pthread_mutex_t *locks = malloc(count * sizeof(pthread_mutex_t));
+    if (!locks) return NULL;
+
+    // Mutexes can not be moved, so a bigger level re-creates the pool once
+    for (int i = 0; i < arena->n_locks; i++) {
+        pthread_mutex_destroy(&arena->locks[i]);
+    }
+    free(arena->locks);
+
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_init(&locks[i], NULL);
+    }
+
+    arena->locks = locks;
+    arena->n_locks = count;
+    return locks;
+}
+
+void arena_reset(arena_t *arena) {
+    arena->resets++;
+    arena->used = 0;
+
+    if (!arena->head) return;
+
+    if (arena->head->next) {
+        // Level needed several blocks: fold them into a single one sized to the high water mark
+        arena_block_t *block = arena->head;
+        while (block) {
+            arena_block_t *next = block->next;
+            free(block);
+            block = next;
+        }
+        arena->head = NULL;
+        arena->capacity = 0;
+        arena_new_block(arena, arena->high_water);
+        return;
+    }
+
+    arena->head->used = 0;
+}
+
+void arena_destroy(arena_t *arena) {
+    arena_block_t *block = arena->head;
+    while (block) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    for (int i = 0; i < arena->n_locks; i++) {
+        pthread_mutex_destroy(&arena->locks[i]);
+    }
+    free(arena->locks);
+
+    memset(arena, 0, sizeof(arena_t));
+}
@@ -1,14 +1,17 @@
 #include "board.h"
 #include "parser.h"
+#include "chase.h"
+#include "lockprof.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <stdio.h> //snprintf
+#include <string.h>
 #include <fcntl.h>
 #include <time.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <pthread.h>
 
-FILE * debugfile;
 
 // Helper private function to find and kill pacman at specific position
 static int find_and_kill_pacman(board_t* board, int new_x, int new_y) {
@@ -60,7 +63,7 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
 
     if (direction == 'R') {
         char directions[] = {'W', 'S', 'A', 'D'};
-        direction = directions[rand() % 4];
+        direction = directions[rng_below(&pac->rng, 4)];
     }
 
     // Calculate new position based on direction
@@ -101,20 +104,20 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
 
     // locks
     if (old_index < new_index) {
-        pthread_mutex_lock(&board->board[old_index].lock);
-        pthread_mutex_lock(&board->board[new_index].lock);
+        MUTEX_LOCK("cell_lock", &board->cell_locks[old_index]);
+        MUTEX_LOCK("cell_lock", &board->cell_locks[new_index]);
     }
     else {
-        pthread_mutex_lock(&board->board[new_index].lock);
-        pthread_mutex_lock(&board->board[old_index].lock);
+        MUTEX_LOCK("cell_lock", &board->cell_locks[new_index]);
+        MUTEX_LOCK("cell_lock", &board->cell_locks[old_index]);
     }
 
     char target_content = board->board[new_index].content;
 
-    if (board->board[new_index].has_portal) {
+    if (board_has_portal(board, new_index)) {
         board->board[old_index].content = ' ';
         board->board[new_index].content = 'P';
-        return REACHED_PORTAL;
+        goto move_pacman_portal; // Cell locks outlive the level, so they must be released
     }
 
     // Check for walls
@@ -140,37 +143,48 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
     board->board[new_index].content = 'P';
 
     if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
+        MUTEX_UNLOCK(&board->cell_locks[old_index]);
+        MUTEX_UNLOCK(&board->cell_locks[new_index]);
     }
     else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
+        MUTEX_UNLOCK(&board->cell_locks[new_index]);
+        MUTEX_UNLOCK(&board->cell_locks[old_index]);
     }
     
     return VALID_MOVE;
 
     move_pacman_invalid:
     if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
+        MUTEX_UNLOCK(&board->cell_locks[old_index]);
+        MUTEX_UNLOCK(&board->cell_locks[new_index]);
     }
     else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
+        MUTEX_UNLOCK(&board->cell_locks[new_index]);
+        MUTEX_UNLOCK(&board->cell_locks[old_index]);
     }
     return INVALID_MOVE;
 
     move_pacman_dead:
     if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
+        MUTEX_UNLOCK(&board->cell_locks[old_index]);
+        MUTEX_UNLOCK(&board->cell_locks[new_index]);
     }
     else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
+        MUTEX_UNLOCK(&board->cell_locks[new_index]);
+        MUTEX_UNLOCK(&board->cell_locks[old_index]);
     }
     return DEAD_PACMAN;
+
+    move_pacman_portal:
+    if (old_index < new_index) {
+        MUTEX_UNLOCK(&board->cell_locks[old_index]);
+        MUTEX_UNLOCK(&board->cell_locks[new_index]);
+    }
+    else {
+        MUTEX_UNLOCK(&board->cell_locks[new_index]);
+        MUTEX_UNLOCK(&board->cell_locks[old_index]);
+    }
+    return REACHED_PORTAL;
 }
 
 int move_ghost_charged(board_t* board, int ghost_index, char direction) {
@@ -179,7 +193,7 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
     int y = ghost->pos_y;
     int new_x = x;
     int new_y = y;
-    int result;
+    int result = VALID_MOVE; // A dash that meets nothing runs to the border
 
     ghost->charged = 0; //uncharge
 
@@ -188,7 +202,7 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
             if (y == 0) return INVALID_MOVE;
 
             for (int i = 0; i <= y; i++) {
-                pthread_mutex_lock(&board->board[i * board->width + x].lock);
+                MUTEX_LOCK("cell_lock", &board->cell_locks[i * board->width + x]);
             }
 
             new_y = 0; // In case there is no colision
@@ -207,14 +221,14 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
             }
 
             for (int i = 0; i <= y; i++) {
-                pthread_mutex_unlock(&board->board[i * board->width + x].lock);
+                MUTEX_UNLOCK(&board->cell_locks[i * board->width + x]);
             }
             break;
         case 'S':
             if (y == board->height - 1) return INVALID_MOVE;
 
             for (int i = y; i < board->height; i++) {
-                pthread_mutex_lock(&board->board[i * board->width + x].lock);
+                MUTEX_LOCK("cell_lock", &board->cell_locks[i * board->width + x]);
             }
 
             new_y = board->height - 1; // In case there is no colision
@@ -233,14 +247,14 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
             }
 
             for (int i = y; i < board->height; i++) {
-                pthread_mutex_unlock(&board->board[i * board->width + x].lock);
+                MUTEX_UNLOCK(&board->cell_locks[i * board->width + x]);
             }
             break;
         case 'A':
             if (x == 0) return INVALID_MOVE;
 
             for (int j = 0; j <= x; j++) {
-                pthread_mutex_lock(&board->board[y * board->width + j].lock);
+                MUTEX_LOCK("cell_lock", &board->cell_locks[y * board->width + j]);
             }
 
             new_x = 0; // In case there is no colision
@@ -259,14 +273,14 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
             }
 
             for (int j = 0; j <= x; j++) {
-                pthread_mutex_unlock(&board->board[y * board->width + j].lock);
+                MUTEX_UNLOCK(&board->cell_locks[y * board->width + j]);
             }
             break;
         case 'D':
             if (x == board->width - 1) return INVALID_MOVE;
 
             for (int j = x; j < board->width; j++) {
-                pthread_mutex_lock(&board->board[y * board->width + j].lock);
+                MUTEX_LOCK("cell_lock", &board->cell_locks[y * board->width + j]);
             }
 
             new_x = board->width - 1; // In case there is no colision
@@ -285,7 +299,7 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
             }
 
             for (int j = x; j < board->width; j++) {
-                pthread_mutex_unlock(&board->board[y * board->width + j].lock);
+                MUTEX_UNLOCK(&board->cell_locks[y * board->width + j]);
             }
             break;
         default:
@@ -304,7 +318,74 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
     return result;
 }
 
-int move_ghost(board_t* board, int ghost_index, command_t* command) {
+// Helper private function, neighbour closest to the pacman along the chase field
+// 'T' when the ghost is already there or boxed in, 'R' when the pacman cannot be reached
+static char chase_direction(board_t* board, ghost_t* ghost) {
+    static const struct { char direction; int dx, dy; } steps[] = {
+        {'W', 0, -1}, {'S', 0, 1}, {'A', -1, 0}, {'D', 1, 0},
+    };
+
+    if (board->chase_target < 0) return 'R';
+    int cell = ghost->pos_y * board->width + ghost->pos_x;
+    int here = chase_steps(board->chase_field, cell);
+    if (here == CHASE_UNREACHABLE) return 'R';
+    if (cell == board->chase_target) return 'T';
+
+    // First neighbour one step closer, in W S A D order
+    int closer = (here + 2) % 3;
+    for (int k = 0; k < 4; k++) {
+        int x = ghost->pos_x + steps[k].dx;
+        int y = ghost->pos_y + steps[k].dy;
+        if (!is_valid_position(board, x, y)) continue;
+        if (chase_steps(board->chase_field, y * board->width + x) == closer) {
+            return steps[k].direction;
+        }
+    }
+    return 'T';
+}
+
+void seed_board(board_t* board, uint64_t seed) {
+    uint64_t base = rng_mix(seed);
+    for (int i = 0; i < board->n_pacmans; i++) {
+        rng_seed(&board->pacmans[i].rng, rng_mix(base ^ (uint64_t)i));
+    }
+    for (int i = 0; i < board->n_ghosts; i++) {
+        rng_seed(&board->ghosts[i].rng, rng_mix(base + (uint64_t)i + 1));
+    }
+}
+
+int chase_update(board_t* board) {
+    if (!board->distances && !board->chase_fields[0]) return 0; // no chasing ghost in this level
+
+    pacman_t* pacman = &board->pacmans[0];
+    int target = pacman->pos_y * board->width + pacman->pos_x;
+    if (target == board->chase_target || target == board->chase_pending) return 0;
+
+    if (board->distances) {
+        board->chase_field = board->distances + (size_t)target * CHASE_FIELD_BYTES(board->width * board->height);
+        board->chase_target = target;
+        return 0;
+    }
+    board->chase_pending = target;
+    return 1;
+}
+
+void chase_build(board_t* board) {
+    // Ghosts only read chase_fields[0], the pacman cell was taken by chase_update
+    chase_bfs(board->grid, board->width, board->height, board->chase_pending, board->chase_fields[1],
+              &board->chase_queue);
+}
+
+void chase_publish(board_t* board) {
+    uint8_t* built = board->chase_fields[1];
+    board->chase_fields[1] = board->chase_fields[0];
+    board->chase_fields[0] = built;
+    board->chase_field = built;
+    board->chase_target = board->chase_pending;
+    board->chase_pending = -1;
+}
+
+int move_ghost(board_t* board, int ghost_index) {
     ghost_t* ghost = &board->ghosts[ghost_index];
     int new_x = ghost->pos_x;
     int new_y = ghost->pos_y;
@@ -316,11 +397,15 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
     }
     ghost->waiting = ghost->passo;
 
-    char direction = command->command;
+    char direction = script_step(&ghost->script);
+
+    if (direction == 'H') {
+        direction = chase_direction(board, ghost);
+    }
 
     if (direction == 'R') {
         char directions[] = {'W', 'S', 'A', 'D'};
-        direction = directions[rand() % 4];
+        direction = directions[rng_below(&ghost->rng, 4)];
     }
 
     // Calculate new position based on direction
@@ -338,24 +423,21 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
             new_x++;
             break;
         case 'C': // Charge
-            ghost->current_move += 1;
             ghost->charged = 1;
             return VALID_MOVE;
-        case 'T': // Wait
-            if (command->turns_left == 1) {
-                ghost->current_move += 1; // move on
-                command->turns_left = command->turns;
-            }
-            else command->turns_left -= 1;
+        case 'T': // Wait, the countdown lives in the script state of the ghost
             return VALID_MOVE;
         default:
             return INVALID_MOVE; // Invalid direction
     }
 
     // Logic for the WASD movement
-    ghost->current_move++;
-    if (ghost->charged)
-        return move_ghost_charged(board, ghost_index, direction);
+    if (ghost->charged) {
+        trace_begin(TRACE_MOVE_GHOST_CHARGED);
+        int result = move_ghost_charged(board, ghost_index, direction);
+        trace_end(TRACE_MOVE_GHOST_CHARGED);
+        return result;
+    }
 
     // Check boundaries
     if (!is_valid_position(board, new_x, new_y)) {
@@ -368,12 +450,12 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
 
     // locks
     if (old_index < new_index) {
-        pthread_mutex_lock(&board->board[old_index].lock);
-        pthread_mutex_lock(&board->board[new_index].lock);
+        MUTEX_LOCK("cell_lock", &board->cell_locks[old_index]);
+        MUTEX_LOCK("cell_lock", &board->cell_locks[new_index]);
     }
     else {
-        pthread_mutex_lock(&board->board[new_index].lock);
-        pthread_mutex_lock(&board->board[old_index].lock);
+        MUTEX_LOCK("cell_lock", &board->cell_locks[new_index]);
+        MUTEX_LOCK("cell_lock", &board->cell_locks[old_index]);
     }
 
     char target_content = board->board[new_index].content;
@@ -411,24 +493,24 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
     board->board[new_index].content = 'M';
 
     if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
+        MUTEX_UNLOCK(&board->cell_locks[old_index]);
+        MUTEX_UNLOCK(&board->cell_locks[new_index]);
     }
     else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
+        MUTEX_UNLOCK(&board->cell_locks[new_index]);
+        MUTEX_UNLOCK(&board->cell_locks[old_index]);
     }
     
     return result;
 
     move_ghost_invalid:
     if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
+        MUTEX_UNLOCK(&board->cell_locks[old_index]);
+        MUTEX_UNLOCK(&board->cell_locks[new_index]);
     }
     else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
+        MUTEX_UNLOCK(&board->cell_locks[new_index]);
+        MUTEX_UNLOCK(&board->cell_locks[old_index]);
     }
     return INVALID_MOVE;
 }
@@ -466,56 +548,128 @@ int load_ghost(board_t* board) {
     return 0;
 }
 
-int load_level(board_t *board, char *filename, char* dirname, int points) {
+int prepare_level(level_template_t *level, arena_t *arena) {
+    int n_cells = level->width * level->height;
 
-    if (read_level(board, filename, dirname) < 0) {
-        printf("Failed to load level\n");
+    level->cells = arena_alloc(arena, n_cells * sizeof(board_pos_t));
+    level->ghost_images = arena_alloc(arena, level->n_ghosts * sizeof(ghost_t));
+    if (!level->cells || !level->ghost_images) {
         return -1;
     }
 
-    if (read_pacman(board, points) < 0) {
-        printf("Failed to load the pacman\n");
+    for (int i = 0; i < n_cells; i++) {
+        level->cells[i].content = (level->grid[i] & CELL_WALL) ? 'W' : ' ';
+        level->cells[i].has_dot = (level->grid[i] & CELL_DOT) != 0;
     }
 
-    if (read_ghosts(board) < 0) {
-        printf("Failed to read ghosts\n");
+    pacman_t* pacman = &level->pacman_image;
+    memset(pacman, 0, sizeof(pacman_t));
+    pacman->alive = 1;
+    pacman->passo = level->pacman.passo;
+    pacman->waiting = level->pacman.passo;
+    pacman->pos_x = level->pacman.pos_x;
+    pacman->pos_y = level->pacman.pos_y;
+    if (level->pacman.placed) {
+        level->cells[pacman->pos_y * level->width + pacman->pos_x].content = 'P';
     }
 
-    pthread_rwlock_init(&board->state_lock, NULL);
+    for (int i = 0; i < level->n_ghosts; i++) {
+        const entity_spec_t* spec = &level->ghosts[i];
+        ghost_t* ghost = &level->ghost_images[i];
+
+        ghost->pos_x = spec->pos_x;
+        ghost->pos_y = spec->pos_y;
+        ghost->passo = spec->passo;
+        ghost->waiting = spec->passo;
+        script_start(&ghost->script, spec->script); // Bytecode is read-only, every board shares it
+
+        if (spec->placed) {
+            level->cells[ghost->pos_y * level->width + ghost->pos_x].content = 'M';
+        }
+    }
 
-    for (int i = 0; i < board->height * board->width; i++) {
-        pthread_mutex_init(&board->board[i].lock, NULL);
+    // Chasers of small levels share one all-pairs table, bigger levels BFS per board
+    for (int i = 0; i < level->n_ghosts; i++) {
+        if (script_uses(level->ghosts[i].script, level->ghosts[i].script_len, SCRIPT_CHASE)) {
+            level->has_chasers = 1;
+        }
+    }
+    if (level->has_chasers) {
+        level->distances = chase_all_pairs(level->grid, level->width, level->height, arena);
     }
 
-    //print_board(board);
+    level->prepared = 1;
     return 0;
 }
 
-void unload_level(board_t * board) {
-    pthread_rwlock_destroy(&board->state_lock);
-    for (int i = 0; i < board->height * board->width; i++) {
-        pthread_mutex_destroy(&board->board[i].lock);
+int load_level(board_t *board, const level_template_t *level, int points) {
+    int n_cells = level->width * level->height;
+
+    board->width = level->width;
+    board->height = level->height;
+    board->tempo = level->tempo;
+    board->n_pacmans = 1;
+    board->n_ghosts = level->n_ghosts;
+    snprintf(board->level_name, sizeof(board->level_name), "%s", level->name);
+
+    // Walls and portals are shared, only dots, occupancy and entities are cloned
+    board->grid = level->grid;
+    board->board = arena_copy(board->arena, level->cells, n_cells * sizeof(board_pos_t));
+    board->pacmans = arena_copy(board->arena, &level->pacman_image, sizeof(pacman_t));
+    board->ghosts = arena_copy(board->arena, level->ghost_images, board->n_ghosts * sizeof(ghost_t));
+    if (!board->board || !board->pacmans || !board->ghosts) {
+        printf("Failed to load level\n");
+        arena_reset(board->arena);
+        return -1;
     }
-    free(board->board);
-    free(board->pacmans);
-    free(board->ghosts);
-}
+    board->pacmans[0].points = points;
 
-void open_debug_file(char *filename) {
-    debugfile = fopen(filename, "w");
-}
+    // Cell locks are pooled by the arena, only a bigger level creates new ones
+    board->cell_locks = arena_locks(board->arena, board->height * board->width);
+    board->frame = arena_alloc(board->arena, board->width * board->height + 1);
+    if (!board->cell_locks || !board->frame) {
+        printf("Failed to allocate level memory\n");
+        arena_reset(board->arena);
+        return -1;
+    }
 
-void close_debug_file() {
-    fclose(debugfile);
-}
+    board->chase_field = NULL;
+    board->chase_target = -1;
+    board->distances = level->distances;
+    board->chase_fields[0] = board->chase_fields[1] = NULL;
+    board->chase_pending = -1;
+    if (level->has_chasers && !level->distances) {
+        board->chase_fields[0] = arena_alloc(board->arena, CHASE_FIELD_BYTES(n_cells));
+        board->chase_fields[1] = arena_alloc(board->arena, CHASE_FIELD_BYTES(n_cells));
+        if (!board->chase_fields[0] || !board->chase_fields[1]) {
+            printf("Failed to allocate level memory\n");
+            arena_reset(board->arena);
+            return -1;
+        }
+    }
+    if (chase_update(board)) { // No thread plays the board yet
+        chase_build(board);
+        chase_publish(board);
+    }
 
-void debug(const char * format, ...) {
-    va_list args;
-    va_start(args, format);
-    vfprintf(debugfile, format, args);
-    va_end(args);
+    //print_board(board);
+    return 0;
+}
 
-    fflush(debugfile);
+void unload_level(board_t * board) {
+    board->grid = NULL;
+    board->board = NULL;
+    board->cell_locks = NULL;
+    board->pacmans = NULL;
+    board->ghosts = NULL;
+    board->frame = NULL;
+    board->chase_field = NULL;
+    board->chase_target = -1;
+    board->distances = NULL;
+    board->chase_fields[0] = board->chase_fields[1] = NULL;
+    board->chase_pending = -1;
+    chase_queue_free(&board->chase_queue);
+    arena_reset(board->arena); // Memory and cell locks stay with the arena for the next level
 }
 
 void print_board(board_t *board) {
@@ -532,15 +686,15 @@ void print_board(board_t *board) {
                        "=== [%d] LEVEL INFO ===\n"
                        "Dimensions: %d x %d\n"
                        "Tempo: %d\n"
-                       "Pacman file: %s\n",
-                       getpid(), board->height, board->width, board->tempo, board->pacman_file);
+                       "Level: %s\n",
+                       getpid(), board->height, board->width, board->tempo, board->level_name);
 
     offset += snprintf(buffer + offset, sizeof(buffer) - offset,
-                       "Monster files (%d):\n", board->n_ghosts);
+                       "Monsters (%d):\n", board->n_ghosts);
 
     for (int i = 0; i < board->n_ghosts; i++) {
         offset += snprintf(buffer + offset, sizeof(buffer) - offset,
-                           "  - %s\n", board->ghosts_files[i]);
+                           "  - %d x %d\n", board->ghosts[i].pos_x, board->ghosts[i].pos_y);
     }
 
     offset += snprintf(buffer + offset, sizeof(buffer) - offset, "\n=== BOARD ===\n");
@@ -44,6 +44,14 @@ void buffer_insert(request_buffer_t *buf, connection_request_t req) {
     sem_post(buf->full); // Signal that a new request is available for a new consumer
 }
 
+// Number of requests waiting in the buffer
+int buffer_count(request_buffer_t *buf) {
+    pthread_mutex_lock(&buf->mutex);
+    int count = buf->count;
+    pthread_mutex_unlock(&buf->mutex);
+    return count;
+}
+
 // Remove a request from the buffer
 connection_request_t buffer_remove(request_buffer_t *buf) {
     sem_wait(buf->full); // Wait for a full slot
@@ -0,0 +1,348 @@
+#include "catalog.h"
+#include "parser.h"
+#include "levelpack.h"
+#include <stdlib.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define RELOAD_DEBOUNCE_MS 200 // Editors write files in several steps, wait for the directory to settle
+#define WATCH_POLL_MS 500
+
+static char *catalog_path; // levels directory or pack file
+static char watch_dir[MAX_FILENAME]; // directory watched by inotify
+static char pack_name[MAX_FILENAME]; // file name of the pack inside watch_dir, empty for a levels directory
+static level_catalog_t *current;
+static unsigned long next_version = 1;
+static pthread_mutex_t current_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t watcher_tid;
+static int watcher_running = 0;
+static atomic_int watcher_stop;
+static int inotify_fd = -1;
+
+typedef struct {
+    level_catalog_t *catalog;
+    char *levels_dir;
+    char **level_names;
+    int count;
+    int *loaded; // per level, 1 if it parsed and passed levelpack_validate
+    atomic_int *next_ptr; // next level to be claimed by a loader
+    arena_t *arena; // arena of this loader
+} loader_arg_t;
+
+// Parses levels until there are none left, every loader allocates from its own arena
+static void *catalog_loader_thread(void *arg) {
+    loader_arg_t *loader = (loader_arg_t *)arg;
+    int i;
+    while ((i = atomic_fetch_add(loader->next_ptr, 1)) < loader->count) {
+        level_template_t *level = &loader->catalog->levels[i];
+        if (read_level(level, loader->arena, loader->level_names[i], loader->levels_dir) < 0) {
+            // A broken file is left out instead of taking the whole catalog down
+            log_warn("Skipping level %s\n", loader->level_names[i]);
+            printf("Failed to load level %s\n", loader->level_names[i]);
+            continue;
+        }
+        // Same checks as levelc, spawns are written to the board as is
+        char err[256];
+        if (levelpack_validate(level, err, sizeof(err)) < 0) {
+            log_warn("Skipping level %s: %s\n", loader->level_names[i], err);
+            printf("Invalid level %s: %s\n", loader->level_names[i], err);
+            continue;
+        }
+        loader->loaded[i] = 1;
+    }
+    return NULL;
+}
+
+// Helper private function to parse every level of the directory into a new catalog
+static level_catalog_t *catalog_build(char *levels_dir) {
+    level_catalog_t *catalog = calloc(1, sizeof(level_catalog_t));
+    if (!catalog) return NULL;
+    arena_init(&catalog->arena);
+
+    int count;
+    char **level_names = sort_levels(levels_dir, &count);
+
+    catalog->levels = arena_alloc(&catalog->arena, count * sizeof(level_template_t));
+    int *loaded = calloc(count ? count : 1, sizeof(int));
+    if (!catalog->levels || !loaded) {
+        free(loaded);
+        free_level_names(level_names, count);
+        arena_destroy(&catalog->arena);
+        free(catalog);
+        return NULL;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int n_loaders = count < cpus ? count : (int)cpus;
+    if (n_loaders > CATALOG_MAX_LOADERS) n_loaders = CATALOG_MAX_LOADERS;
+    if (n_loaders < 1) n_loaders = 1;
+    catalog->n_arenas = n_loaders;
+
+    atomic_int next;
+    atomic_init(&next, 0);
+    loader_arg_t loaders[CATALOG_MAX_LOADERS];
+    pthread_t tids[CATALOG_MAX_LOADERS];
+    for (int t = 0; t < n_loaders; t++) {
+        arena_init(&catalog->arenas[t]);
+        loaders[t] = (loader_arg_t){
+            .catalog = catalog, .levels_dir = levels_dir, .level_names = level_names,
+            .count = count, .loaded = loaded, .next_ptr = &next, .arena = &catalog->arenas[t],
+        };
+    }
+
+    // The calling thread is loader 0
+    for (int t = 1; t < n_loaders; t++) {
+        pthread_create(&tids[t], NULL, catalog_loader_thread, &loaders[t]);
+    }
+    catalog_loader_thread(&loaders[0]);
+    for (int t = 1; t < n_loaders; t++) {
+        pthread_join(tids[t], NULL);
+    }
+
+    // Keep the sorted order, without the levels that failed
+    for (int i = 0; i < count; i++) {
+        if (!loaded[i]) {
+            catalog->n_skipped++;
+            continue;
+        }
+        catalog->levels[catalog->n_levels++] = catalog->levels[i];
+        if (catalog->levels[i].n_ghosts > catalog->max_ghosts) catalog->max_ghosts = catalog->levels[i].n_ghosts;
+    }
+    for (int t = 0; t < n_loaders; t++) {
+        catalog->bytes += catalog->arenas[t].high_water;
+    }
+
+    free(loaded);
+    free_level_names(level_names, count);
+
+    pthread_mutex_init(&catalog->prepare_lock, NULL);
+    atomic_init(&catalog->refs, 1); // Reference held by `current`
+    return catalog;
+}
+
+// Helper private function to build a catalog straight from a compiled pack, no parsing
+static level_catalog_t *catalog_build_pack(char *pack_path) {
+    level_catalog_t *catalog = calloc(1, sizeof(level_catalog_t));
+    if (!catalog) return NULL;
+    arena_init(&catalog->arena);
+
+    const levelpack_level_t *packed;
+    int count;
+    if (levelpack_open(pack_path, &catalog->pack, &packed, &count) == -1) {
+        free(catalog);
+        return NULL;
+    }
+
+    catalog->levels = arena_alloc(&catalog->arena, count * sizeof(level_template_t));
+    for (int i = 0; catalog->levels && i < count; i++) {
+        if (levelpack_template(&catalog->pack, &packed[i], &catalog->levels[i], &catalog->arena) == -1) {
+            catalog->levels = NULL;
+        }
+    }
+    if (!catalog->levels) {
+        unmap_file(&catalog->pack);
+        arena_destroy(&catalog->arena);
+        free(catalog);
+        return NULL;
+    }
+
+    catalog->n_levels = count;
+    for (int i = 0; i < count; i++) {
+        if (catalog->levels[i].n_ghosts > catalog->max_ghosts) catalog->max_ghosts = catalog->levels[i].n_ghosts;
+    }
+    catalog->bytes = catalog->arena.high_water + catalog->pack.len;
+    pthread_mutex_init(&catalog->prepare_lock, NULL);
+    atomic_init(&catalog->refs, 1); // Reference held by `current`
+    return catalog;
+}
+
+static level_catalog_t *catalog_load(void) {
+    return pack_name[0] ? catalog_build_pack(catalog_path) : catalog_build(catalog_path);
+}
+
+// Helper private function to check if a file name is part of the catalog
+static int is_level_file(const char *name) {
+    if (pack_name[0]) return strcmp(name, pack_name) == 0;
+
+    const char *dot = strrchr(name, '.');
+    if (!dot || name[0] == '.') return 0;
+    return strcmp(dot, ".lvl") == 0 || strcmp(dot, ".p") == 0 || strcmp(dot, ".m") == 0;
+}
+
+// Helper private function to read pending inotify events, returns 1 if a level file changed
+static int drain_events(void) {
+    alignas(struct inotify_event) char events[4096];
+    int changed = 0;
+
+    ssize_t len;
+    while ((len = read(inotify_fd, events, sizeof(events))) > 0) {
+        for (char *ptr = events; ptr < events + len; ) {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+            if (event->len > 0 && is_level_file(event->name)) changed = 1;
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+
+// Helper private function to read the current version number
+static unsigned long current_version(void) {
+    pthread_mutex_lock(&current_mutex);
+    unsigned long version = current ? current->version : 0;
+    pthread_mutex_unlock(&current_mutex);
+    return version;
+}
+
+// Helper private function to make `catalog` the current version
+static void catalog_publish(level_catalog_t *catalog) {
+    pthread_mutex_lock(&current_mutex);
+    catalog->version = next_version++;
+    level_catalog_t *old = current;
+    current = catalog;
+    pthread_mutex_unlock(&current_mutex);
+
+    log_info("Level catalog v%lu: %d levels, %zu bytes\n", catalog->version, catalog->n_levels, catalog->bytes);
+    if (old) catalog_release(old); // Freed once the last session on it ends
+}
+
+static void *catalog_watcher_thread(void *arg) {
+    (void)arg;
+    struct pollfd pfd = {.fd = inotify_fd, .events = POLLIN};
+
+    while (!atomic_load(&watcher_stop)) {
+        if (poll(&pfd, 1, WATCH_POLL_MS) <= 0) continue;
+        if (!drain_events()) continue;
+
+        // Coalesce the burst of events of a single save / copy
+        while (poll(&pfd, 1, RELOAD_DEBOUNCE_MS) > 0) {
+            drain_events();
+        }
+
+        level_catalog_t *catalog = catalog_load();
+        if (!catalog) {
+            log_warn("Level reload failed, keeping catalog v%lu\n", current_version());
+            continue;
+        }
+        // A directory caught mid-edit or emptied would fail every new session
+        if (catalog->n_levels == 0 || catalog->n_skipped > 0) {
+            if (catalog->n_levels == 0) {
+                log_warn("Level reload found no levels, keeping catalog v%lu\n", current_version());
+            }
+            else {
+                log_warn("Level reload skipped %d invalid levels, keeping catalog v%lu\n", catalog->n_skipped,
+                         current_version());
+            }
+            catalog_release(catalog);
+            continue;
+        }
+        catalog_publish(catalog);
+        printf("Levels reloaded (%d levels)\n", catalog->n_levels);
+    }
+    return NULL;
+}
+
+int catalog_init(char *levels_path) {
+    catalog_path = levels_path;
+
+    struct stat st;
+    if (stat(levels_path, &st) == -1) return -1;
+
+    // A pack is watched through its directory, so that levelc's rename is seen
+    char copy[MAX_FILENAME];
+    if (S_ISREG(st.st_mode)) {
+        snprintf(copy, sizeof(copy), "%s", levels_path);
+        snprintf(pack_name, sizeof(pack_name), "%s", basename(copy));
+        snprintf(copy, sizeof(copy), "%s", levels_path);
+        snprintf(watch_dir, sizeof(watch_dir), "%s", dirname(copy));
+    }
+    else {
+        pack_name[0] = '\0';
+        snprintf(watch_dir, sizeof(watch_dir), "%s", levels_path);
+    }
+
+    level_catalog_t *catalog = catalog_load();
+    if (!catalog) return -1;
+    catalog_publish(catalog);
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1 ||
+        inotify_add_watch(inotify_fd, watch_dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) == -1) {
+        // Not fatal, the server keeps the levels it parsed
+        perror("inotify");
+        if (inotify_fd != -1) close(inotify_fd);
+        inotify_fd = -1;
+        return 0;
+    }
+
+    atomic_init(&watcher_stop, 0);
+    if (pthread_create(&watcher_tid, NULL, catalog_watcher_thread, NULL) == 0) {
+        watcher_running = 1;
+    }
+    return 0;
+}
+
+level_catalog_t *catalog_acquire(void) {
+    pthread_mutex_lock(&current_mutex);
+    level_catalog_t *catalog = current;
+    if (catalog) atomic_fetch_add(&catalog->refs, 1);
+    pthread_mutex_unlock(&current_mutex);
+    return catalog;
+}
+
+int catalog_is_current(const level_catalog_t *catalog) {
+    pthread_mutex_lock(&current_mutex);
+    int is_current = catalog && catalog == current;
+    pthread_mutex_unlock(&current_mutex);
+    return is_current;
+}
+
+void catalog_release(level_catalog_t *catalog) {
+    if (!catalog) return;
+    if (atomic_fetch_sub(&catalog->refs, 1) == 1) {
+        for (int t = 0; t < catalog->n_arenas; t++) {
+            arena_destroy(&catalog->arenas[t]);
+        }
+        arena_destroy(&catalog->arena);
+        unmap_file(&catalog->pack);
+        pthread_mutex_destroy(&catalog->prepare_lock);
+        free(catalog);
+    }
+}
+
+const level_template_t *catalog_level(level_catalog_t *catalog, int index) {
+    if (!catalog || index < 0 || index >= catalog->n_levels) return NULL;
+
+    level_template_t *level = &catalog->levels[index];
+    pthread_mutex_lock(&catalog->prepare_lock);
+    if (!level->prepared && prepare_level(level, &catalog->arena) == -1) {
+        level = NULL;
+    }
+    pthread_mutex_unlock(&catalog->prepare_lock);
+    return level;
+}
+
+void catalog_shutdown(void) {
+    if (watcher_running) {
+        atomic_store(&watcher_stop, 1);
+        pthread_join(watcher_tid, NULL);
+        watcher_running = 0;
+    }
+    if (inotify_fd != -1) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+
+    pthread_mutex_lock(&current_mutex);
+    level_catalog_t *catalog = current;
+    current = NULL;
+    pthread_mutex_unlock(&current_mutex);
+    catalog_release(catalog);
+}
@@ -0,0 +1,95 @@
+#include "chase.h"
+#include "board.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CHASE_QUEUE_MIN 256
+
+// Helper private function to write the steps of cell into field
+static inline void set_steps(uint8_t *field, int cell, int steps) {
+    int shift = (cell & 3) * 2;
+    field[cell >> 2] = (uint8_t)((field[cell >> 2] & ~(3 << shift)) | (steps << shift));
+}
+
+// Helper private function, doubles the ring keeping the queued cells in order from index 0. -1 on allocation failure
+static int queue_grow(chase_queue_t *queue, unsigned *head, unsigned *tail) {
+    unsigned capacity = queue->capacity ? queue->capacity * 2 : CHASE_QUEUE_MIN;
+    int *cells = malloc(capacity * sizeof(int));
+    if (!cells) return -1;
+
+    unsigned n = *tail - *head;
+    for (unsigned i = 0; i < n; i++) {
+        cells[i] = queue->cells[(*head + i) & (queue->capacity - 1)];
+    }
+    free(queue->cells);
+    queue->cells = cells;
+    queue->capacity = capacity;
+    *head = 0;
+    *tail = n;
+    return 0;
+}
+
+void chase_queue_free(chase_queue_t *queue) {
+    free(queue->cells);
+    queue->cells = NULL;
+    queue->capacity = 0;
+}
+
+int chase_bfs(const uint8_t *grid, int width, int height, int target, uint8_t *field, chase_queue_t *queue) {
+    int n_cells = width * height;
+    memset(field, 0xFF, CHASE_FIELD_BYTES(n_cells)); // every cell CHASE_UNREACHABLE
+    if (target < 0 || target >= n_cells || (grid[target] & CELL_WALL)) {
+        return 0;
+    }
+
+    unsigned head = 0, tail = 0;
+    if (queue->capacity == 0 && queue_grow(queue, &head, &tail) != 0) return -1;
+    set_steps(field, target, 0);
+    queue->cells[tail++ & (queue->capacity - 1)] = target;
+    while (head != tail) {
+        int cell = queue->cells[head++ & (queue->capacity - 1)];
+        int x = cell % width;
+        int y = cell / width;
+        int next = (chase_steps(field, cell) + 1) % 3;
+
+        int neighbours[4] = {
+            y > 0 ? cell - width : -1,
+            y < height - 1 ? cell + width : -1,
+            x > 0 ? cell - 1 : -1,
+            x < width - 1 ? cell + 1 : -1,
+        };
+        for (int k = 0; k < 4; k++) {
+            int n = neighbours[k];
+            if (n < 0 || (grid[n] & CELL_WALL) || chase_steps(field, n) != CHASE_UNREACHABLE) continue;
+            if (tail - head == queue->capacity && queue_grow(queue, &head, &tail) != 0) {
+                memset(field, 0xFF, CHASE_FIELD_BYTES(n_cells));
+                return -1;
+            }
+            set_steps(field, n, next);
+            queue->cells[tail++ & (queue->capacity - 1)] = n;
+        }
+    }
+    return 0;
+}
+
+const uint8_t *chase_all_pairs(const uint8_t *grid, int width, int height, arena_t *arena) {
+    int n_cells = width * height;
+    if (n_cells > CHASE_ALL_PAIRS_MAX_CELLS) {
+        return NULL;
+    }
+
+    size_t field_bytes = CHASE_FIELD_BYTES(n_cells);
+    uint8_t *table = arena_alloc(arena, n_cells * field_bytes);
+    if (!table) {
+        return NULL;
+    }
+
+    // One BFS per target cell, the levels are small enough for n^2 work once per catalog
+    chase_queue_t queue = {0};
+    int result = 0;
+    for (int target = 0; target < n_cells && result == 0; target++) {
+        result = chase_bfs(grid, width, height, target, table + target * field_bytes, &queue);
+    }
+    chase_queue_free(&queue);
+    return result == 0 ? table : NULL;
+}
@@ -0,0 +1,66 @@
+#include "config.h"
+#include "protocol.h"
+#include <stdlib.h>
+
+server_config_t server_config;
+
+// Helper private function to read an integer variable, fallback when unset or malformed
+static int env_int(const char *name, int fallback) {
+    const char *value = getenv(name);
+    if (!value || !*value) return fallback;
+
+    char *end;
+    long parsed = strtol(value, &end, 10);
+    if (*end != '\0') return fallback;
+    return (int)parsed;
+}
+
+void config_load(int max_games) {
+    int prewarm = env_int("PACMAN_PREWARM_SLOTS", DEFAULT_PREWARM_SLOTS);
+    if (prewarm < 0) prewarm = 0;
+    if (prewarm > max_games) prewarm = max_games;
+    server_config.prewarm_slots = prewarm;
+
+    int k = env_int("PACMAN_LEADERBOARD_K", DEFAULT_LEADERBOARD_K);
+    if (k < 1) k = 1;
+    if (k > MAX_LEADERBOARD_SIZE) k = MAX_LEADERBOARD_SIZE;
+    server_config.leaderboard_k = k;
+
+    const char *score_dir = getenv("PACMAN_SCORE_DIR");
+    server_config.score_dir = score_dir && *score_dir ? score_dir : ".";
+
+    int n = env_int("PACMAN_HIGHSCORES_N", DEFAULT_HIGHSCORES_N);
+    if (n < 1) n = 1;
+    if (n > MAX_LEADERBOARD_SIZE) n = MAX_LEADERBOARD_SIZE;
+    server_config.highscores_n = n;
+
+    int compact_sec = env_int("PACMAN_SCORE_COMPACT_SEC", DEFAULT_SCORE_COMPACT_SEC);
+    server_config.score_compact_sec = compact_sec < 1 ? 1 : compact_sec;
+
+    const char *events_dir = getenv("PACMAN_EVENTS_DIR");
+    server_config.events_dir = events_dir && *events_dir ? events_dir : NULL;
+
+    int rotate_mb = env_int("PACMAN_EVENTS_ROTATE_MB", DEFAULT_EVENTS_ROTATE_MB);
+    server_config.events_rotate_bytes = (rotate_mb < 1 ? 1 : rotate_mb) * 1024L * 1024L;
+
+    const char *trace_dir = getenv("PACMAN_TRACE_DIR");
+    server_config.trace_dir = trace_dir && *trace_dir ? trace_dir : ".";
+
+    int trace_sec = env_int("PACMAN_TRACE_SEC", DEFAULT_TRACE_SEC);
+    server_config.trace_sec = trace_sec < 0 ? 0 : trace_sec;
+
+    const char *flight_dir = getenv("PACMAN_FLIGHT_DIR");
+    server_config.flight_dir = flight_dir && *flight_dir ? flight_dir : ".";
+
+    const char *log_level = getenv("PACMAN_LOG_LEVEL");
+    int level = log_level && *log_level ? log_level_parse(log_level) : -1;
+    server_config.log_level = level == -1 ? DEFAULT_LOG_LEVEL : level;
+
+    const char *seed = getenv("PACMAN_SEED");
+    char *end;
+    server_config.fixed_seed = 0;
+    if (seed && *seed) {
+        server_config.seed = strtoull(seed, &end, 0);
+        server_config.fixed_seed = *end == '\0';
+    }
+}
@@ -0,0 +1,244 @@
+#include "events.h"
+#include "board.h"
+#include "utils.h"
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define EVENTS_BATCH 4096 // events per write() of the writer
+
+// Single producer, single consumer ring, handed to another thread once its owner exits
+typedef struct {
+    alignas(CACHE_LINE_SIZE) atomic_ulong head; // written by the producer
+    unsigned long cached_tail; // producer's last look at tail, saves a shared load per event
+    atomic_ulong dropped; // events lost to a full ring
+    atomic_int owned;
+    alignas(CACHE_LINE_SIZE) atomic_ulong tail; // written by the writer thread
+    event_t events[EVENTS_RING_SIZE];
+} event_ring_t;
+
+static atomic_int enabled; // read by every emit, relaxed
+static char events_dir[MAX_FILENAME - 64]; // leaves room for the file names
+static long rotate_size;
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER; // only taken to add a ring
+static event_ring_t *rings[EVENTS_MAX_RINGS];
+static atomic_int n_rings;
+static pthread_key_t ring_key; // releases the ring of a thread when it exits
+static _Thread_local event_ring_t *thread_ring;
+
+// Owned by the writer thread
+static pthread_t writer_tid;
+static atomic_int stopping;
+static int out_fd = -1;
+static unsigned long file_index;
+static long file_bytes;
+static event_t batch[EVENTS_BATCH];
+
+// Helper private function, called at thread exit with the ring of the thread
+static void release_ring(void *ring) {
+    atomic_store_explicit(&((event_ring_t *)ring)->owned, 0, memory_order_release);
+}
+
+// Helper private function to give the calling thread a ring, a free one first, NULL if none is left
+static event_ring_t *claim_ring(void) {
+    int count = atomic_load_explicit(&n_rings, memory_order_acquire);
+    for (int i = 0; i < count && !thread_ring; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong_explicit(&rings[i]->owned, &expected, 1,
+                                                    memory_order_acquire, memory_order_relaxed)) {
+            thread_ring = rings[i];
+        }
+    }
+
+    if (!thread_ring) {
+        pthread_mutex_lock(&rings_lock);
+        count = atomic_load_explicit(&n_rings, memory_order_relaxed);
+        if (count < EVENTS_MAX_RINGS) {
+            event_ring_t *ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(event_ring_t));
+            if (ring) {
+                memset(ring, 0, sizeof(event_ring_t));
+                atomic_store_explicit(&ring->owned, 1, memory_order_relaxed);
+                rings[count] = ring;
+                atomic_store_explicit(&n_rings, count + 1, memory_order_release); // Writer sees the ring initialized
+                thread_ring = ring;
+            }
+        }
+        pthread_mutex_unlock(&rings_lock);
+    }
+
+    if (thread_ring) {
+        pthread_setspecific(ring_key, thread_ring);
+    }
+    return thread_ring;
+}
+
+void event_emit(event_type_t type, int client_id, int level, int x, int y, int value) {
+    if (!atomic_load_explicit(&enabled, memory_order_relaxed)) return;
+
+    event_ring_t *ring = thread_ring ? thread_ring : claim_ring();
+    if (!ring) return;
+
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - ring->cached_tail >= EVENTS_RING_SIZE) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->cached_tail >= EVENTS_RING_SIZE) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return;
+        }
+    }
+
+    event_t *event = &ring->events[head & (EVENTS_RING_SIZE - 1)];
+    event->time_us = monotonic_us();
+    event->client_id = client_id;
+    event->type = type;
+    event->level = level;
+    event->x = x;
+    event->y = y;
+    event->value = value;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Helper private function to start the next events file
+static int open_next_file(void) {
+    if (out_fd != -1) close(out_fd);
+
+    char path[MAX_FILENAME];
+    snprintf(path, sizeof(path), "%s/events.%lu.bin", events_dir, file_index++);
+    out_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd == -1) {
+        log_error("Error opening events file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    event_file_header_t header = {.version = EVENTS_VERSION, .record_size = sizeof(event_t)};
+    memcpy(header.magic, EVENTS_MAGIC, sizeof(header.magic));
+    if (write(out_fd, &header, sizeof(header)) != sizeof(header)) {
+        close(out_fd);
+        out_fd = -1;
+        return -1;
+    }
+    file_bytes = sizeof(header);
+    return 0;
+}
+
+// Helper private function to write the batch, rotating first if the file would grow past rotate_size
+static void flush_batch(int n) {
+    size_t size = n * sizeof(event_t);
+    if ((out_fd == -1 || file_bytes + (long)size > rotate_size) && open_next_file() == -1) {
+        return;
+    }
+
+    const char *data = (const char *)batch;
+    size_t written = 0;
+    while (written < size) {
+        ssize_t w = write(out_fd, data + written, size - written);
+        if (w <= 0 && errno != EINTR) break;
+        if (w > 0) written += w;
+    }
+    file_bytes += written;
+}
+
+// Helper private function to move every ring's pending events to the current file
+static void drain_rings(void) {
+    int n = 0;
+    int count = atomic_load_explicit(&n_rings, memory_order_acquire);
+
+    for (int r = 0; r < count; r++) {
+        event_ring_t *ring = rings[r];
+        unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+        while (tail != head) {
+            batch[n++] = ring->events[tail & (EVENTS_RING_SIZE - 1)];
+            tail++;
+            if (n == EVENTS_BATCH) {
+                atomic_store_explicit(&ring->tail, tail, memory_order_release);
+                flush_batch(n);
+                n = 0;
+            }
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release); // The slots can be reused
+    }
+
+    if (n > 0) flush_batch(n);
+}
+
+static void *writer_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        int stop = atomic_load(&stopping);
+        drain_rings();
+        if (stop) break;
+        sleep_ms(EVENTS_FLUSH_MS);
+    }
+    return NULL;
+}
+
+// Helper private function, first file index after the ones already in dir
+static unsigned long next_file_index(void) {
+    unsigned long next = 0;
+    DIR *dir = opendir(events_dir);
+    if (!dir) return 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        unsigned long index;
+        char tail[8];
+        if (sscanf(entry->d_name, "events.%lu.%7s", &index, tail) == 2 && strcmp(tail, "bin") == 0 && index >= next) {
+            next = index + 1;
+        }
+    }
+    closedir(dir);
+    return next;
+}
+
+int events_init(const char *dir, long rotate_bytes) {
+    snprintf(events_dir, sizeof(events_dir), "%s", dir);
+    rotate_size = rotate_bytes;
+
+    if (mkdir(events_dir, 0755) == -1 && errno != EEXIST) {
+        return -1;
+    }
+    if (pthread_key_create(&ring_key, release_ring) != 0) {
+        return -1;
+    }
+    file_index = next_file_index(); // Never overwrite the files of a previous run
+
+    atomic_store(&stopping, 0);
+    if (pthread_create(&writer_tid, NULL, writer_thread, NULL) != 0) {
+        pthread_key_delete(ring_key);
+        return -1;
+    }
+    atomic_store(&enabled, 1);
+    return 0;
+}
+
+void events_shutdown(void) {
+    if (!atomic_load(&enabled)) return;
+
+    atomic_store(&enabled, 0);
+    atomic_store(&stopping, 1);
+    pthread_join(writer_tid, NULL);
+
+    unsigned long lost = 0;
+    int count = atomic_load(&n_rings);
+    for (int r = 0; r < count; r++) {
+        lost += atomic_load(&rings[r]->dropped);
+    }
+    if (lost > 0) {
+        log_warn("%lu events dropped on full rings\n", lost);
+    }
+    if (out_fd != -1) {
+        close(out_fd);
+        out_fd = -1;
+    }
+}
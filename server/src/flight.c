@@ -0,0 +1,309 @@
+#include "flight.h"
+#include "utils.h"
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Ring of one slot, written by its pacman and manager threads
+typedef struct {
+    alignas(CACHE_LINE_SIZE) atomic_ulong head;
+    atomic_ulong first; // head when the session began, older records belong to the previous one
+    atomic_int client_id; // -1 while no session is recorded
+    atomic_int abnormal;
+    uint64_t seed;
+    flight_record_t records[FLIGHT_RING_SIZE];
+} flight_ring_t;
+
+static flight_ring_t *rings;
+static int n_rings;
+static char flight_dir[MAX_FILENAME - 64]; // leaves room for the file names
+static atomic_uint dumps; // makes dump names unique within a second
+
+// Text written by hand, snprintf and stdio are not async-signal-safe
+typedef struct {
+    char *data;
+    size_t len, capacity;
+    int fd; // flushed here when full, -1 to only fill data
+} text_t;
+
+static void text_flush(text_t *text) {
+    size_t written = 0;
+    while (text->fd != -1 && written < text->len) {
+        ssize_t n = write(text->fd, text->data + written, text->len - written);
+        if (n <= 0) break;
+        written += n;
+    }
+    text->len = 0;
+}
+
+static void text_char(text_t *text, char c) {
+    if (text->len + 1 >= text->capacity) {
+        if (text->fd == -1) return; // Truncated
+        text_flush(text);
+    }
+    text->data[text->len++] = c;
+    text->data[text->len] = '\0';
+}
+
+static void text_str(text_t *text, const char *s) {
+    while (*s) text_char(text, *s++);
+}
+
+static void text_int(text_t *text, long long value) {
+    char digits[24];
+    int n = 0;
+    unsigned long long magnitude = value < 0 ? -(unsigned long long)value : (unsigned long long)value;
+    do {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0) text_char(text, '-');
+    while (n) text_char(text, digits[--n]);
+}
+
+static void text_uint(text_t *text, unsigned long long value) {
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (n) text_char(text, digits[--n]);
+}
+
+static void text_position(text_t *text, const int16_t position[2]) {
+    text_int(text, position[0]);
+    text_char(text, ',');
+    text_int(text, position[1]);
+}
+
+// Helper private function to write one record as a line
+static void write_record(text_t *out, const flight_record_t *record) {
+    text_int(out, record->time_us);
+    if (record->type == FLIGHT_INPUT) {
+        text_str(out, " input ");
+        text_char(out, record->command);
+        text_str(out, " seq ");
+        text_int(out, record->value);
+        text_str(out, " result ");
+        text_int(out, record->result);
+    }
+    else {
+        text_str(out, " frame ");
+        text_int(out, record->value);
+    }
+    text_str(out, " level ");
+    text_int(out, record->level);
+    text_str(out, " points ");
+    text_int(out, record->points);
+    text_str(out, " pacman ");
+    text_position(out, record->pacman);
+    if (record->type == FLIGHT_FRAME) {
+        text_str(out, " ghosts");
+        for (int g = 0; g < record->n_ghosts; g++) {
+            text_char(out, ' ');
+            text_position(out, record->ghosts[g]);
+        }
+    }
+    text_char(out, '\n');
+}
+
+int flight_dump(int slot, const char *reason, char *path, int path_size) {
+    if (!rings || slot < 0 || slot >= n_rings) return -1;
+
+    flight_ring_t *ring = &rings[slot];
+    int client_id = atomic_load(&ring->client_id);
+    if (client_id == -1) return -1;
+
+    char name[MAX_FILENAME];
+    text_t file_name = {name, 0, sizeof(name), -1};
+    text_str(&file_name, flight_dir);
+    text_str(&file_name, "/flight.");
+    text_int(&file_name, client_id);
+    text_char(&file_name, '.');
+    text_int(&file_name, (long long)time(NULL));
+    text_char(&file_name, '.');
+    text_uint(&file_name, atomic_fetch_add(&dumps, 1));
+    text_str(&file_name, ".txt");
+
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return -1;
+
+    char buffer[4096];
+    text_t out = {buffer, 0, sizeof(buffer), fd};
+    text_str(&out, "flight recorder: slot ");
+    text_int(&out, slot);
+    text_str(&out, " client ");
+    text_int(&out, client_id);
+    text_str(&out, " seed ");
+    text_uint(&out, ring->seed);
+    text_str(&out, " reason ");
+    text_str(&out, reason);
+    text_str(&out, "\n");
+
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    unsigned long first = atomic_load(&ring->first);
+    if (head - first > FLIGHT_RING_SIZE) first = head - FLIGHT_RING_SIZE;
+
+    for (unsigned long i = first; i < head; i++) {
+        const flight_record_t *record = &ring->records[i & (FLIGHT_RING_SIZE - 1)];
+        if (atomic_load_explicit(&record->stamp, memory_order_acquire) != i + 1) continue; // Being written
+
+        flight_record_t copy;
+        memcpy(&copy, record, sizeof(copy));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&record->stamp, memory_order_relaxed) != i + 1) continue; // Overwritten meanwhile
+
+        write_record(&out, &copy);
+    }
+    text_flush(&out);
+    close(fd);
+
+    if (path) {
+        size_t n = strlen(name) < (size_t)path_size ? strlen(name) + 1 : (size_t)path_size;
+        memcpy(path, name, n);
+        path[n - 1] = '\0';
+    }
+    return 0;
+}
+
+// Helper private function, reserves the next record of a slot and marks it as being written
+static flight_record_t *start_record(int slot, unsigned long *index) {
+    if (!rings || slot < 0 || slot >= n_rings) return NULL;
+
+    flight_ring_t *ring = &rings[slot];
+    *index = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+    flight_record_t *record = &ring->records[*index & (FLIGHT_RING_SIZE - 1)];
+    atomic_store_explicit(&record->stamp, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // A reader never sees new fields under the old stamp
+    return record;
+}
+
+static void finish_record(flight_record_t *record, unsigned long index) {
+    atomic_store_explicit(&record->stamp, index + 1, memory_order_release);
+}
+
+void flight_input(int slot, const board_t *board, char command, int seq, int result) {
+    unsigned long index;
+    flight_record_t *record = start_record(slot, &index);
+    if (!record) return;
+
+    const pacman_t *pacman = &board->pacmans[0];
+    record->time_us = monotonic_us();
+    record->type = FLIGHT_INPUT;
+    record->command = command;
+    record->result = (int8_t)result;
+    record->n_ghosts = 0;
+    record->level = (int16_t)board->level_index;
+    record->value = seq;
+    record->points = pacman->points;
+    record->pacman[0] = (int16_t)pacman->pos_x;
+    record->pacman[1] = (int16_t)pacman->pos_y;
+    finish_record(record, index);
+}
+
+void flight_frame(int slot, const board_t *board, long frame, int points) {
+    unsigned long index;
+    flight_record_t *record = start_record(slot, &index);
+    if (!record) return;
+
+    const pacman_t *pacman = &board->pacmans[0];
+    int n_ghosts = board->n_ghosts < MAX_GHOSTS ? board->n_ghosts : MAX_GHOSTS;
+    record->time_us = monotonic_us();
+    record->type = FLIGHT_FRAME;
+    record->command = 0;
+    record->result = 0;
+    record->n_ghosts = (uint8_t)n_ghosts;
+    record->level = (int16_t)board->level_index;
+    record->value = (int32_t)frame;
+    record->points = points;
+    record->pacman[0] = (int16_t)pacman->pos_x;
+    record->pacman[1] = (int16_t)pacman->pos_y;
+    for (int g = 0; g < n_ghosts; g++) {
+        record->ghosts[g][0] = (int16_t)board->ghosts[g].pos_x;
+        record->ghosts[g][1] = (int16_t)board->ghosts[g].pos_y;
+    }
+    finish_record(record, index);
+}
+
+void flight_begin(int slot, int client_id, uint64_t seed) {
+    if (!rings || slot < 0 || slot >= n_rings) return;
+
+    flight_ring_t *ring = &rings[slot];
+    atomic_store(&ring->first, atomic_load(&ring->head));
+    atomic_store(&ring->abnormal, 0);
+    ring->seed = seed;
+    atomic_store(&ring->client_id, client_id);
+}
+
+void flight_abnormal(int slot) {
+    if (rings && slot >= 0 && slot < n_rings) {
+        atomic_store(&rings[slot].abnormal, 1);
+    }
+}
+
+void flight_end(int slot) {
+    if (!rings || slot < 0 || slot >= n_rings) return;
+
+    char path[MAX_FILENAME];
+    if (atomic_load(&rings[slot].abnormal) && flight_dump(slot, "abnormal end", path, sizeof(path)) == 0) {
+        log_warn("Session of client %d ended abnormally, flight recorder in %s\n", atomic_load(&rings[slot].client_id),
+                 path);
+    }
+    atomic_store(&rings[slot].client_id, -1);
+}
+
+int flight_slot_of(int client_id) {
+    for (int slot = 0; rings && slot < n_rings; slot++) {
+        if (atomic_load(&rings[slot].client_id) == client_id) return slot;
+    }
+    return -1;
+}
+
+// Dumps every recorded session, then lets the signal do what it would have done
+static void crash_handler(int sig) {
+    const char *reason = sig == SIGSEGV ? "SIGSEGV" : sig == SIGBUS ? "SIGBUS" : "SIGABRT";
+    for (int slot = 0; slot < n_rings; slot++) {
+        flight_dump(slot, reason, NULL, 0);
+    }
+    raise(sig); // Handler was reset, delivered with the default action once this returns
+}
+
+int flight_init(int n_slots, const char *dir) {
+    rings = aligned_alloc(CACHE_LINE_SIZE, (size_t)n_slots * sizeof(flight_ring_t));
+    if (!rings) return -1;
+    memset(rings, 0, (size_t)n_slots * sizeof(flight_ring_t));
+    for (int i = 0; i < n_slots; i++) {
+        atomic_init(&rings[i].client_id, -1);
+    }
+    n_rings = n_slots;
+
+    size_t length = strlen(dir) < sizeof(flight_dir) - 1 ? strlen(dir) : sizeof(flight_dir) - 1;
+    memcpy(flight_dir, dir, length);
+    flight_dir[length] = '\0';
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = crash_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESETHAND;
+    sigaction(SIGSEGV, &sa, NULL);
+    sigaction(SIGABRT, &sa, NULL);
+    sigaction(SIGBUS, &sa, NULL); // Truncated mmap'd level pack or score index
+    return 0;
+}
+
+void flight_destroy(void) {
+    signal(SIGSEGV, SIG_DFL);
+    signal(SIGABRT, SIG_DFL);
+    signal(SIGBUS, SIG_DFL);
+
+    free(rings);
+    rings = NULL;
+    n_rings = 0;
+}
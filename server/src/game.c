@@ -3,6 +3,19 @@
 #include "protocol.h"
 #include "parser.h"
 #include "buffer.h"
+#include "session.h"
+#include "catalog.h"
+#include "config.h"
+#include "stats.h"
+#include "rng.h"
+#include "leaderboard.h"
+#include "scores.h"
+#include "events.h"
+#include "admin.h"
+#include "histogram.h"
+#include "lockprof.h"
+#include "trace.h"
+#include "flight.h"
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -18,31 +31,8 @@
 #include <signal.h>
 
 
-// Struct for session data
 typedef struct {
-    int active; 
-    int client_id;
-    board_t board;
-    int client_req_pipe;
-    int client_notif_pipe;
-    char client_req_path[MAX_PIPE_PATH_LENGTH];
-    char client_notif_path[MAX_PIPE_PATH_LENGTH];
-    pthread_t pacman_tid;
-    pthread_t session_tid;
-    pthread_t *ghost_tids;
-    int thread_shutdown;
-    pthread_mutex_t session_lock;
-    int current_level;
-    int total_levels;
-    int victory;
-    int accumulated_points;
-    int level_change_pending;
-    int new_level_index;
-} session_data_t;
-
-
-typedef struct {
-    board_t *board;
+    session_data_t *session;
     int ghost_index;
     int *shutdown_flag;
 } ghost_thread_arg_t;
@@ -54,212 +44,321 @@ static int max_games;
 static char *levels_dir;
 static pthread_mutex_t sessions_mutex = PTHREAD_MUTEX_INITIALIZER;
 static volatile sig_atomic_t sigusr1_received = 0;
+static volatile sig_atomic_t shutdown_requested = 0; // SIGTERM or SIGINT
+static atomic_ulong sessions_seeded;
+
+
+/*
+Parks a thread of a pre-warmed slot until a client is bound to the session
+Returns 0 once the session starts, -1 if the slot is torn down instead
+*/
+static int wait_for_client(session_data_t *session) {
+    pthread_mutex_lock(&session->session_lock); // Not profiled, the wait would count as hold time
+    while (!session->started && !session->thread_shutdown) {
+        pthread_cond_wait(&session->start_cond, &session->session_lock);
+    }
+    int shutdown = session->thread_shutdown;
+    pthread_mutex_unlock(&session->session_lock);
+    return shutdown ? -1 : 0;
+}
+
+
+// Helper private function, sleep_ms that records how late the thread woke up past its deadline
+static void timed_sleep_ms(int ms) {
+    long long deadline = monotonic_ns() + ms * 1000000LL;
+    sleep_ms(ms);
+    hist_record(HIST_TICK_LATE, monotonic_ns() - deadline);
+}
 
 
 void* ghost_thread(void *arg) {
     ghost_thread_arg_t *ghost_arg = (ghost_thread_arg_t*) arg; 
-    board_t *board = ghost_arg->board;
+    session_data_t *session = ghost_arg->session;
     int ghost_ind = ghost_arg->ghost_index;
     int *shutdown = ghost_arg->shutdown_flag;
     free(ghost_arg);
+    hist_bind((int)(session - sessions), HIST_GHOST + ghost_ind);
+    trace_thread_name("slot %ld ghost %d", (long)(session - sessions), ghost_ind);
 
-    ghost_t* ghost = &board->ghosts[ghost_ind];
+    if (wait_for_client(session) != 0) {
+        pthread_exit(NULL);
+    }
 
     while (1) {
         
-        pthread_rwlock_rdlock(&board->state_lock);
+        RWLOCK_RDLOCK("state_lock", &session->state_lock);
         if (*shutdown) {
-            pthread_rwlock_unlock(&board->state_lock);
+            RWLOCK_UNLOCK(&session->state_lock);
             pthread_exit(NULL); 
         }
         
-        move_ghost(board, ghost_ind, &ghost->moves[ghost->current_move % ghost->n_moves]);
-        pthread_rwlock_unlock(&board->state_lock);
-        sleep_ms(board->tempo * (1 + ghost->passo));
+        // The board is re-read every tick, a portal swaps it under the write lock
+        board_t *board = session->board;
+        int delay = board->tempo;
+
+        // Workers above the ghost count of this level idle until a level that needs them
+        if (ghost_ind < board->n_ghosts) {
+            ghost_t *ghost = &board->ghosts[ghost_ind];
+            int charged = ghost->charged;
+            trace_begin(TRACE_MOVE_GHOST);
+            int result = move_ghost(board, ghost_ind);
+            trace_end(TRACE_MOVE_GHOST);
+            if (result == DEAD_PACMAN) {
+                event_emit(EVENT_DEATH, session->client_id, board->level_index, ghost->pos_x, ghost->pos_y, ghost_ind);
+            }
+            if (charged && !ghost->charged) {
+                event_emit(EVENT_CHARGE, session->client_id, board->level_index, ghost->pos_x, ghost->pos_y, ghost_ind);
+            }
+            delay *= 1 + ghost->passo;
+        }
+        RWLOCK_UNLOCK(&session->state_lock);
+        timed_sleep_ms(delay);
+    }
+}
+
+
+// Loads level `level_index` of the catalog the session is pinned to into board, no file I/O
+static int load_session_level(session_data_t *session, board_t *board, int level_index) {
+    const level_template_t *level = catalog_level(session->catalog, level_index);
+    trace_begin(TRACE_LOAD_LEVEL);
+    int result = level ? load_level(board, level, 0) : -1;
+    trace_end(TRACE_LOAD_LEVEL);
+    if (result != 0) {
+        return -1;
+    }
+    seed_board(board, session->seed ^ rng_mix((uint64_t)level_index)); // Same seed, same level, same moves
+    board->level_index = level_index;
+    return 0;
+}
+
+
+// Helper private function, seed of a new session: PACMAN_SEED or a fresh one
+static uint64_t new_session_seed(void) {
+    if (server_config.fixed_seed) {
+        return server_config.seed;
+    }
+    uint64_t count = atomic_fetch_add(&sessions_seeded, 1);
+    return rng_mix((uint64_t)time(NULL) ^ rng_mix((uint64_t)monotonic_us() + count));
+}
+
+
+// Helper private function, the board of the slot that is not being played
+static board_t *spare_board(session_data_t *session) {
+    return session->board == &session->boards[0] ? &session->boards[1] : &session->boards[0];
+}
+
+
+/*
+Loads the level after the current one into the spare board, session_lock must be held
+Levels are memcpy'd from the catalog templates, so this only takes microseconds
+*/
+static void prefetch_next_level(session_data_t *session) {
+    if (session->next_ready || session->current_level + 1 >= session->total_levels) {
+        return;
+    }
+
+    board_t *spare = spare_board(session);
+    if (spare->board) {
+        trace_begin(TRACE_UNLOAD_LEVEL);
+        unload_level(spare); // Still holds the level played before the last portal
+        trace_end(TRACE_UNLOAD_LEVEL);
+    }
+    if (load_session_level(session, spare, session->current_level + 1) == 0) {
+        session->next_ready = 1;
     }
 }
 
 
 void* pacman_thread(void *arg) {
     session_data_t *session = (session_data_t*) arg;
-    board_t *board = &session->board;
-    pacman_t* pacman = &board->pacmans[0];
+    hist_bind((int)(session - sessions), HIST_PACMAN);
+    trace_thread_name("slot %ld pacman", (long)(session - sessions));
+
+    if (wait_for_client(session) != 0) {
+        pthread_exit(NULL);
+    }
 
     while (1) {
-        pthread_mutex_lock(&session->session_lock);
-        if (!pacman->alive || session->thread_shutdown || session->victory) {
-            pthread_mutex_unlock(&session->session_lock);
+        MUTEX_LOCK("session_lock", &session->session_lock);
+        if (!session->board->pacmans[0].alive || session->thread_shutdown || session->victory) {
+            MUTEX_UNLOCK(&session->session_lock);
             pthread_exit(NULL);
         }
-        pthread_mutex_unlock(&session->session_lock);
+        MUTEX_UNLOCK(&session->session_lock);
 
         char op_code;
         ssize_t bytes = read(session->client_req_pipe, &op_code, 1); // Read op code
         
         // Check for read errors
         if (bytes <= 0) {
-            pthread_mutex_lock(&session->session_lock);
+            event_emit(EVENT_DISCONNECT, session->client_id, 0, 0, 0, EVENT_PIPE_CLOSED);
+            flight_abnormal((int)(session - sessions));
+            MUTEX_LOCK("session_lock", &session->session_lock);
             session->thread_shutdown = 1;
-            pthread_mutex_unlock(&session->session_lock);
+            MUTEX_UNLOCK(&session->session_lock);
             pthread_exit(NULL);
         }
 
         // Handle disconnect request
         if (op_code == OP_CODE_DISCONNECT) {
-            pthread_mutex_lock(&session->session_lock);
+            event_emit(EVENT_DISCONNECT, session->client_id, 0, 0, 0, EVENT_BY_CLIENT);
+            MUTEX_LOCK("session_lock", &session->session_lock);
             session->thread_shutdown = 1;
-            pthread_mutex_unlock(&session->session_lock);
+            MUTEX_UNLOCK(&session->session_lock);
             pthread_exit(NULL);
         }
         
-        // Handle play request
-        if (op_code == OP_CODE_PLAY) {
+        // Handle play request, a sequenced one is echoed by the frames drawn after it is applied
+        if (op_code == OP_CODE_PLAY || op_code == OP_CODE_PLAY_SEQ) {
             char command;
+            int seq = -1;
             // Read command
-            if (read(session->client_req_pipe, &command, 1) <= 0) {
-                pthread_mutex_lock(&session->session_lock);
+            if (read(session->client_req_pipe, &command, 1) <= 0 ||
+                (op_code == OP_CODE_PLAY_SEQ && read(session->client_req_pipe, &seq, sizeof(int)) != sizeof(int))) {
+                event_emit(EVENT_DISCONNECT, session->client_id, 0, 0, 0, EVENT_PIPE_CLOSED);
+                flight_abnormal((int)(session - sessions));
+                MUTEX_LOCK("session_lock", &session->session_lock);
                 session->thread_shutdown = 1;
-                pthread_mutex_unlock(&session->session_lock);
+                MUTEX_UNLOCK(&session->session_lock);
                 pthread_exit(NULL);
             }
 
             // Quit command
             if (command == 'Q') {
-                pthread_rwlock_wrlock(&board->state_lock);
-                pacman->alive = 0;  // Set pacman as dead
-                pthread_rwlock_unlock(&board->state_lock);
+                RWLOCK_WRLOCK("state_lock", &session->state_lock);
+                session->board->pacmans[0].alive = 0;  // Set pacman as dead
+                if (seq != -1) session->input_seq = seq;
+                flight_input((int)(session - sessions), session->board, command, seq, VALID_MOVE);
+                RWLOCK_UNLOCK(&session->state_lock);
                 
                 continue;
             }
 
+            atomic_fetch_add_explicit(&session->ticks, 1, memory_order_relaxed);
+
             // Move command
             command_t cmd = {.command = command, .turns = 1}; 
             
-            pthread_rwlock_wrlock(&board->state_lock);
+            RWLOCK_WRLOCK("state_lock", &session->state_lock);
+            board_t *board = session->board;
+            pacman_t *pacman = &board->pacmans[0];
+            int points_before = pacman->points;
+            int was_alive = pacman->alive;
+            trace_begin(TRACE_MOVE_PACMAN);
             int result = move_pacman(board, 0, &cmd);
-            pthread_rwlock_unlock(&board->state_lock);
+            trace_end(TRACE_MOVE_PACMAN);
+            int chase_moved = chase_update(board); // Chasing ghosts follow the new position from their next step
+            int alive = pacman->alive;
+            int tempo = board->tempo;
+            int passo = pacman->passo;
+            int scored = pacman->points != points_before;
+            int total_points = session->accumulated_points + pacman->points;
+            if (seq != -1) session->input_seq = seq;
+            flight_input((int)(session - sessions), board, command, seq, result);
+            if (result == DEAD_PACMAN && was_alive) {
+                event_emit(EVENT_DEATH, session->client_id, board->level_index, pacman->pos_x, pacman->pos_y, -1);
+            }
+            else if (result == REACHED_PORTAL) {
+                event_emit(EVENT_PORTAL, session->client_id, board->level_index, pacman->pos_x, pacman->pos_y, pacman->points);
+            }
+            RWLOCK_UNLOCK(&session->state_lock);
+
+            // The BFS of a level without all-pairs table runs outside the lock, only the swap takes it
+            if (chase_moved) {
+                chase_build(board);
+                RWLOCK_WRLOCK("state_lock", &session->state_lock);
+                chase_publish(board);
+                RWLOCK_UNLOCK(&session->state_lock);
+            }
+
+            if (scored) {
+                leaderboard_update((int)(session - sessions), session->client_id, total_points);
+            }
 
             // Check if Pacman is dead 
-            if (result == DEAD_PACMAN || pacman->alive == 0) {
-                sleep_ms(board->tempo); 
+            if (result == DEAD_PACMAN || alive == 0) {
+                timed_sleep_ms(tempo); 
                 continue;
             }
             
             // Check if reached portal
             if (result == REACHED_PORTAL) {
-                sleep_ms(board->tempo);
-                pthread_mutex_lock(&session->session_lock);
+                MUTEX_LOCK("session_lock", &session->session_lock);
+                scores_record(SCORE_LEVEL, session->client_id, session->current_level, pacman->points, session->seed);
 
-                session->current_level++; // Increment level
-                
                 // Check for victory
-                if (session->current_level >= session->total_levels) {
+                if (session->current_level + 1 >= session->total_levels) {
+                    session->current_level++;
                     session->victory = 1;
-                    pthread_mutex_unlock(&session->session_lock);
-                    sleep_ms(board->tempo);
+                    MUTEX_UNLOCK(&session->session_lock);
+                    timed_sleep_ms(tempo);
                     continue; // Exit to notify victory
-                } else {
-                    session->accumulated_points += board->pacmans[0].points; // Accumulate points
                 }
-                
-                session->level_change_pending = 1; // Request level change
-                session->new_level_index = session->current_level; // Set new level index
-                
-                pthread_mutex_unlock(&session->session_lock);
 
-                sleep_ms(board->tempo);
-                
-                // Wait until level change is done
-                while (1) {
-                    pthread_mutex_lock(&session->session_lock);
-                    // Check if level change is still pending
-                    if (!session->level_change_pending) {
-                        pthread_mutex_unlock(&session->session_lock);
-                        break;
-                    }
-                    pthread_mutex_unlock(&session->session_lock);
-                    sleep_ms(board->tempo);
+                prefetch_next_level(session); // Normally already done by the manager during the level
+                if (!session->next_ready) {
+                    flight_abnormal((int)(session - sessions));
+                    session->thread_shutdown = 1;
+                    MUTEX_UNLOCK(&session->session_lock);
+                    pthread_exit(NULL);
                 }
-                
-                sleep_ms(board->tempo);
+
+                // Swap in the prefetched board, no thread is stopped
+                RWLOCK_WRLOCK("state_lock", &session->state_lock);
+                session->accumulated_points += board->pacmans[0].points; // Accumulate points
+                session->board = spare_board(session);
+                session->current_level++; // Increment level
+                session->next_ready = 0;
+                tempo = session->board->tempo;
+                RWLOCK_UNLOCK(&session->state_lock);
+
+                MUTEX_UNLOCK(&session->session_lock);
+
+                timed_sleep_ms(tempo);
                 continue;
             }
 
-            sleep_ms(board->tempo * (1 + pacman->passo));
+            timed_sleep_ms(tempo * (1 + passo));
         }
     }
 }
 
 
-
 void* session_manager_thread(void *arg) {
     session_data_t *session = (session_data_t*) arg;
-    board_t *board = &session->board;
+    hist_bind((int)(session - sessions), HIST_MANAGER);
+    trace_thread_name("slot %ld manager", (long)(session - sessions));
 
-    while (1) {
-        sleep_ms(50); // Fixed bugs
+    if (wait_for_client(session) != 0) {
+        pthread_exit(NULL);
+    }
 
-        pthread_mutex_lock(&session->session_lock);
-        
-        // Check for level change request
-        if (session->level_change_pending) {
-            int new_level = session->new_level_index; // Get new level index
-            
-            session->thread_shutdown = 1;
-            pthread_mutex_unlock(&session->session_lock);
-            
-            for (int i = 0; i < board->n_ghosts; i++) {
-                pthread_join(session->ghost_tids[i], NULL); // Wait for ghost threads to finish
-            }
-            free(session->ghost_tids); 
-            
-            // Unload current level
-            pthread_rwlock_wrlock(&board->state_lock);
-            unload_level(board);
-            pthread_rwlock_unlock(&board->state_lock);
-            
-            // Load new level
-            if (load_sorted_level(board, levels_dir, new_level, 0) != 0) {
-                pthread_mutex_lock(&session->session_lock);
-                session->thread_shutdown = 1;
-                pthread_mutex_unlock(&session->session_lock);
-                pthread_exit(NULL);
-            }
-            
-            
-            pthread_mutex_lock(&session->session_lock);
-            session->thread_shutdown = 0;
-            session->ghost_tids = malloc(board->n_ghosts * sizeof(pthread_t));
-
-            // Restart ghost threads
-            for (int i = 0; i < board->n_ghosts; i++) {
-                ghost_thread_arg_t *arg = malloc(sizeof(ghost_thread_arg_t));
-                arg->board = board;
-                arg->ghost_index = i;
-                arg->shutdown_flag = &session->thread_shutdown; 
-                pthread_create(&session->ghost_tids[i], NULL, ghost_thread, arg); // Start ghost thread
-            }
-            
-            session->level_change_pending = 0;  
-            pthread_mutex_unlock(&session->session_lock);
-        
-            continue; 
+    for (long frame = 0; ; frame++) {
+        if (frame > 0) {
+            timed_sleep_ms(50); // Fixed bugs, the first frame goes out as soon as the client is bound
         }
+
+        MUTEX_LOCK("session_lock", &session->session_lock);
         
         // Check for shutdown request
         if (session->thread_shutdown) {
-            pthread_mutex_unlock(&session->session_lock);
+            MUTEX_UNLOCK(&session->session_lock);
             pthread_exit(NULL);
         }
+
+        // Get the next level ready while this one is played
+        prefetch_next_level(session);
         
         // Prepare board data to send
         int victory = session->victory;
         int acc_points = session->accumulated_points;
-        pthread_mutex_unlock(&session->session_lock);
+        MUTEX_UNLOCK(&session->session_lock);
 
-        pthread_rwlock_rdlock(&board->state_lock);
+        RWLOCK_RDLOCK("state_lock", &session->state_lock);
+        board_t *board = session->board;
         
-        char op_code = OP_CODE_BOARD;
+        int input_seq = session->input_seq;
+        char op_code = input_seq != -1 ? OP_CODE_BOARD_SEQ : OP_CODE_BOARD;
         int width = board->width;
         int height = board->height;
         int tempo = board->tempo;
@@ -268,13 +367,20 @@ void* session_manager_thread(void *arg) {
         int total_points = acc_points + current_level_points;
 
 
-        char *board_str = get_board_displayed(board); // Get board string
+        long long render_start = monotonic_ns();
+        trace_begin(TRACE_RENDER);
+        char *board_str = get_board_displayed_into(board, board->frame); // Render into the arena frame buffer
         int board_size = width * height;
+        trace_end(TRACE_RENDER);
+        long long render_end = monotonic_ns();
+        hist_record(HIST_RENDER, render_end - render_start);
+        flight_frame((int)(session - sessions), board, frame, total_points);
 
-        pthread_rwlock_unlock(&board->state_lock);
+        RWLOCK_UNLOCK(&session->state_lock);
 
         // Send board data to client
         int write_failed = 0;
+        trace_begin(TRACE_SEND_FRAME);
         if (write(session->client_notif_pipe, &op_code, 1) <= 0 ||
             write(session->client_notif_pipe, &width, sizeof(int)) <= 0 ||
             write(session->client_notif_pipe, &height, sizeof(int)) <= 0 ||
@@ -282,26 +388,36 @@ void* session_manager_thread(void *arg) {
             write(session->client_notif_pipe, &victory, sizeof(int)) <= 0 ||
             write(session->client_notif_pipe, &game_over, sizeof(int)) <= 0 ||
             write(session->client_notif_pipe, &total_points, sizeof(int)) <= 0 ||
+            (op_code == OP_CODE_BOARD_SEQ && write(session->client_notif_pipe, &input_seq, sizeof(int)) <= 0) ||
             write(session->client_notif_pipe, board_str, board_size) != board_size) {
             write_failed = 1; 
         }
-        
-        free(board_str); // Free board string
+        trace_end(TRACE_SEND_FRAME);
+        hist_record(HIST_SEND, monotonic_ns() - render_end);
 
         // Handle write failure
         if (write_failed) {
-            pthread_mutex_lock(&session->session_lock);
+            flight_abnormal((int)(session - sessions));
+            MUTEX_LOCK("session_lock", &session->session_lock);
             session->thread_shutdown = 1;
-            pthread_mutex_unlock(&session->session_lock);
+            MUTEX_UNLOCK(&session->session_lock);
             pthread_exit(NULL);
         }
 
+        atomic_fetch_add_explicit(&session->frames, 1, memory_order_relaxed);
+
+        if (frame == 0) {
+            long long latency = monotonic_us() - session->connect_us;
+            stats_first_frame(latency);
+            log_info("Client %d first frame after %lld us\n", session->client_id, latency);
+        }
+
         // Check for game over or victory to shutdown
         if (game_over || victory) {
-            sleep_ms(board->tempo);
-            pthread_mutex_lock(&session->session_lock);
+            timed_sleep_ms(tempo);
+            MUTEX_LOCK("session_lock", &session->session_lock);
             session->thread_shutdown = 1;
-            pthread_mutex_unlock(&session->session_lock);
+            MUTEX_UNLOCK(&session->session_lock);
             pthread_exit(NULL);
         }
     }
@@ -309,22 +425,23 @@ void* session_manager_thread(void *arg) {
 
 
 void cleanup_session(session_data_t *session) {
-    if (!session->active) return;
+    if (session->slot_state == SLOT_FREE) return;
 
-    pthread_mutex_lock(&session->session_lock);
+    MUTEX_LOCK("session_lock", &session->session_lock);
     session->thread_shutdown = 1;
-    pthread_mutex_unlock(&session->session_lock);
+    pthread_cond_broadcast(&session->start_cond); // Parked threads leave through the start gate
+    MUTEX_UNLOCK(&session->session_lock);
 
-    // Wait for threads to finish
-    pthread_join(session->pacman_tid, NULL);
+    // Wait for threads to finish, the pacman of a started session is joined by its worker
+    if (!session->started) {
+        pthread_join(session->pacman_tid, NULL);
+    }
     pthread_join(session->session_tid, NULL);
     
-    for (int i = 0; i < session->board.n_ghosts; i++) {
+    for (int i = 0; i < session->n_ghost_threads; i++) {
         pthread_join(session->ghost_tids[i], NULL);
     }
     
-    free(session->ghost_tids);
-    
     // Close pipes
     if (session->client_req_pipe != -1) {
         close(session->client_req_pipe);
@@ -335,15 +452,220 @@ void cleanup_session(session_data_t *session) {
         session->client_notif_pipe = -1;
     }
     
-    unload_level(&session->board); // Unload level data
-    memset(&session->board, 0, sizeof(board_t)); // Clear board data
+    // Unload level data, the arenas keep the memory for the next session
+    for (int b = 0; b < 2; b++) {
+        if (session->boards[b].board) {
+            trace_begin(TRACE_UNLOAD_LEVEL);
+            unload_level(&session->boards[b]);
+            trace_end(TRACE_UNLOAD_LEVEL);
+        }
+        log_info("Session slot %ld arena %d: high water %zu bytes, %zu reserved, %d cell locks, %lu resets, %lu mallocs\n",
+                 (long)(session - sessions), b, session->arenas[b].high_water, session->arenas[b].capacity,
+                 session->arenas[b].n_locks, session->arenas[b].resets, session->arenas[b].block_allocs);
+    }
+    memset(session->boards, 0, sizeof(session->boards)); // Clear board data
+    session->board = NULL;
+    catalog_release(session->catalog);
+    session->catalog = NULL;
+    pthread_cond_destroy(&session->start_cond);
+    pthread_rwlock_destroy(&session->state_lock);
     pthread_mutex_destroy(&session->session_lock);
-    session->active = 0; // Mark session as inactive
+}
+
+
+/*
+Loads level 0, prefetches level 1 and starts the pacman, manager and ghost threads parked on the start gate
+Everything but the client pipes is ready afterwards, -1 on error
+*/
+static int prepare_session(session_data_t *session) {
+    pthread_mutex_init(&session->session_lock, NULL);
+    pthread_rwlock_init(&session->state_lock, NULL);
+    pthread_cond_init(&session->start_cond, NULL);
+    session->started = 0;
+    session->client_id = -1;
+    session->thread_shutdown = 0;
+    session->client_req_pipe = -1;
+    session->client_notif_pipe = -1;
+    session->current_level = 0;
+    session->total_levels = 0;
+    session->victory = 0;
+    session->accumulated_points = 0;
+    session->next_ready = 0;
+    atomic_store(&session->ticks, 0);
+    atomic_store(&session->frames, 0);
+    session->input_seq = -1;
+    session->seed = new_session_seed();
+    session->boards[0].arena = &session->arenas[0];
+    session->boards[1].arena = &session->arenas[1];
+    session->board = &session->boards[0];
+
+    // Load the first level
+    session->catalog = catalog_acquire(); // Pinned until cleanup, reloads do not affect this session
+    session->total_levels = session->catalog ? session->catalog->n_levels : 0;
+    if (load_session_level(session, session->board, 0) != 0) {
+        catalog_release(session->catalog);
+        session->catalog = NULL;
+        pthread_cond_destroy(&session->start_cond);
+        pthread_rwlock_destroy(&session->state_lock);
+        pthread_mutex_destroy(&session->session_lock);
+        return -1;
+    }
+    prefetch_next_level(session); // No other thread yet, session_lock is not needed
+
+    // One ghost worker per ghost of the busiest level, they live as long as the session
+    session->n_ghost_threads = session->catalog->max_ghosts;
+
+    // Create threads for Pacman, session manager, and ghosts
+    pthread_create(&session->pacman_tid, NULL, pacman_thread, session);
+    pthread_create(&session->session_tid, NULL, session_manager_thread, session);
     
+    for (int i = 0; i < session->n_ghost_threads; i++) {
+        ghost_thread_arg_t *arg = malloc(sizeof(ghost_thread_arg_t));
+        arg->session = session;
+        arg->ghost_index = i;
+        arg->shutdown_flag = &session->thread_shutdown;
+        pthread_create(&session->ghost_tids[i], NULL, ghost_thread, arg);
+    }
+
+    return 0;
+}
+
+
+// Opens the client pipes of a prepared session and opens its start gate, -1 on error
+static int bind_session(session_data_t *session, connection_request_t *req) {
+    // Open the notification pipe to write
+    session->client_notif_pipe = open(req->notif_pipe_path, O_WRONLY);
+    if (session->client_notif_pipe == -1) {
+        return -1;
+    }
+
+    char resp_op_code = OP_CODE_CONNECT; // Op code for connect response
+    char result = 0; // Success when connecting
+    
+    // Send connection response to client
+    if (write(session->client_notif_pipe, &resp_op_code, 1) <= 0 ||
+        write(session->client_notif_pipe, &result, 1) <= 0) {
+        return -1;
+    }
+
+    // Open the request pipe to read
+    session->client_req_pipe = open(req->req_pipe_path, O_RDONLY);
+    if (session->client_req_pipe == -1) {
+        return -1;
+    }
+
+    // Save pipe paths
+    strncpy(session->client_req_path, req->req_pipe_path, MAX_PIPE_PATH_LENGTH);
+    strncpy(session->client_notif_path, req->notif_pipe_path, MAX_PIPE_PATH_LENGTH);
+    session->client_id = req->client_id;
+    session->connect_us = req->received_us;
+    hist_tag((int)(session - sessions), req->client_id); // Before the start gate, no thread of the slot records yet
+    flight_begin((int)(session - sessions), req->client_id, session->seed);
+    leaderboard_update((int)(session - sessions), req->client_id, 0); // Seeded before the pacman can score
+
+    MUTEX_LOCK("session_lock", &session->session_lock);
+    session->started = 1;
+    pthread_cond_broadcast(&session->start_cond);
+    MUTEX_UNLOCK(&session->session_lock);
+    return 0;
+}
+
+
+// Helper private function to take a slot for a client, pre-warmed slots first
+static session_data_t *claim_slot(int *warm) {
+    session_data_t *session = NULL;
+
+    MUTEX_LOCK("sessions_mutex", &sessions_mutex);
+    for (int i = 0; i < max_games && !session; i++) {
+        if (sessions[i].slot_state == SLOT_WARM) session = &sessions[i];
+    }
+    *warm = session != NULL;
+    for (int i = 0; i < max_games && !session; i++) {
+        if (sessions[i].slot_state == SLOT_FREE) session = &sessions[i];
+    }
+    if (session) session->slot_state = SLOT_BINDING;
+    MUTEX_UNLOCK(&sessions_mutex);
+
+    return session;
+}
+
+
+// Helper private function to move a slot to the next state of its lifecycle
+static void set_slot_state(session_data_t *session, slot_state_t state) {
+    MUTEX_LOCK("sessions_mutex", &sessions_mutex);
+    session->slot_state = state;
+    MUTEX_UNLOCK(&sessions_mutex);
+}
+
+
+// Helper private function to give a slot back once its session is cleaned up
+static void release_slot(session_data_t *session) {
+    set_slot_state(session, SLOT_FREE);
+}
+
+
+// Helper private function to take every free or warm slot away from the workers, returns the slots still in use
+static int close_idle_slots(void) {
+    int busy = 0;
+    MUTEX_LOCK("sessions_mutex", &sessions_mutex);
+    for (int i = 0; i < max_games; i++) {
+        if (sessions[i].slot_state == SLOT_FREE || sessions[i].slot_state == SLOT_WARM) {
+            sessions[i].slot_state = SLOT_CLOSING;
+        }
+        else {
+            busy++; // Including a worker still cleaning up its game
+        }
+    }
+    MUTEX_UNLOCK(&sessions_mutex);
+    return busy;
+}
+
+
+// Helper private function to turn a client away, the worker stays free for the next request
+static void refuse_client(connection_request_t *req) {
+    int notif_pipe = open(req->notif_pipe_path, O_WRONLY);
+    if (notif_pipe == -1) {
+        return;
+    }
+
+    char response[2] = {OP_CODE_CONNECT, 1}; // Op code + failure
+    if (write(notif_pipe, response, 2) != 2) {
+        log_warn("Could not refuse client %d\n", req->client_id);
+    }
+    close(notif_pipe);
+}
+
+
+// Prepares free slots until server_config.prewarm_slots of them are waiting for clients
+static void warm_idle_slots(void) {
+    while (1) {
+        session_data_t *session = NULL;
+        int warm = 0;
+
+        MUTEX_LOCK("sessions_mutex", &sessions_mutex);
+        for (int i = 0; i < max_games; i++) {
+            if (sessions[i].slot_state == SLOT_WARM || sessions[i].slot_state == SLOT_WARMING) warm++;
+            else if (sessions[i].slot_state == SLOT_FREE && !session) session = &sessions[i];
+        }
+        if (warm >= server_config.prewarm_slots || !session) {
+            MUTEX_UNLOCK(&sessions_mutex);
+            return;
+        }
+        session->slot_state = SLOT_WARMING;
+        MUTEX_UNLOCK(&sessions_mutex);
+
+        int failed = prepare_session(session) != 0;
+
+        MUTEX_LOCK("sessions_mutex", &sessions_mutex);
+        session->slot_state = failed ? SLOT_FREE : SLOT_WARM;
+        MUTEX_UNLOCK(&sessions_mutex);
+        if (failed) return;
+    }
 }
 
 
 void* session_worker_thread(void *arg) {
+    trace_thread_name("worker %d", *(int*)arg);
     free(arg);
 
     sigset_t set; // Create signal set
@@ -355,136 +677,147 @@ void* session_worker_thread(void *arg) {
     while (1) {
         // Remove request from buffer and process it
         connection_request_t req = buffer_remove(&req_buffer); 
-        
-
-        // Find an available session slot
-        pthread_mutex_lock(&sessions_mutex);
-        int session_id = -1;
-        for (int i = 0; i < max_games; i++) {
-            if (!sessions[i].active) {
-                session_id = i;
-                sessions[i].active = 1;  // Mark session as active
-                break;
-            }
-        }
-        pthread_mutex_unlock(&sessions_mutex);
 
-        if (session_id == -1) {
+        // Paused or drained through the admin socket
+        if (!admin_accepting()) {
+            refuse_client(&req);
             continue;
         }
-
-        // Initialize session data
-        session_data_t *session = &sessions[session_id]; // Get session pointer
-        pthread_mutex_init(&session->session_lock, NULL);
-        session->client_id = req.client_id;
-        session->thread_shutdown = 0;
-        session->client_req_pipe = -1;
-        session->client_notif_pipe = -1;
-        session->current_level = 0;
-        session->total_levels = count_levels(levels_dir);
-        session->victory = 0;
-        session->accumulated_points = 0;
-        session->level_change_pending = 0;
-        session->new_level_index = 0;   
-
-
-        // Open the notification pipe to write
-        session->client_notif_pipe = open(req.notif_pipe_path, O_WRONLY);
-        if (session->client_notif_pipe == -1) {
-            pthread_mutex_lock(&sessions_mutex);
-            session->active = 0;
-            pthread_mutex_unlock(&sessions_mutex);
-            pthread_mutex_destroy(&session->session_lock);
+        
+        // Find an available session slot
+        int warm;
+        session_data_t *session = claim_slot(&warm);
+        if (!session) {
             continue;
         }
 
-        
-        char resp_op_code = OP_CODE_CONNECT; // Op code for connect response
-        char result = 0; // Success when connecting
-        
-        // Send connection response to client
-        if (write(session->client_notif_pipe, &resp_op_code, 1) <= 0 ||
-            write(session->client_notif_pipe, &result, 1) <= 0) {
-            close(session->client_notif_pipe);
-            pthread_mutex_lock(&sessions_mutex);
-            session->active = 0;
-            pthread_mutex_unlock(&sessions_mutex);
-            pthread_mutex_destroy(&session->session_lock);
-            continue;
+        // A slot warmed before a reload would still play the old levels
+        if (warm && !catalog_is_current(session->catalog)) {
+            cleanup_session(session);
+            warm = 0;
         }
 
-        // Open the request pipe to read
-        session->client_req_pipe = open(req.req_pipe_path, O_RDONLY);
-        if (session->client_req_pipe == -1) {
-            close(session->client_notif_pipe);
-            pthread_mutex_lock(&sessions_mutex);
-            session->active = 0;
-            pthread_mutex_unlock(&sessions_mutex);
-            pthread_mutex_destroy(&session->session_lock);
+        if (!warm && prepare_session(session) != 0) {
+            release_slot(session);
             continue;
         }
 
-        // Save pipe paths
-        strncpy(session->client_req_path, req.req_pipe_path, MAX_PIPE_PATH_LENGTH);
-        strncpy(session->client_notif_path, req.notif_pipe_path, MAX_PIPE_PATH_LENGTH);
-
-        // Load the first level
-        if (load_sorted_level(&session->board, levels_dir, 0, 0) != 0) {
-            close(session->client_req_pipe);
-            close(session->client_notif_pipe);
-            pthread_mutex_lock(&sessions_mutex);
-            session->active = 0;
-            pthread_mutex_unlock(&sessions_mutex);
-            pthread_mutex_destroy(&session->session_lock);
+        trace_begin(TRACE_HANDSHAKE);
+        int bound = bind_session(session, &req);
+        trace_end(TRACE_HANDSHAKE);
+        if (bound != 0) {
+            cleanup_session(session);
+            release_slot(session);
             continue;
         }
+        set_slot_state(session, SLOT_ACTIVE);
+        stats_connect(warm);
+        event_emit(EVENT_CONNECT, req.client_id, 0, 0, 0, warm);
+        log_info("Client %d bound to %s slot %ld, seed %llu\n", req.client_id, warm ? "warm" : "cold",
+                 (long)(session - sessions), (unsigned long long)session->seed);
 
-        session->ghost_tids = malloc(session->board.n_ghosts * sizeof(pthread_t));
-
-        // Create threads for Pacman, session manager, and ghosts
-        pthread_create(&session->pacman_tid, NULL, pacman_thread, session);
-        pthread_create(&session->session_tid, NULL, session_manager_thread, session);
-        
-        for (int i = 0; i < session->board.n_ghosts; i++) {
-            ghost_thread_arg_t *arg = malloc(sizeof(ghost_thread_arg_t));
-            arg->board = &session->board;
-            arg->ghost_index = i;
-            arg->shutdown_flag = &session->thread_shutdown;
-            pthread_create(&session->ghost_tids[i], NULL, ghost_thread, arg);
-        }
+        warm_idle_slots(); // Replace the slot this client took, off its critical path
 
         // Wait for Pacman thread to finish
         pthread_join(session->pacman_tid, NULL);
+        set_slot_state(session, SLOT_CLOSING); // Out of the admin socket's sight before anything is freed
+        leaderboard_remove((int)(session - sessions));
+
+        MUTEX_LOCK("session_lock", &session->session_lock);
+        int total_points = session->accumulated_points + session->board->pacmans[0].points;
+        scores_record(SCORE_GAME, session->client_id, session->current_level, total_points, session->seed);
+        event_emit(EVENT_GAME_END, session->client_id, session->current_level, 0, 0, total_points);
+        MUTEX_UNLOCK(&session->session_lock);
         
         cleanup_session(session);
-        
-        pthread_mutex_lock(&sessions_mutex);
-        session->active = 0;
-        pthread_mutex_unlock(&sessions_mutex);
+        flight_end((int)(session - sessions)); // Every thread of the session is joined, the ring is complete
+        release_slot(session);
+        warm_idle_slots();
     }
 
     return NULL;
 }
 
+// Helper private function to answer a leaderboard or high scores query read from the server pipe
+static void answer_scores_query(int server_pipe, char op_code) {
+    char reply_path[MAX_PIPE_PATH_LENGTH];
+    if (read(server_pipe, reply_path, MAX_PIPE_PATH_LENGTH) != MAX_PIPE_PATH_LENGTH) {
+        return;
+    }
+    reply_path[MAX_PIPE_PATH_LENGTH - 1] = '\0';
+
+    leaderboard_entry_t top[MAX_LEADERBOARD_SIZE];
+    int count = 0;
+    if (op_code == OP_CODE_LEADERBOARD) {
+        count = leaderboard_read(top, server_config.leaderboard_k);
+    }
+    else {
+        int level; // -1 for whole games
+        if (read(server_pipe, &level, sizeof(int)) != sizeof(int)) {
+            return;
+        }
+        score_record_t best[MAX_LEADERBOARD_SIZE];
+        count = scores_top(level, best, server_config.highscores_n); // From the index, history is never scanned
+        for (int i = 0; i < count; i++) {
+            top[i].client_id = best[i].client_id;
+            top[i].points = best[i].points;
+        }
+    }
+
+    // Non blocking so a client that went away never stalls the host thread
+    int reply_pipe = open(reply_path, O_WRONLY | O_NONBLOCK);
+    if (reply_pipe == -1) {
+        return;
+    }
+
+    // op code, count, then count (client_id, points) pairs in a single write below PIPE_BUF
+    char reply[1 + sizeof(int) + MAX_LEADERBOARD_SIZE * 2 * sizeof(int)];
+    reply[0] = op_code;
+    memcpy(reply + 1, &count, sizeof(int));
+    char *cursor = reply + 1 + sizeof(int);
+    for (int i = 0; i < count; i++) {
+        memcpy(cursor, &top[i].client_id, sizeof(int));
+        memcpy(cursor + sizeof(int), &top[i].points, sizeof(int));
+        cursor += 2 * sizeof(int);
+    }
+
+    if (write(reply_pipe, reply, cursor - reply) != cursor - reply) {
+        log_warn("Scores reply to %s failed\n", reply_path);
+    }
+    close(reply_pipe);
+}
+
 // Signal handler for SIGUSR1
 void sigusr1_handler(int sig) {
     (void)sig; 
     sigusr1_received = 1; // Set flag to indicate signal received
 }
 
+// Signal handler for SIGTERM and SIGINT, the host thread stops reading and main shuts down
+void shutdown_handler(int sig) {
+    (void)sig;
+    shutdown_requested = 1;
+}
+
 void* host_thread(void *arg) {
     char *fifo_pathname = (char*)arg; 
+    trace_thread_name("host");
 
     sigset_t set; // Create signal set
     sigemptyset(&set); // Initialize empty signal set
     sigaddset(&set, SIGUSR1); // Add SIGUSR1 to the set
-    pthread_sigmask(SIG_UNBLOCK, &set, NULL); // Unblock SIGUSR1 in this thread
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL); // Unblock them in this thread only, so they interrupt its read
     
     struct sigaction sa; // Set up signal action
     sa.sa_handler = sigusr1_handler; // Set signal handler with sigusr1_handler
     sigemptyset(&sa.sa_mask); // No additional signals to block
     sa.sa_flags = 0; // No special flags, default behavior
     sigaction(SIGUSR1, &sa, NULL); // Register signal handler
+    sa.sa_handler = shutdown_handler;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
 
 
     int server_pipe = open(fifo_pathname, O_RDWR); // Open server FIFO for reading and writing to avoid EOF    
@@ -494,7 +827,7 @@ void* host_thread(void *arg) {
     }
 
 
-    while (1) {
+    while (!shutdown_requested) {
         // Check if SIGUSR1 was received
         if (sigusr1_received) {
             sigusr1_received = 0;
@@ -504,36 +837,11 @@ void* host_thread(void *arg) {
             if (f) {
                 fprintf(f, "Top 5 Clients Connected\n\n"); 
                 
-                typedef struct { int id; int points; } client_score_t; // Struct for client score
-                client_score_t scores[max_games]; // Array to save scores
-                int count = 0;
-                
-                pthread_mutex_lock(&sessions_mutex);
-                for (int i = 0; i < max_games; i++) {
-                    if (sessions[i].active) {
-                        scores[count].id = sessions[i].client_id; // Save client ID
-                        // Save total points
-                        scores[count].points = sessions[i].accumulated_points + sessions[i].board.pacmans[0].points;
-                        count++;
-                    }
-                }
-                pthread_mutex_unlock(&sessions_mutex);
-                
-                // Sort scores in descending order
-                for (int i = 0; i < count - 1; i++) {
-                    for (int j = 0; j < count - i - 1; j++) {
-                        if (scores[j].points < scores[j + 1].points) {
-                            client_score_t temp = scores[j];
-                            scores[j] = scores[j + 1];
-                            scores[j + 1] = temp;
-                        }
-                    }
-                }
-                
-                int limit = count < 5 ? count : 5; // Limit to top 5 clients
-                for (int i = 0; i < limit; i++) {
+                leaderboard_entry_t top[5];
+                int count = leaderboard_read(top, 5); // Already sorted, no session is touched
+                for (int i = 0; i < count; i++) {
                     fprintf(f, "%d. Client ID %d - %d points\n", 
-                            i + 1, scores[i].id, scores[i].points); // Write client score to file
+                            i + 1, top[i].client_id, top[i].points); // Write client score to file
                 }
                 
                 if (count == 0) {
@@ -543,6 +851,18 @@ void* host_thread(void *arg) {
                 fclose(f);
                 printf("Top 5 clients file generated (top5_clients.txt)\n");
             }
+
+            if (stats_dump("server_stats.txt") == 0) {
+                printf("Server stats file generated (server_stats.txt)\n");
+            }
+
+            if (hist_dump("server_latency.txt") == 0) {
+                printf("Server latency file generated (server_latency.txt)\n");
+            }
+
+            if (lockprof_dump("server_locks.txt") == 0) {
+                printf("Lock contention file generated (server_locks.txt)\n");
+            }
         }
         
         char op_code;
@@ -553,7 +873,12 @@ void* host_thread(void *arg) {
             continue;
         }
 
-        // Process only connection requests
+        if (op_code == OP_CODE_LEADERBOARD || op_code == OP_CODE_HIGHSCORES) {
+            answer_scores_query(server_pipe, op_code);
+            continue;
+        }
+
+        // Otherwise process only connection requests
         if (op_code != OP_CODE_CONNECT) {
             continue;
         }    
@@ -565,6 +890,7 @@ void* host_thread(void *arg) {
             read(server_pipe, req.notif_pipe_path, MAX_PIPE_PATH_LENGTH) != MAX_PIPE_PATH_LENGTH) {
             continue;
         }
+        req.received_us = monotonic_us(); // Start of the connect to first frame latency
         
         buffer_insert(&req_buffer, req); // Insert request into buffer 
     }
@@ -577,7 +903,7 @@ void* host_thread(void *arg) {
 int main(int argc, char** argv) {
     signal(SIGPIPE, SIG_IGN); // Ignore SIGPIPE signals
     if (argc != 4) {
-        printf("Usage: %s <levels_dir> <max_games> <register_pipe>\n", argv[0]);
+        printf("Usage: %s <levels_dir|levels.pack> <max_games> <register_pipe>\n", argv[0]);
         return -1;
     }
 
@@ -590,8 +916,18 @@ int main(int argc, char** argv) {
         return -1;
     }
 
-    srand(time(NULL)); // Seed random number generator
-    open_debug_file("server-debug.log");
+    // Before any thread starts (the log flusher is the first), every thread inherits the mask
+    sigset_t set; // Create signal set
+    sigemptyset(&set); // Initialize empty signal set
+    sigaddset(&set, SIGUSR1); // Add SIGUSR1 to the set
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, NULL); // Only the host thread takes them
+
+    config_load(max_games);
+    if (log_open("server-debug.log", server_config.log_level) != 0) {
+        fprintf(stderr, "Error opening server-debug.log: %s\n", strerror(errno));
+    }
 
     unlink(fifo_pathname); // Remove existing FIFO
     // Create server FIFO
@@ -600,13 +936,53 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    sigset_t set; // Create signal set
-    sigemptyset(&set); // Initialize empty signal set
-    sigaddset(&set, SIGUSR1); // Add SIGUSR1 to the set
-    pthread_sigmask(SIG_BLOCK, &set, NULL); // Block SIGUSR1 in main thread
+    // Parse every level once, sessions never touch the levels directory again
+    if (catalog_init(levels_dir) != 0) {
+        fprintf(stderr, "Error loading levels from %s\n", levels_dir);
+        return 1;
+    }
 
     buffer_init(&req_buffer); // Initialize request buffer
-    sessions = calloc(max_games, sizeof(session_data_t));
+    // Cache line aligned so neighbouring sessions never share a line
+    sessions = aligned_alloc(CACHE_LINE_SIZE, max_games * sizeof(session_data_t));
+    memset(sessions, 0, max_games * sizeof(session_data_t));
+    for (int i = 0; i < max_games; i++) {
+        arena_init(&sessions[i].arenas[0]);
+        arena_init(&sessions[i].arenas[1]);
+    }
+
+    if (leaderboard_init(max_games, server_config.leaderboard_k) != 0) {
+        fprintf(stderr, "Error allocating the leaderboard\n");
+        return 1;
+    }
+    if (hist_init(max_games) != 0) {
+        fprintf(stderr, "Error allocating the latency histograms\n");
+        return 1;
+    }
+    if (flight_init(max_games, server_config.flight_dir) != 0) {
+        fprintf(stderr, "Error allocating the flight recorder\n");
+        return 1;
+    }
+    if (scores_init(server_config.score_dir, server_config.highscores_n, server_config.score_compact_sec) != 0) {
+        fprintf(stderr, "Error opening the score store in %s: %s\n", server_config.score_dir, strerror(errno));
+        return 1;
+    }
+    char admin_path[MAX_FILENAME];
+    snprintf(admin_path, sizeof(admin_path), "%s.admin", fifo_pathname);
+    if (admin_init(admin_path, sessions, max_games, &sessions_mutex, &req_buffer) != 0) {
+        fprintf(stderr, "Error opening admin socket %s: %s\n", admin_path, strerror(errno));
+        return 1;
+    }
+    if (server_config.events_dir && events_init(server_config.events_dir, server_config.events_rotate_bytes) != 0) {
+        fprintf(stderr, "Error starting the event stream in %s: %s\n", server_config.events_dir, strerror(errno));
+        return 1;
+    }
+    char trace_path[MAX_FILENAME];
+    if (server_config.trace_sec > 0 &&
+        trace_start(server_config.trace_dir, server_config.trace_sec, trace_path, sizeof(trace_path)) == 0) {
+        printf("Tracing the first %d s into %s\n", server_config.trace_sec, trace_path);
+    }
+    warm_idle_slots(); // First clients get a ready slot too
 
     printf("Server initialized\n");
 
@@ -623,18 +999,39 @@ int main(int argc, char** argv) {
     pthread_join(host_tid, NULL); // Wait for host thread to finish
 
     printf("Server shutting down\n");
+    admin_shutdown();
+    trace_shutdown();
+
+    // Games still in play belong to their workers, the process exit takes them down with everything they use
+    int busy = close_idle_slots();
+    if (busy > 0) {
+        log_warn("Shutting down with %d games in play\n", busy);
+        scores_shutdown();
+        events_shutdown();
+        unlink(fifo_pathname);
+        log_close();
+        return 0;
+    }
     
     for (int i = 0; i < max_games; i++) {
-        if (sessions[i].active) {
-            cleanup_session(&sessions[i]); 
+        if (sessions[i].board) {
+            cleanup_session(&sessions[i]); // A warm slot
         }
+        arena_destroy(&sessions[i].arenas[0]);
+        arena_destroy(&sessions[i].arenas[1]);
     }
 
     free(sessions);
     free(worker_tids);
+    catalog_shutdown();
+    scores_shutdown();
+    events_shutdown();
+    leaderboard_destroy();
+    hist_destroy();
+    flight_destroy();
     buffer_destroy(&req_buffer);
     unlink(fifo_pathname);
-    close_debug_file();
+    log_close();
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,278 @@
+#include "histogram.h"
+#include "utils.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+static hist_thread_t *threads; // HIST_THREADS per slot
+static atomic_int *slot_clients;
+static int n_hist_slots;
+static _Thread_local hist_thread_t *current;
+
+static const char *metric_names[HIST_METRICS] = {
+    [HIST_TICK_LATE] = "tick_late",
+    [HIST_LOCK_WAIT] = "lock_wait",
+    [HIST_RENDER] = "render",
+    [HIST_SEND] = "send",
+};
+
+static hist_merged_t retired[HIST_METRICS]; // Sessions that left their slot, still part of the totals
+static pthread_mutex_t retired_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline int bucket_of(uint64_t ns) {
+    if (ns < (1u << HIST_SUB_BITS)) return (int)ns;
+
+    int exp = 63 - __builtin_clzll(ns);
+    if (exp >= HIST_MAX_EXP) return HIST_BUCKETS - 1;
+    int shift = exp - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + (int)((ns >> shift) & ((1u << HIST_SUB_BITS) - 1));
+}
+
+// Largest value that falls in bucket, percentiles are reported as upper bounds
+static inline uint64_t bucket_upper(int bucket) {
+    if (bucket < (1 << HIST_SUB_BITS)) return bucket;
+
+    int shift = (bucket >> HIST_SUB_BITS) - 1;
+    uint64_t mantissa = (bucket & ((1u << HIST_SUB_BITS) - 1)) | (1u << HIST_SUB_BITS);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+int hist_init(int n_slots) {
+    threads = aligned_alloc(CACHE_LINE_SIZE, (size_t)n_slots * HIST_THREADS * sizeof(hist_thread_t));
+    slot_clients = calloc(n_slots, sizeof(atomic_int));
+    if (!threads || !slot_clients) {
+        hist_destroy();
+        return -1;
+    }
+    memset(threads, 0, (size_t)n_slots * HIST_THREADS * sizeof(hist_thread_t));
+    for (int i = 0; i < n_slots; i++) {
+        atomic_init(&slot_clients[i], -1);
+    }
+    n_hist_slots = n_slots;
+    return 0;
+}
+
+void hist_destroy(void) {
+    free(threads);
+    free(slot_clients);
+    threads = NULL;
+    slot_clients = NULL;
+    n_hist_slots = 0;
+    memset(retired, 0, sizeof(retired));
+}
+
+void hist_bind(int slot, int role) {
+    current = threads && slot >= 0 && slot < n_hist_slots && role >= 0 && role < HIST_THREADS
+                  ? &threads[(size_t)slot * HIST_THREADS + role]
+                  : NULL;
+}
+
+void hist_merge(hist_merged_t *merged, const histogram_t *hist) {
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        unsigned count = atomic_load_explicit(&hist->counts[b], memory_order_relaxed);
+        merged->counts[b] += count;
+        merged->count += count;
+    }
+    merged->total_ns += atomic_load_explicit(&hist->total_ns, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&hist->max_ns, memory_order_relaxed);
+    if (max > merged->max_ns) merged->max_ns = max;
+}
+
+// Helper private function to add the metric of threads [first, first + n) to merged
+static void merge_threads(hist_merged_t *merged, hist_metric_t metric, size_t first, size_t n) {
+    for (size_t t = first; t < first + n; t++) {
+        hist_merge(merged, &threads[t].metrics[metric]);
+    }
+}
+
+void hist_tag(int slot, int client_id) {
+    if (!threads || slot < 0 || slot >= n_hist_slots) return;
+
+    // The threads of the previous session are joined and the new ones have not started yet
+    hist_thread_t *first = &threads[(size_t)slot * HIST_THREADS];
+    pthread_mutex_lock(&retired_mutex);
+    for (int m = 0; m < HIST_METRICS; m++) {
+        merge_threads(&retired[m], m, (size_t)slot * HIST_THREADS, HIST_THREADS);
+    }
+    memset(first, 0, HIST_THREADS * sizeof(hist_thread_t));
+    atomic_store_explicit(&slot_clients[slot], client_id, memory_order_relaxed);
+    pthread_mutex_unlock(&retired_mutex);
+}
+
+void hist_record(hist_metric_t metric, long long ns) {
+    hist_thread_t *thread = current;
+    if (!thread) return;
+
+    uint64_t value = ns > 0 ? (uint64_t)ns : 0;
+    histogram_t *hist = &thread->metrics[metric];
+    int bucket = bucket_of(value);
+
+    // Only this thread writes, so load + store instead of locked read-modify-writes
+    atomic_store_explicit(&hist->counts[bucket],
+                          atomic_load_explicit(&hist->counts[bucket], memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&hist->total_ns,
+                          atomic_load_explicit(&hist->total_ns, memory_order_relaxed) + value, memory_order_relaxed);
+    if (value > atomic_load_explicit(&hist->max_ns, memory_order_relaxed)) {
+        atomic_store_explicit(&hist->max_ns, value, memory_order_relaxed);
+    }
+}
+
+void hist_add(histogram_t *hist, long long ns) {
+    uint64_t value = ns > 0 ? (uint64_t)ns : 0;
+    atomic_fetch_add_explicit(&hist->counts[bucket_of(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->total_ns, value, memory_order_relaxed);
+
+    unsigned long long max = atomic_load_explicit(&hist->max_ns, memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak(&hist->max_ns, &max, value)) {
+    }
+}
+
+int hist_mutex_lock(pthread_mutex_t *mutex) {
+    if (pthread_mutex_trylock(mutex) == 0) {
+        hist_record(HIST_LOCK_WAIT, 0); // Free locks count too, or the percentiles would only show contention
+        return 0;
+    }
+    long long start = monotonic_ns();
+    trace_begin(TRACE_LOCK_WAIT);
+    pthread_mutex_lock(mutex);
+    trace_end(TRACE_LOCK_WAIT);
+    hist_record(HIST_LOCK_WAIT, monotonic_ns() - start);
+    return 1;
+}
+
+int hist_rwlock_rdlock(pthread_rwlock_t *lock) {
+    if (pthread_rwlock_tryrdlock(lock) == 0) {
+        hist_record(HIST_LOCK_WAIT, 0);
+        return 0;
+    }
+    long long start = monotonic_ns();
+    trace_begin(TRACE_LOCK_WAIT);
+    pthread_rwlock_rdlock(lock);
+    trace_end(TRACE_LOCK_WAIT);
+    hist_record(HIST_LOCK_WAIT, monotonic_ns() - start);
+    return 1;
+}
+
+int hist_rwlock_wrlock(pthread_rwlock_t *lock) {
+    if (pthread_rwlock_trywrlock(lock) == 0) {
+        hist_record(HIST_LOCK_WAIT, 0);
+        return 0;
+    }
+    long long start = monotonic_ns();
+    trace_begin(TRACE_LOCK_WAIT);
+    pthread_rwlock_wrlock(lock);
+    trace_end(TRACE_LOCK_WAIT);
+    hist_record(HIST_LOCK_WAIT, monotonic_ns() - start);
+    return 1;
+}
+
+uint64_t hist_percentile(const hist_merged_t *merged, double fraction) {
+    uint64_t wanted = (uint64_t)(merged->count * fraction + 0.5);
+    if (wanted == 0) wanted = 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += merged->counts[b];
+        if (seen >= wanted) {
+            uint64_t upper = bucket_upper(b);
+            return upper < merged->max_ns ? upper : merged->max_ns;
+        }
+    }
+    return merged->max_ns;
+}
+
+// Helper private function to merge one metric of a slot, or of every slot when slot is -1
+static void merge_metric(hist_merged_t *merged, hist_metric_t metric, int slot) {
+    memset(merged, 0, sizeof(*merged));
+    if (slot == -1) {
+        *merged = retired[metric];
+        merge_threads(merged, metric, 0, (size_t)n_hist_slots * HIST_THREADS);
+    }
+    else {
+        merge_threads(merged, metric, (size_t)slot * HIST_THREADS, HIST_THREADS);
+    }
+}
+
+// Helper private function, whether a slot recorded anything yet
+static int slot_used(int slot, hist_merged_t *scratch) {
+    for (int m = 0; m < HIST_METRICS; m++) {
+        merge_metric(scratch, m, slot);
+        if (scratch->count > 0) return 1;
+    }
+    return 0;
+}
+
+static void print_metrics(FILE *f, int slot) {
+    hist_merged_t merged;
+    for (int m = 0; m < HIST_METRICS; m++) {
+        merge_metric(&merged, m, slot);
+        if (merged.count == 0) continue;
+        fprintf(f, "  %-10s count %llu mean %.1f p50 %.1f p90 %.1f p99 %.1f p999 %.1f max %.1f\n", metric_names[m],
+                (unsigned long long)merged.count, merged.total_ns / 1e3 / merged.count,
+                hist_percentile(&merged, 0.50) / 1e3, hist_percentile(&merged, 0.90) / 1e3,
+                hist_percentile(&merged, 0.99) / 1e3, hist_percentile(&merged, 0.999) / 1e3, merged.max_ns / 1e3);
+    }
+}
+
+int hist_dump(const char *path) {
+    if (!threads) return -1;
+
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    pthread_mutex_lock(&retired_mutex);
+    fprintf(f, "Latency histograms (microseconds, percentiles are bucket upper bounds)\n\n");
+    fprintf(f, "all slots\n");
+    print_metrics(f, -1);
+
+    hist_merged_t scratch;
+    for (int slot = 0; slot < n_hist_slots; slot++) {
+        if (!slot_used(slot, &scratch)) continue;
+        fprintf(f, "\nslot %d (client %d)\n", slot, atomic_load(&slot_clients[slot]));
+        print_metrics(f, slot);
+    }
+    pthread_mutex_unlock(&retired_mutex);
+
+    fclose(f);
+    return 0;
+}
+
+static void write_metrics_json(FILE *f, int slot) {
+    hist_merged_t merged;
+    int first = 1;
+    for (int m = 0; m < HIST_METRICS; m++) {
+        merge_metric(&merged, m, slot);
+        if (merged.count == 0) continue;
+        fprintf(f, "%s\"%s\":{\"count\":%llu,\"mean_us\":%.1f,\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,"
+                   "\"p999_us\":%.1f,\"max_us\":%.1f}",
+                first ? "" : ",", metric_names[m], (unsigned long long)merged.count,
+                merged.total_ns / 1e3 / merged.count, hist_percentile(&merged, 0.50) / 1e3,
+                hist_percentile(&merged, 0.90) / 1e3, hist_percentile(&merged, 0.99) / 1e3,
+                hist_percentile(&merged, 0.999) / 1e3, merged.max_ns / 1e3);
+        first = 0;
+    }
+}
+
+void hist_write_json(FILE *f) {
+    if (!threads) {
+        fprintf(f, "{}");
+        return;
+    }
+
+    pthread_mutex_lock(&retired_mutex);
+    fprintf(f, "{\"all\":{");
+    write_metrics_json(f, -1);
+    fprintf(f, "},\"slots\":[");
+
+    hist_merged_t scratch;
+    int first = 1;
+    for (int slot = 0; slot < n_hist_slots; slot++) {
+        if (!slot_used(slot, &scratch)) continue;
+        fprintf(f, "%s{\"slot\":%d,\"client_id\":%d,", first ? "" : ",", slot, atomic_load(&slot_clients[slot]));
+        write_metrics_json(f, slot);
+        fprintf(f, "}");
+        first = 0;
+    }
+    fprintf(f, "]}");
+    pthread_mutex_unlock(&retired_mutex);
+}
@@ -0,0 +1,170 @@
+#include "leaderboard.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static int n_slots;
+static int top_size; // K
+static int *slot_points; // -1 for slots without a session
+static int *slot_client;
+static char *in_top;
+static int *top; // slots of the best scores, best first
+static int top_count;
+
+// Snapshot read by leaderboard_read, odd seq while the writer is updating it
+static atomic_uint seq;
+static atomic_int snap_count;
+static atomic_int *snap_client;
+static atomic_int *snap_points;
+
+int leaderboard_init(int slots, int k) {
+    n_slots = slots;
+    top_size = k;
+    top_count = 0;
+    slot_points = malloc(slots * sizeof(int));
+    slot_client = calloc(slots, sizeof(int));
+    in_top = calloc(slots, 1);
+    top = malloc(k * sizeof(int));
+    snap_client = calloc(k, sizeof(atomic_int));
+    snap_points = calloc(k, sizeof(atomic_int));
+    if (!slot_points || !slot_client || !in_top || !top || !snap_client || !snap_points) {
+        leaderboard_destroy();
+        return -1;
+    }
+
+    for (int i = 0; i < slots; i++) {
+        slot_points[i] = -1;
+    }
+    atomic_init(&seq, 0);
+    atomic_init(&snap_count, 0);
+    return 0;
+}
+
+void leaderboard_destroy(void) {
+    free(slot_points);
+    free(slot_client);
+    free(in_top);
+    free(top);
+    free(snap_client);
+    free(snap_points);
+    slot_points = slot_client = top = NULL;
+    in_top = NULL;
+    snap_client = snap_points = NULL;
+}
+
+// Helper private function to copy the top to the snapshot, writer_lock must be held
+static void publish(void) {
+    unsigned s = atomic_load_explicit(&seq, memory_order_relaxed);
+    atomic_store_explicit(&seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // Readers see the odd seq before any entry changes
+
+    for (int i = 0; i < top_count; i++) {
+        atomic_store_explicit(&snap_client[i], slot_client[top[i]], memory_order_relaxed);
+        atomic_store_explicit(&snap_points[i], slot_points[top[i]], memory_order_relaxed);
+    }
+    atomic_store_explicit(&snap_count, top_count, memory_order_relaxed);
+
+    atomic_store_explicit(&seq, s + 2, memory_order_release);
+}
+
+// Helper private function, index of slot in the top or -1
+static int top_position(int slot) {
+    if (!in_top[slot]) return -1;
+    for (int i = 0; i < top_count; i++) {
+        if (top[i] == slot) return i;
+    }
+    return -1;
+}
+
+void leaderboard_update(int slot, int client_id, int points) {
+    if (!slot_points || slot < 0 || slot >= n_slots) return;
+
+    pthread_mutex_lock(&writer_lock);
+    slot_points[slot] = points;
+    slot_client[slot] = client_id;
+
+    int pos = top_position(slot);
+    if (pos == -1) {
+        if (top_count < top_size) {
+            pos = top_count++;
+        }
+        else if (points > slot_points[top[top_size - 1]]) {
+            pos = top_size - 1;
+            in_top[top[pos]] = 0; // Evict the lowest, every slot outside the top stays below the top
+        }
+        else {
+            pthread_mutex_unlock(&writer_lock);
+            return;
+        }
+        top[pos] = slot;
+        in_top[slot] = 1;
+    }
+
+    // Scores only grow, so the slot can only move up
+    while (pos > 0 && slot_points[top[pos - 1]] < points) {
+        top[pos] = top[pos - 1];
+        top[pos - 1] = slot;
+        pos--;
+    }
+
+    publish();
+    pthread_mutex_unlock(&writer_lock);
+}
+
+void leaderboard_remove(int slot) {
+    if (!slot_points || slot < 0 || slot >= n_slots) return;
+
+    pthread_mutex_lock(&writer_lock);
+    slot_points[slot] = -1;
+
+    int pos = top_position(slot);
+    if (pos == -1) {
+        pthread_mutex_unlock(&writer_lock);
+        return;
+    }
+    for (int i = pos; i < top_count - 1; i++) {
+        top[i] = top[i + 1];
+    }
+    top_count--;
+    in_top[slot] = 0;
+
+    // Refill from the best slot outside the top, the only full scan and only when a top client leaves
+    int best = -1;
+    for (int i = 0; i < n_slots; i++) {
+        if (in_top[i] || slot_points[i] < 0) continue;
+        if (best == -1 || slot_points[i] > slot_points[best]) best = i;
+    }
+    if (best != -1) {
+        top[top_count++] = best;
+        in_top[best] = 1;
+    }
+
+    publish();
+    pthread_mutex_unlock(&writer_lock);
+}
+
+int leaderboard_read(leaderboard_entry_t *entries, int max) {
+    if (!snap_client) return 0;
+
+    while (1) {
+        unsigned before = atomic_load_explicit(&seq, memory_order_acquire);
+        if (before & 1) {
+            sched_yield(); // A writer is in the middle of publish
+            continue;
+        }
+
+        int count = atomic_load_explicit(&snap_count, memory_order_relaxed);
+        if (count > max) count = max;
+        for (int i = 0; i < count; i++) {
+            entries[i].client_id = atomic_load_explicit(&snap_client[i], memory_order_relaxed);
+            entries[i].points = atomic_load_explicit(&snap_points[i], memory_order_relaxed);
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&seq, memory_order_relaxed) == before) {
+            return count;
+        }
+    }
+}
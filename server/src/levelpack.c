@@ -0,0 +1,266 @@
+#include "levelpack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+static inline uint64_t align8(uint64_t value) {
+    return (value + 7) & ~(uint64_t)7;
+}
+
+// Helper private function to write a formatted validation error
+static int fail(char *err, size_t err_size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(err, err_size, format, args);
+    va_end(args);
+    return -1;
+}
+
+// Helper private function for checking a spawn position
+static int check_spawn(const level_template_t *level, const entity_spec_t *entity, const char *who, int index,
+                       char *err, size_t err_size) {
+    if (!entity->placed) {
+        return fail(err, err_size, "%s %d has no POS", who, index);
+    }
+    if (entity->pos_x < 0 || entity->pos_x >= level->width || entity->pos_y < 0 || entity->pos_y >= level->height) {
+        return fail(err, err_size, "%s %d spawns outside the board at %d x %d", who, index, entity->pos_x, entity->pos_y);
+    }
+    if (level->grid[entity->pos_y * level->width + entity->pos_x] & CELL_WALL) {
+        return fail(err, err_size, "%s %d spawns on a wall at %d x %d", who, index, entity->pos_x, entity->pos_y);
+    }
+    return 0;
+}
+
+int levelpack_validate(const level_template_t *level, char *err, size_t err_size) {
+    if (level->width <= 0 || level->height <= 0) {
+        return fail(err, err_size, "invalid dimensions %d x %d", level->width, level->height);
+    }
+    if (level->tempo <= 0) {
+        return fail(err, err_size, "TEMPO must be positive");
+    }
+    if (strlen(level->name) >= LEVELPACK_NAME_LENGTH) {
+        return fail(err, err_size, "level name longer than %d characters", LEVELPACK_NAME_LENGTH - 1);
+    }
+    if (check_spawn(level, &level->pacman, "pacman", 0, err, err_size) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < level->n_ghosts; i++) {
+        if (check_spawn(level, &level->ghosts[i], "ghost", i, err, err_size) < 0) {
+            return -1;
+        }
+        if (script_validate(level->ghosts[i].script, level->ghosts[i].script_len) != 0) {
+            return fail(err, err_size, "ghost %d has no valid script", i);
+        }
+    }
+
+    // Breadth first search from the pacman spawn until a portal shows up
+    int n_cells = level->width * level->height;
+    int *queue = malloc(n_cells * sizeof(int));
+    uint8_t *seen = calloc(n_cells, 1);
+    if (!queue || !seen) {
+        free(queue);
+        free(seen);
+        return fail(err, err_size, "out of memory");
+    }
+
+    int head = 0, tail = 0, found = 0;
+    int start = level->pacman.pos_y * level->width + level->pacman.pos_x;
+    queue[tail++] = start;
+    seen[start] = 1;
+    while (head < tail && !found) {
+        int idx = queue[head++];
+        if (level->grid[idx] & CELL_PORTAL) {
+            found = 1;
+            break;
+        }
+        int x = idx % level->width, y = idx / level->width;
+        const int dx[] = {0, 0, -1, 1}, dy[] = {-1, 1, 0, 0};
+        for (int d = 0; d < 4; d++) {
+            int nx = x + dx[d], ny = y + dy[d];
+            if (nx < 0 || nx >= level->width || ny < 0 || ny >= level->height) continue;
+            int next = ny * level->width + nx;
+            if (seen[next] || (level->grid[next] & CELL_WALL)) continue;
+            seen[next] = 1;
+            queue[tail++] = next;
+        }
+    }
+    free(queue);
+    free(seen);
+
+    if (!found) {
+        return fail(err, err_size, "no portal reachable from the pacman spawn");
+    }
+    return 0;
+}
+
+int levelpack_write(const char *path, const level_template_t *levels, int n_levels) {
+    // First pass lays out the file
+    uint64_t size = align8(sizeof(levelpack_header_t) + n_levels * sizeof(levelpack_level_t));
+    for (int l = 0; l < n_levels; l++) {
+        size += align8((uint64_t)levels[l].width * levels[l].height);
+        size += align8(levels[l].n_ghosts * sizeof(levelpack_entity_t));
+        for (int g = 0; g < levels[l].n_ghosts; g++) {
+            size += align8(levels[l].ghosts[g].script_len);
+        }
+    }
+
+    char *data = calloc(1, size);
+    if (!data) return -1;
+
+    levelpack_header_t *header = (levelpack_header_t *)data;
+    memcpy(header->magic, LEVELPACK_MAGIC, sizeof(header->magic));
+    header->version = LEVELPACK_VERSION;
+    header->n_levels = n_levels;
+    header->size = size;
+
+    levelpack_level_t *table = (levelpack_level_t *)(data + sizeof(levelpack_header_t));
+    uint64_t offset = align8(sizeof(levelpack_header_t) + n_levels * sizeof(levelpack_level_t));
+
+    for (int l = 0; l < n_levels; l++) {
+        const level_template_t *level = &levels[l];
+        levelpack_level_t *packed = &table[l];
+
+        memcpy(packed->name, level->name, strnlen(level->name, sizeof(packed->name) - 1)); // zero padded by calloc
+        packed->width = level->width;
+        packed->height = level->height;
+        packed->tempo = level->tempo;
+        packed->n_ghosts = level->n_ghosts;
+        packed->pacman.pos_x = level->pacman.pos_x;
+        packed->pacman.pos_y = level->pacman.pos_y;
+        packed->pacman.placed = level->pacman.placed;
+        packed->pacman.passo = level->pacman.passo;
+
+        packed->grid_offset = offset;
+        memcpy(data + offset, level->grid, (size_t)level->width * level->height);
+        offset += align8((uint64_t)level->width * level->height);
+
+        packed->ghosts_offset = offset;
+        levelpack_entity_t *ghosts = (levelpack_entity_t *)(data + offset);
+        offset += align8(level->n_ghosts * sizeof(levelpack_entity_t));
+
+        for (int g = 0; g < level->n_ghosts; g++) {
+            const entity_spec_t *spec = &level->ghosts[g];
+            ghosts[g].pos_x = spec->pos_x;
+            ghosts[g].pos_y = spec->pos_y;
+            ghosts[g].placed = spec->placed;
+            ghosts[g].passo = spec->passo;
+            ghosts[g].script_len = spec->script_len;
+            ghosts[g].script_offset = offset;
+            memcpy(data + offset, spec->script, spec->script_len);
+            offset += align8(spec->script_len);
+        }
+    }
+
+    // Write next to the target and rename, a running server only ever sees complete packs
+    char tmp_path[MAX_FILENAME + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        free(data);
+        return -1;
+    }
+
+    uint64_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, data + written, size - written);
+        if (n <= 0) break;
+        written += n;
+    }
+    free(data);
+
+    if (written != size || fsync(fd) == -1) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+    return rename(tmp_path, path);
+}
+
+// Helper private function for checking that [offset, offset + length) lies inside the pack
+static inline int in_pack(const span_t *pack, uint64_t offset, uint64_t length) {
+    return offset <= pack->len && length <= pack->len - offset && (offset & 7) == 0;
+}
+
+int levelpack_open(const char *path, span_t *pack, const levelpack_level_t **levels, int *n_levels) {
+    if (map_file(path, pack) == -1) {
+        return -1;
+    }
+
+    const levelpack_header_t *header = (const levelpack_header_t *)pack->ptr;
+    if (pack->len < sizeof(levelpack_header_t) ||
+        memcmp(header->magic, LEVELPACK_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != LEVELPACK_VERSION ||
+        header->size != pack->len ||
+        !in_pack(pack, sizeof(levelpack_header_t), (uint64_t)header->n_levels * sizeof(levelpack_level_t))) {
+        log_error("Invalid level pack %s\n", path);
+        unmap_file(pack);
+        return -1;
+    }
+
+    const levelpack_level_t *table = (const levelpack_level_t *)(pack->ptr + sizeof(levelpack_header_t));
+    for (uint32_t l = 0; l < header->n_levels; l++) {
+        const levelpack_level_t *level = &table[l];
+        int valid = level->width > 0 && level->height > 0 && level->n_ghosts >= 0 && level->n_ghosts <= MAX_GHOSTS &&
+                    memchr(level->name, '\0', sizeof(level->name)) != NULL &&
+                    in_pack(pack, level->grid_offset, (uint64_t)level->width * level->height) &&
+                    in_pack(pack, level->ghosts_offset, (uint64_t)level->n_ghosts * sizeof(levelpack_entity_t));
+
+        // Spawns are written to the board as is, they have to be inside it
+        valid = valid && (!level->pacman.placed ||
+                          (level->pacman.pos_x >= 0 && level->pacman.pos_x < level->width &&
+                           level->pacman.pos_y >= 0 && level->pacman.pos_y < level->height));
+
+        const levelpack_entity_t *ghosts = (const levelpack_entity_t *)(pack->ptr + level->ghosts_offset);
+        for (int g = 0; valid && g < level->n_ghosts; g++) {
+            // Bytecode is run as is, so it is checked like any other offset
+            valid = in_pack(pack, ghosts[g].script_offset, ghosts[g].script_len) &&
+                    script_validate((const uint8_t *)(pack->ptr + ghosts[g].script_offset), ghosts[g].script_len) == 0 &&
+                    (!ghosts[g].placed ||
+                     (ghosts[g].pos_x >= 0 && ghosts[g].pos_x < level->width &&
+                      ghosts[g].pos_y >= 0 && ghosts[g].pos_y < level->height));
+        }
+
+        if (!valid) {
+            log_error("Corrupted level %u in pack %s\n", l, path);
+            unmap_file(pack);
+            return -1;
+        }
+    }
+
+    *levels = table;
+    *n_levels = header->n_levels;
+    return 0;
+}
+
+int levelpack_template(const span_t *pack, const levelpack_level_t *packed, level_template_t *level, arena_t *arena) {
+    memset(level, 0, sizeof(level_template_t));
+    snprintf(level->name, sizeof(level->name), "%s", packed->name);
+    level->width = packed->width;
+    level->height = packed->height;
+    level->tempo = packed->tempo;
+    level->grid = (const uint8_t *)(pack->ptr + packed->grid_offset);
+
+    level->pacman.pos_x = packed->pacman.pos_x;
+    level->pacman.pos_y = packed->pacman.pos_y;
+    level->pacman.placed = packed->pacman.placed;
+    level->pacman.passo = packed->pacman.passo;
+
+    level->n_ghosts = packed->n_ghosts;
+    level->ghosts = arena_alloc(arena, level->n_ghosts * sizeof(entity_spec_t));
+    if (!level->ghosts) return -1;
+
+    const levelpack_entity_t *ghosts = (const levelpack_entity_t *)(pack->ptr + packed->ghosts_offset);
+    for (int g = 0; g < level->n_ghosts; g++) {
+        level->ghosts[g].pos_x = ghosts[g].pos_x;
+        level->ghosts[g].pos_y = ghosts[g].pos_y;
+        level->ghosts[g].placed = ghosts[g].placed;
+        level->ghosts[g].passo = ghosts[g].passo;
+        level->ghosts[g].script_len = ghosts[g].script_len;
+        level->ghosts[g].script = (const uint8_t *)(pack->ptr + ghosts[g].script_offset);
+    }
+    return 0;
+}
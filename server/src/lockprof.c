@@ -0,0 +1,156 @@
+#include "lockprof.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LOCK_PROFILE
+
+#define LOCKPROF_MAX_HELD 8 // locks one thread holds at the same time, more are not timed
+
+typedef struct {
+    const void *lock;
+    lock_site_t *site;
+    long long acquired_ns;
+} held_lock_t;
+
+static _Thread_local held_lock_t held[LOCKPROF_MAX_HELD];
+static _Thread_local int n_held;
+
+static pthread_mutex_t sites_lock = PTHREAD_MUTEX_INITIALIZER; // only taken to add a site
+static lock_site_t *sites;
+
+long long lockprof_now(void) {
+    return monotonic_ns();
+}
+
+static void store_max(atomic_ullong *max, unsigned long long value) {
+    unsigned long long current = atomic_load_explicit(max, memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(max, &current, value, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// Helper private function to add a site to the report the first time it is used
+static void register_site(lock_site_t *site) {
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&site->registered, &expected, 1)) return;
+
+    pthread_mutex_lock(&sites_lock);
+    site->next = sites;
+    sites = site;
+    pthread_mutex_unlock(&sites_lock);
+}
+
+void lockprof_acquired(lock_site_t *site, const void *lock, long long start_ns, int contended) {
+    long long now = monotonic_ns();
+    unsigned long long wait = now - start_ns;
+
+    if (!atomic_load_explicit(&site->registered, memory_order_relaxed)) register_site(site);
+    atomic_fetch_add_explicit(&site->acquisitions, 1, memory_order_relaxed);
+    if (contended) atomic_fetch_add_explicit(&site->contended, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&site->wait_ns, wait, memory_order_relaxed);
+    store_max(&site->wait_max_ns, wait);
+
+    if (n_held < LOCKPROF_MAX_HELD) {
+        held[n_held++] = (held_lock_t){lock, site, now};
+    }
+}
+
+void lockprof_released(const void *lock) {
+    for (int i = n_held - 1; i >= 0; i--) {
+        if (held[i].lock != lock) continue;
+
+        lock_site_t *site = held[i].site;
+        unsigned long long hold = monotonic_ns() - held[i].acquired_ns;
+        atomic_fetch_add_explicit(&site->hold_ns, hold, memory_order_relaxed);
+        store_max(&site->hold_max_ns, hold);
+
+        memmove(&held[i], &held[i + 1], (n_held - i - 1) * sizeof(held_lock_t)); // Not always released in order
+        n_held--;
+        return;
+    }
+}
+
+int lockprof_enabled(void) {
+    return 1;
+}
+
+static int by_wait(const void *a, const void *b) {
+    unsigned long long x = atomic_load(&(*(lock_site_t *const *)a)->wait_ns);
+    unsigned long long y = atomic_load(&(*(lock_site_t *const *)b)->wait_ns);
+    return (x < y) - (x > y);
+}
+
+// Helper private function, the used sites by total wait, NULL if none. count gets their number
+static lock_site_t **sorted_sites(int *count) {
+    pthread_mutex_lock(&sites_lock);
+    int n = 0;
+    for (lock_site_t *site = sites; site; site = site->next) n++;
+
+    lock_site_t **sorted = n ? malloc(n * sizeof(lock_site_t *)) : NULL;
+    n = 0;
+    for (lock_site_t *site = sites; site && sorted; site = site->next) sorted[n++] = site;
+    pthread_mutex_unlock(&sites_lock);
+
+    if (sorted) qsort(sorted, n, sizeof(lock_site_t *), by_wait);
+    *count = n;
+    return sorted;
+}
+
+int lockprof_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    fprintf(f, "Lock contention by site (microseconds, by total wait)\n\n");
+    fprintf(f, "%-40s %12s %10s %12s %10s %12s %10s\n", "site", "acquired", "contended", "wait total", "wait max",
+            "hold total", "hold max");
+
+    int count;
+    lock_site_t **sorted = sorted_sites(&count);
+    for (int i = 0; i < count; i++) {
+        lock_site_t *site = sorted[i];
+        char label[64];
+        snprintf(label, sizeof(label), "%s %s:%d", site->name, site->function, site->line);
+        fprintf(f, "%-40s %12lu %10lu %12.1f %10.1f %12.1f %10.1f\n", label, atomic_load(&site->acquisitions),
+                atomic_load(&site->contended), atomic_load(&site->wait_ns) / 1e3, atomic_load(&site->wait_max_ns) / 1e3,
+                atomic_load(&site->hold_ns) / 1e3, atomic_load(&site->hold_max_ns) / 1e3);
+    }
+    free(sorted);
+
+    fclose(f);
+    return 0;
+}
+
+void lockprof_write_json(FILE *f) {
+    int count;
+    lock_site_t **sorted = sorted_sites(&count);
+
+    fprintf(f, "{\"sites\":[");
+    for (int i = 0; i < count; i++) {
+        lock_site_t *site = sorted[i];
+        fprintf(f, "%s{\"lock\":\"%s\",\"function\":\"%s\",\"line\":%d,\"acquired\":%lu,\"contended\":%lu,"
+                   "\"wait_us\":%.1f,\"wait_max_us\":%.1f,\"hold_us\":%.1f,\"hold_max_us\":%.1f}",
+                i ? "," : "", site->name, site->function, site->line, atomic_load(&site->acquisitions),
+                atomic_load(&site->contended), atomic_load(&site->wait_ns) / 1e3, atomic_load(&site->wait_max_ns) / 1e3,
+                atomic_load(&site->hold_ns) / 1e3, atomic_load(&site->hold_max_ns) / 1e3);
+    }
+    fprintf(f, "]}");
+    free(sorted);
+}
+
+#else
+
+int lockprof_enabled(void) {
+    return 0;
+}
+
+int lockprof_dump(const char *path) {
+    (void)path;
+    return -1;
+}
+
+void lockprof_write_json(FILE *f) {
+    fprintf(f, "{\"ok\":false,\"error\":\"server built without LOCK_PROFILE\"}");
+}
+
+#endif
@@ -7,75 +7,104 @@
 #include "utils.h"
 #include <fcntl.h>
 #include <dirent.h>
-#include <string.h>
 
-int read_level(board_t* board, char* filename, char* dirname) {
+// Helper private function to pop the next line that is not empty nor a comment, 0 at the end of text
+static int next_content_line(span_t *text, span_t *line) {
+    int ok;
+    while (1) {
+        *line = span_next_line(text, &ok);
+        if (!ok) return 0;
+        if (line->len == 0 || line->ptr[0] == '#') continue;
+        return 1;
+    }
+}
+
+// Helper private function to parse the PASSO / POS header of a pacman or ghost file
+// Returns 1 with the first line that is not part of the header in *line, 0 if the file ended
+static int read_entity_header(span_t *text, entity_spec_t *entity, span_t *line, const char *who) {
+    while (next_content_line(text, line)) {
+        span_t rest = *line;
+        span_t word = span_next_token(&rest);
+        if (!word.len) continue;  // skip blank line
+
+        if (span_equals(word, "PASSO")) {
+            span_t arg = span_next_token(&rest);
+            if (arg.len) {
+                entity->passo = span_atoi(arg);
+                debug("%s passo: %d\n", who, entity->passo);
+            }
+        }
+        else if (span_equals(word, "POS")) {
+            span_t arg1 = span_next_token(&rest);
+            span_t arg2 = span_next_token(&rest);
+            if (arg1.len && arg2.len) {
+                entity->pos_x = span_atoi(arg1);
+                entity->pos_y = span_atoi(arg2);
+                entity->placed = 1;
+                debug("%s Pos = %d x %d\n", who, entity->pos_x, entity->pos_y);
+            }
+        }
+        else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int read_level(level_template_t* level, arena_t* arena, char* filename, char* dirname) {
 
     char fullname[MAX_FILENAME];
-    strcpy(fullname, dirname);
-    strcat(fullname, "/"); 
-    strcat(fullname, filename); 
+    snprintf(fullname, sizeof(fullname), "%s/%s", dirname, filename);
 
-    int fd = open(fullname, O_RDONLY);
-    if (fd == -1) {
-        debug("Error opening file %s\n", fullname);
+    span_t file;
+    if (map_file(fullname, &file) == -1) {
+        log_error("Error opening file %s\n", fullname);
         return -1;
     }
-    
-    char command[MAX_COMMAND_LENGTH];
 
     // Pacman is optional
-    board->pacman_file[0] = '\0';
-    board->n_pacmans = 1;
-
-    strcpy(board->level_name, filename);
-    *strrchr(board->level_name, '.') = '\0'; // remove .lvl
-
-    int read;
-    while ((read = read_line(fd, command)) > 0) {
-
-        // comment
-        if (command[0] == '#' || command[0] == '\0') continue;
-
-        char *word = strtok(command, " \t\n");
-        if (!word) continue;  // skip empty line
-
-        if (strcmp(word, "DIM") == 0) {
-            char *arg1 = strtok(NULL, " \t\n");
-            char *arg2 = strtok(NULL, " \t\n");
-            if (arg1 && arg2) {
-                board->width = atoi(arg1);
-                board->height = atoi(arg2);
-                debug("DIM = %d x %d\n", board->width, board->height);
+    span_t pacman_name = {0};
+    span_t ghost_names = {0};
+
+    snprintf(level->name, sizeof(level->name), "%s", filename);
+    *strrchr(level->name, '.') = '\0'; // remove .lvl
+
+    span_t text = file;
+    span_t line;
+    int has_line;
+    while ((has_line = next_content_line(&text, &line))) {
+        span_t rest = line;
+        span_t word = span_next_token(&rest);
+        if (!word.len) continue;  // skip blank line
+
+        if (span_equals(word, "DIM")) {
+            span_t arg1 = span_next_token(&rest);
+            span_t arg2 = span_next_token(&rest);
+            if (arg1.len && arg2.len) {
+                level->width = span_atoi(arg1);
+                level->height = span_atoi(arg2);
+                debug("DIM = %d x %d\n", level->width, level->height);
             }
         }
 
-        else if (strcmp(word, "TEMPO") == 0) {
-            char *arg = strtok(NULL, " \t\n");
-            if (arg) {
-                board->tempo = atoi(arg);
-                debug("TEMPO = %d\n", board->tempo);
+        else if (span_equals(word, "TEMPO")) {
+            span_t arg = span_next_token(&rest);
+            if (arg.len) {
+                level->tempo = span_atoi(arg);
+                debug("TEMPO = %d\n", level->tempo);
             }
         }
 
-        else if (strcmp(word, "PAC") == 0) {
-            char *arg = strtok(NULL, " \t\n");
-            if (arg) {
-                snprintf(board->pacman_file, sizeof(board->pacman_file), "%s/%s", dirname, arg);
-                debug("PAC = %s\n", board->pacman_file);
-            }
+        else if (span_equals(word, "PAC")) {
+            pacman_name = span_next_token(&rest);
+            debug("PAC = %.*s\n", (int)pacman_name.len, pacman_name.ptr);
         }
 
-        else if (strcmp(word, "MON") == 0) {
-            char *arg;
-            int i = 0;
-            while ((arg = strtok(NULL, " \t\n")) != NULL) {
-                snprintf(board->ghosts_files[i], sizeof(board->ghosts_files[0]), "%s/%s", dirname, arg);
-                debug("MON file: %s\n", board->ghosts_files[i]);
-                i+= 1;
-                if (i == MAX_GHOSTS-1) break;
-            }
-            board->n_ghosts = i;
+        else if (span_equals(word, "MON")) {
+            ghost_names = rest; // parsed once the grid is allocated
+            level->n_ghosts = 0;
+            span_t names = rest;
+            while (span_next_token(&names).len) level->n_ghosts++;
         }
 
         else {
@@ -83,76 +112,95 @@ int read_level(board_t* board, char* filename, char* dirname) {
         }
     }
 
-    if (!board->width || !board->height) {
-        debug("Missing dimensions in level file\n");
-        close(fd);
+    if (level->width <= 0 || level->height <= 0) {
+        log_error("Missing dimensions in level file\n");
+        unmap_file(&file);
+        return -1;
+    }
+    if (level->n_ghosts > MAX_GHOSTS) {
+        log_error("More than %d ghosts in level file\n", MAX_GHOSTS);
+        unmap_file(&file);
         return -1;
     }
     
     // the end of the file contains the grid
-    board->board = calloc(board->width * board->height, sizeof(board_pos_t));
-    board->pacmans = calloc(board->n_pacmans, sizeof(pacman_t));
-    board->ghosts = calloc(board->n_ghosts, sizeof(ghost_t));
+    uint8_t *grid = arena_alloc(arena, (size_t)level->width * level->height);
+    level->ghosts = arena_alloc(arena, level->n_ghosts * sizeof(entity_spec_t));
+    level->grid = grid;
+    if (!grid || !level->ghosts) {
+        log_error("Failed allocating level memory\n");
+        unmap_file(&file);
+        return -1;
+    }
 
     int row = 0;
-    // command here still holds the previous line
-    while (read > 0) {
-        if (command[0]== '#' || command[0] == '\0') continue;
-        if (row >= board->height) break;
-
-        debug("Line: %s\n", command);
-
-        for (int col = 0; col < board -> width; col++){
-            int idx = row * board->width + col;
-            char content = command[col];
+    // line here still holds the first row of the grid
+    while (has_line && row < level->height) {
+        for (int col = 0; col < level->width; col++){
+            int idx = row * level->width + col;
+            char content = (size_t)col < line.len ? line.ptr[col] : '\0';
 
             switch (content) {
                 case 'X': // wall
-                    board->board[idx].content = 'W';
+                    grid[idx] = CELL_WALL;
                     break;
                 case '@': // portal
-                    board->board[idx].content = ' ';
-                    board->board[idx].has_portal = 1;
+                    grid[idx] = CELL_PORTAL;
                     break;
                 default:
-                    board->board[idx].content = ' ';
-                    board->board[idx].has_dot = 1;
+                    grid[idx] = CELL_DOT;
                     break;
             }
         }
 
         row++;
-        read = read_line(fd, command);
+        has_line = next_content_line(&text, &line);
     }
 
-    if (read == -1) {
-      debug("Failed parsing line");
-      close(fd);
-      return read;
+    // Missing rows are plain dots, as short rows are
+    for (int idx = row * level->width; idx < level->width * level->height; idx++) {
+        grid[idx] = CELL_DOT;
     }
 
-    close(fd);
+    char path[MAX_FILENAME];
+    path[0] = '\0';
+    if (pacman_name.len) {
+        snprintf(path, sizeof(path), "%s/%.*s", dirname, (int)pacman_name.len, pacman_name.ptr);
+    }
+    if (read_pacman(level, path) < 0) {
+        log_error("Failed to load the pacman\n");
+    }
+
+    for (int i = 0; i < level->n_ghosts; i++) {
+        span_t name = span_next_token(&ghost_names);
+        snprintf(path, sizeof(path), "%s/%.*s", dirname, (int)name.len, name.ptr);
+        debug("MON file: %s\n", path);
+        if (read_ghost(&level->ghosts[i], arena, path) < 0) {
+            log_error("Failed to read ghosts\n");
+            unmap_file(&file);
+            return -1; // A ghost without a script cannot be played
+        }
+    }
+
+    unmap_file(&file); // spans above point into the mapping
     return 0;
 }
 
-int read_pacman(board_t* board, int points) {
-    pacman_t* pacman = &board->pacmans[0];
+int read_pacman(level_template_t* level, char* pacman_file) {
+    entity_spec_t* pacman = &level->pacman;
 
-    pacman->alive = 1;
-    pacman->points = points;
-    pacman->waiting = 0;
     pacman->passo = 0;
 
     // no file was provided -> defaults
-    if (board->pacman_file[0] == '\0') {
+    if (pacman_file[0] == '\0') {
         // default position -> find first non occupied cell
-        for (int y = 0; y < board->height; y++) {
-            for (int x = 0; x < board->width; x++) {
-                int idx = y * board->width + x;
-                if (board->board[idx].content == ' ') {
+        for (int y = 0; y < level->height; y++) {
+            for (int x = 0; x < level->width; x++) {
+                int idx = y * level->width + x;
+                if (!(level->grid[idx] & CELL_WALL)) {
                     pacman->pos_x = x;
                     pacman->pos_y = y;
-                    board->board[idx].content = 'P';
+                    pacman->placed = 1;
                     return 0;
                 }
             }
@@ -160,120 +208,88 @@ int read_pacman(board_t* board, int points) {
         return -1;
     }
 
-    int fd = open(board->pacman_file, O_RDONLY);
-
-    int read;
-    char command[MAX_COMMAND_LENGTH];
-    while ((read = read_line(fd, command)) > 0) {
-        // comment
-        if (command[0] == '#' || command[0] == '\0') continue;
-
-        char *word = strtok(command, " \t\n");
-        if (!word) continue;  // skip empty line
-
-        if (strcmp(word, "PASSO") == 0) {
-            char *arg = strtok(NULL, " \t\n");
-            if (arg) {
-                pacman->passo = atoi(arg);
-                pacman->waiting = pacman->passo;
-                debug("Pacman passo: %d\n", pacman->passo);
-            }
-        }
-        else if (strcmp(word, "POS") == 0) {
-            char *arg1 = strtok(NULL, " \t\n");
-            char *arg2 = strtok(NULL, " \t\n");
-            if (arg1 && arg2) {
-                pacman->pos_x = atoi(arg1);
-                pacman->pos_y = atoi(arg2);
-                int idx = pacman->pos_y * board->width + pacman->pos_x;
-                board->board[idx].content = 'P';
-                debug("Pacman Pos = %d x %d\n", pacman->pos_x, pacman->pos_y);
-            }
-        }
-        else {
-            break;
-        }
+    span_t file;
+    if (map_file(pacman_file, &file) == -1) {
+        log_error("Error opening file %s\n", pacman_file);
+        return -1;
     }
 
-    close(fd);
+    // The moves of the pacman come from the client, only the header matters
+    span_t text = file;
+    span_t line;
+    read_entity_header(&text, pacman, &line, "Pacman");
+
+    unmap_file(&file);
     return 0;
 }
 
 
-int read_ghosts(board_t* board) {
-    for (int i = 0; i < board->n_ghosts; i++) {
-        int fd = open(board->ghosts_files[i], O_RDONLY);
-        ghost_t* ghost = &board->ghosts[i];
-
-        int read;
-        char command[MAX_COMMAND_LENGTH];
-        while ((read = read_line(fd, command)) > 0) {
-            // comment
-            if (command[0] == '#' || command[0] == '\0') continue;
-
-            char *word = strtok(command, " \t\n");
-            if (!word) continue;  // skip empty line
+int read_ghost(entity_spec_t* ghost, arena_t* arena, char* ghost_file) {
+    span_t file;
+    if (map_file(ghost_file, &file) == -1) {
+        log_error("Error opening file %s\n", ghost_file);
+        return -1;
+    }
 
-            if (strcmp(word, "PASSO") == 0) {
-                char *arg = strtok(NULL, " \t\n");
-                if (arg) {
-                    ghost->passo = atoi(arg);
-                    ghost->waiting = ghost->passo;
-                    debug("Ghost passo: %d\n", ghost->passo);
-                }
-            }
-            else if (strcmp(word, "POS") == 0) {
-                char *arg1 = strtok(NULL, " \t\n");
-                char *arg2 = strtok(NULL, " \t\n");
-                if (arg1 && arg2) {
-                    ghost->pos_x = atoi(arg1);
-                    ghost->pos_y = atoi(arg2);
-                    int idx = ghost->pos_y * board->width + ghost->pos_x;
-                    board->board[idx].content = 'M';
-                    debug("Ghost Pos = %d x %d\n", ghost->pos_x, ghost->pos_y);
-                }
-            }
-            else {
-                break;
-            }
+    span_t text = file;
+    span_t line;
+    int has_line = read_entity_header(&text, ghost, &line, "Ghost");
+
+    // end of the file contains the moves, compiled to bytecode as they are read
+    // line here still holds the first move
+    script_builder_t builder;
+    script_builder_init(&builder);
+    int line_no = 0;
+    int result = 0;
+    while (has_line && result == 0) {
+        span_t rest = line;
+        span_t word = span_next_token(&rest);
+        char command = word.len ? word.ptr[0] : '\0'; // blocks may be indented
+        line_no++;
+
+        if (span_equals(word, "REPEAT")) {
+            int times = span_atoi(span_next_token(&rest));
+            result = script_begin_repeat(&builder, times > 0 ? (uint32_t)times : 0);
         }
-
-        // end of the file contains the moves
-        ghost->current_move = 0;
-
-        // command here still holds the previous line
-        int move = 0;
-        while (read > 0 && move < MAX_MOVES) {
-            if (command[0]== '#' || command[0] == '\0') continue;
-            if (command[0] == 'A' ||
-                command[0] == 'D' ||
-                command[0] == 'W' ||
-                command[0] == 'S' ||
-                command[0] == 'R' ||
-                command[0] == 'C') {
-                    ghost->moves[move].command = command[0]; // Add the move to the array
-                    ghost->moves[move].turns = 1; // single turn
-                    move += 1; // increment move count
-            }
-            else if (command[0] == 'T' && command[1] == ' ') {
-                int t = atoi(command+2);
-                if (t > 0) {
-                    ghost->moves[move].command = command[0];
-                    ghost->moves[move].turns = t; // Set number of turns to wait
-                    ghost->moves[move].turns_left = t; // Initialize turns left
-                    move += 1; // increment move count
-                }
+        else if (span_equals(word, "END")) {
+            result = script_end_repeat(&builder);
+        }
+        else if (span_equals(word, "LOOP")) {
+            result = script_mark_loop(&builder);
+        }
+        else if (command == 'A' ||
+            command == 'D' ||
+            command == 'W' ||
+            command == 'S' ||
+            command == 'R' ||
+            command == 'C' ||
+            command == 'H') {
+                static const script_op_t ops[] = {
+                    ['W'] = SCRIPT_UP, ['A'] = SCRIPT_LEFT, ['S'] = SCRIPT_DOWN, ['D'] = SCRIPT_RIGHT,
+                    ['C'] = SCRIPT_CHARGE, ['R'] = SCRIPT_RANDOM, ['H'] = SCRIPT_CHASE,
+                };
+                result = script_emit(&builder, ops[(int)command], 0);
+        }
+        else if (command == 'T' && word.len == 1) {
+            int t = span_atoi(span_next_token(&rest));
+            if (t > 0) {
+                result = script_emit(&builder, SCRIPT_WAIT, (uint32_t)t); // Set number of turns to wait
             }
-            read = read_line(fd, command);
         }
-        ghost->n_moves = move;
+        has_line = next_content_line(&text, &line);
+    }
+    unmap_file(&file);
 
-        if (read == -1) {
-            debug("Failed reading line\n");
-            close(fd);
-            return -1;
-        }
-        close(fd);
+    // Keep only the bytecode, in the catalog arena
+    if (result == 0) {
+        line_no = 0;
+        result = script_finish(&builder, arena, &ghost->script, &ghost->script_len);
+    }
+    if (result != 0) {
+        if (line_no > 0) log_error("Ghost %s, move %d: %s\n", ghost_file, line_no, builder.error);
+        else log_error("Ghost %s: %s\n", ghost_file, builder.error);
+        script_builder_destroy(&builder);
+        return -1;
     }
 
     return 0;
@@ -332,26 +348,3 @@ void free_level_names(char **level_names, int count) {
     for (int i = 0; i < count; i++) free(level_names[i]); // Free each level name
     free(level_names); // Free the array 
 }
-
-int count_levels(char *levels_dir) {
-    int count;
-    char **level_names = sort_levels(levels_dir, &count);
-    free_level_names(level_names, count);
-    return count;
-}
-
-int load_sorted_level(board_t *board, char *levels_dir, int level_index, int accumulated_points) {
-    int count;
-    char **level_names = sort_levels(levels_dir, &count); // Get sorted level names
-
-    // Check for valid id 
-    if (!level_names || level_index < 0 || level_index >= count) {
-        free_level_names(level_names, count);
-        return -1;
-    }
-
-    // Load the specified level
-    int result = load_level(board, level_names[level_index], levels_dir, accumulated_points);
-    free_level_names(level_names, count);
-    return result;
-}
@@ -0,0 +1,408 @@
+#include "scores.h"
+#include "board.h"
+#include "utils.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+typedef struct {
+    uint32_t count;
+    uint32_t reserved;
+    score_record_t entries[]; // top_n of them
+} score_table_t;
+
+static char score_dir[MAX_FILENAME - 64]; // leaves room for the file names
+static uint32_t top_size;
+static long long compact_interval_us;
+
+// Results handed over by the sessions, a ring guarded by queue_lock
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER; // only signalled on shutdown, batches wait for the window
+static score_record_t queue[SCORES_QUEUE_SIZE];
+static int queue_head;
+static int queue_count;
+static int stopping;
+static atomic_ulong dropped;
+
+// Owned by the writer thread once it runs
+static int log_fd = -1;
+static uint64_t log_gen; // log being appended to
+static uint64_t folded_gen; // logs below it are in the index
+static uint64_t unfolded; // results appended since the last compaction
+static score_record_t batch[SCORES_QUEUE_SIZE];
+static pthread_t writer_tid;
+static int running;
+
+// Replaced by the writer, read by scores_top
+static pthread_rwlock_t index_lock = PTHREAD_RWLOCK_INITIALIZER;
+static span_t index_map;
+
+static inline size_t table_bytes(uint32_t top_n) {
+    return sizeof(score_table_t) + (size_t)top_n * sizeof(score_record_t);
+}
+
+static inline score_table_t *index_table(const char *image, uint32_t top_n, uint32_t table) {
+    return (score_table_t *)(image + sizeof(scores_index_header_t) + table * table_bytes(top_n));
+}
+
+// Helper private function for the path of log gen
+static void log_path(char *path, uint64_t gen) {
+    snprintf(path, MAX_FILENAME, "%s/scores.%llu.log", score_dir, (unsigned long long)gen);
+}
+
+static void index_path(char *path, const char *suffix) {
+    snprintf(path, MAX_FILENAME, "%s/scores.idx%s", score_dir, suffix);
+}
+
+// Helper private function for checking a mapped index before trusting its tables
+static int index_valid(const span_t *map) {
+    const scores_index_header_t *header = (const scores_index_header_t *)map->ptr;
+    if (map->len < sizeof(scores_index_header_t) ||
+        memcmp(header->magic, SCORES_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SCORES_VERSION ||
+        header->top_n == 0 || header->n_levels > SCORES_MAX_LEVELS ||
+        map->len != sizeof(scores_index_header_t) + (1 + header->n_levels) * table_bytes(header->top_n)) {
+        return 0;
+    }
+    for (uint32_t t = 0; t <= header->n_levels; t++) {
+        if (index_table(map->ptr, header->top_n, t)->count > header->top_n) return 0;
+    }
+    return 1;
+}
+
+// Helper private function to insert a result in a table kept sorted, best first, earlier results win ties
+static void table_insert(score_table_t *table, uint32_t top_n, const score_record_t *record) {
+    uint32_t pos = table->count;
+    if (pos == top_n) {
+        if (record->points <= table->entries[top_n - 1].points) return;
+        pos--;
+    }
+    else {
+        table->count++;
+    }
+    while (pos > 0 && table->entries[pos - 1].points < record->points) {
+        table->entries[pos] = table->entries[pos - 1];
+        pos--;
+    }
+    table->entries[pos] = *record;
+}
+
+// Helper private function to make room for the tables of levels below wanted, a NULL image starts a new one
+static char *grow_image(char *image, uint32_t *n_levels, uint32_t wanted) {
+    size_t old_size = image ? sizeof(scores_index_header_t) + (1 + *n_levels) * table_bytes(top_size) : 0;
+    size_t new_size = sizeof(scores_index_header_t) + (1 + wanted) * table_bytes(top_size);
+    char *grown = realloc(image, new_size);
+    if (!grown) return NULL;
+    memset(grown + old_size, 0, new_size - old_size);
+    *n_levels = wanted;
+    return grown;
+}
+
+// Helper private function to write a file through a temporary one + rename, so readers only see whole indexes
+static int write_index(const char *image, size_t size) {
+    char tmp_path[MAX_FILENAME], path[MAX_FILENAME];
+    index_path(tmp_path, ".tmp");
+    index_path(path, "");
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return -1;
+
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, image + written, size - written);
+        if (n <= 0) break;
+        written += n;
+    }
+    if (written != size || fsync(fd) == -1) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp_path, path) == -1) return -1;
+
+    // The logs are deleted next, the rename has to be on disk first
+    int dir = open(score_dir, O_RDONLY);
+    if (dir != -1) {
+        fsync(dir);
+        close(dir);
+    }
+    return 0;
+}
+
+/*
+Helper private function to fold logs [first_gen, end_gen) into the index.
+The new index records end_gen, so a crash before the logs are deleted never folds them twice
+*/
+static int compact(uint64_t first_gen, uint64_t end_gen) {
+    const scores_index_header_t *old = (const scores_index_header_t *)index_map.ptr;
+    uint32_t n_levels = 0;
+    uint64_t records = old ? old->records : 0;
+
+    char *image = grow_image(NULL, &n_levels, old ? old->n_levels : 0);
+    if (!image) return -1;
+
+    // Previous bests first, top_n may have changed since they were written
+    for (uint32_t t = 0; old && t <= old->n_levels; t++) {
+        const score_table_t *table = index_table(index_map.ptr, old->top_n, t);
+        for (uint32_t i = 0; i < table->count; i++) {
+            table_insert(index_table(image, top_size, t), top_size, &table->entries[i]);
+        }
+    }
+
+    for (uint64_t gen = first_gen; gen < end_gen; gen++) {
+        char path[MAX_FILENAME];
+        span_t log;
+        log_path(path, gen);
+        if (map_file(path, &log) == -1) continue;
+
+        // A torn record at the end (crash in the middle of an append) is left out
+        const score_record_t *results = (const score_record_t *)log.ptr;
+        size_t n = log.len / sizeof(score_record_t);
+        for (size_t i = 0; i < n; i++) {
+            const score_record_t *result = &results[i];
+            uint32_t table;
+            if (result->kind == SCORE_GAME) {
+                table = 0;
+            }
+            else if (result->kind == SCORE_LEVEL && result->level >= 0 && result->level < SCORES_MAX_LEVELS) {
+                table = 1 + result->level;
+                if ((uint32_t)result->level >= n_levels) {
+                    char *grown = grow_image(image, &n_levels, result->level + 1);
+                    if (!grown) {
+                        free(image);
+                        unmap_file(&log);
+                        return -1;
+                    }
+                    image = grown;
+                }
+            }
+            else {
+                continue;
+            }
+            table_insert(index_table(image, top_size, table), top_size, result);
+            records++;
+        }
+        unmap_file(&log);
+    }
+
+    scores_index_header_t *header = (scores_index_header_t *)image;
+    memcpy(header->magic, SCORES_MAGIC, sizeof(header->magic));
+    header->version = SCORES_VERSION;
+    header->top_n = top_size;
+    header->n_levels = n_levels;
+    header->next_gen = end_gen;
+    header->records = records;
+
+    size_t size = sizeof(scores_index_header_t) + (1 + n_levels) * table_bytes(top_size);
+    int failed = write_index(image, size);
+    free(image);
+    if (failed) {
+        log_error("Score compaction failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    char path[MAX_FILENAME];
+    span_t fresh;
+    index_path(path, "");
+    if (map_file(path, &fresh) == -1) return -1;
+
+    pthread_rwlock_wrlock(&index_lock);
+    span_t stale = index_map;
+    index_map = fresh;
+    pthread_rwlock_unlock(&index_lock);
+    unmap_file(&stale);
+
+    for (uint64_t gen = first_gen; gen < end_gen; gen++) {
+        log_path(path, gen);
+        unlink(path);
+    }
+    return 0;
+}
+
+static int open_log(void) {
+    char path[MAX_FILENAME];
+    log_path(path, log_gen);
+    log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    return log_fd == -1 ? -1 : 0;
+}
+
+// Helper private function to append a batch with one write and one fsync
+static void append_batch(const score_record_t *records, int n) {
+    const char *data = (const char *)records;
+    size_t size = n * sizeof(score_record_t);
+    size_t written = 0;
+    while (written < size) {
+        ssize_t w = write(log_fd, data + written, size - written);
+        if (w <= 0 && errno != EINTR) break;
+        if (w > 0) written += w;
+    }
+    if (written != size || fdatasync(log_fd) == -1) {
+        log_error("Score log append failed: %s\n", strerror(errno));
+    }
+    unfolded += n;
+}
+
+// Helper private function to start a new log and fold the finished ones into the index
+static void rotate_and_compact(void) {
+    close(log_fd);
+    log_gen++;
+    if (open_log() == -1) {
+        log_error("Error opening score log %llu: %s\n", (unsigned long long)log_gen, strerror(errno));
+    }
+    if (compact(folded_gen, log_gen) == 0) {
+        folded_gen = log_gen;
+        unfolded = 0;
+    }
+}
+
+static void *writer_thread(void *arg) {
+    (void)arg;
+    long long last_compact = monotonic_us();
+
+    pthread_mutex_lock(&queue_lock);
+    while (1) {
+        // Wait out the batching window, only shutdown cuts it short
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += SCORES_SYNC_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (!stopping && pthread_cond_timedwait(&queue_cond, &queue_lock, &deadline) != ETIMEDOUT) {
+        }
+
+        int stop = stopping;
+        int n = queue_count;
+        for (int i = 0; i < n; i++) {
+            batch[i] = queue[(queue_head + i) % SCORES_QUEUE_SIZE];
+        }
+        queue_head = (queue_head + n) % SCORES_QUEUE_SIZE;
+        queue_count = 0;
+        pthread_mutex_unlock(&queue_lock);
+
+        if (n > 0 && log_fd != -1) {
+            append_batch(batch, n);
+        }
+        if (unfolded > 0 && (stop || monotonic_us() - last_compact >= compact_interval_us)) {
+            rotate_and_compact();
+            last_compact = monotonic_us();
+        }
+        if (stop) break;
+
+        pthread_mutex_lock(&queue_lock);
+    }
+    return NULL;
+}
+
+int scores_init(const char *dir, int top_n, int compact_sec) {
+    snprintf(score_dir, sizeof(score_dir), "%s", dir);
+    top_size = top_n;
+    compact_interval_us = compact_sec * 1000000LL;
+
+    if (mkdir(score_dir, 0755) == -1 && errno != EEXIST) {
+        return -1;
+    }
+
+    char path[MAX_FILENAME];
+    index_path(path, "");
+    if (map_file(path, &index_map) == 0 && !index_valid(&index_map)) {
+        log_warn("Ignoring invalid score index %s\n", path);
+        unmap_file(&index_map);
+    }
+    folded_gen = index_map.ptr ? ((const scores_index_header_t *)index_map.ptr)->next_gen : 0;
+
+    // Logs already folded but not deleted when the last run stopped
+    for (uint64_t gen = folded_gen; gen-- > 0;) {
+        log_path(path, gen);
+        if (unlink(path) == -1) break;
+    }
+
+    // Logs the last run did not fold yet
+    log_gen = folded_gen;
+    for (log_path(path, log_gen); access(path, F_OK) == 0; log_path(path, log_gen)) {
+        log_gen++;
+    }
+    if (log_gen > folded_gen && compact(folded_gen, log_gen) == 0) {
+        folded_gen = log_gen;
+    }
+
+    if (open_log() == -1) {
+        unmap_file(&index_map);
+        return -1;
+    }
+
+    stopping = 0;
+    if (pthread_create(&writer_tid, NULL, writer_thread, NULL) != 0) {
+        close(log_fd);
+        unmap_file(&index_map);
+        return -1;
+    }
+    running = 1;
+    return 0;
+}
+
+void scores_record(score_kind_t kind, int client_id, int level, int points, uint64_t seed) {
+    score_record_t record = {
+        .kind = kind,
+        .client_id = client_id,
+        .level = level,
+        .points = points,
+        .time = time(NULL),
+        .seed = seed,
+    };
+
+    pthread_mutex_lock(&queue_lock);
+    if (queue_count == SCORES_QUEUE_SIZE) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed); // Writer stuck on the disk, never wait for it
+    }
+    else {
+        queue[(queue_head + queue_count) % SCORES_QUEUE_SIZE] = record;
+        queue_count++;
+    }
+    pthread_mutex_unlock(&queue_lock);
+}
+
+int scores_top(int level, score_record_t *out, int max) {
+    int count = 0;
+
+    pthread_rwlock_rdlock(&index_lock);
+    const scores_index_header_t *header = (const scores_index_header_t *)index_map.ptr;
+    if (header && level >= -1 && level < (int)header->n_levels) {
+        const score_table_t *table = index_table(index_map.ptr, header->top_n, level + 1);
+        count = (int)table->count < max ? (int)table->count : max;
+        if (count > 0) {
+            memcpy(out, table->entries, count * sizeof(score_record_t));
+        }
+    }
+    pthread_rwlock_unlock(&index_lock);
+
+    return count > 0 ? count : 0;
+}
+
+void scores_shutdown(void) {
+    if (!running) return;
+
+    pthread_mutex_lock(&queue_lock);
+    stopping = 1;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    pthread_join(writer_tid, NULL);
+    running = 0;
+
+    unsigned long lost = atomic_load(&dropped);
+    if (lost > 0) {
+        log_warn("%lu score results dropped, the score log could not keep up\n", lost);
+    }
+    if (log_fd != -1) {
+        close(log_fd);
+        log_fd = -1;
+    }
+    unmap_file(&index_map);
+}
@@ -0,0 +1,234 @@
+#include "script.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define OPERAND_SIZE sizeof(uint32_t)
+
+// Helper private function, operands are not aligned
+static inline uint32_t operand_at(const uint8_t *code, uint32_t pc) {
+    uint32_t operand;
+    memcpy(&operand, code + pc + 1, OPERAND_SIZE);
+    return operand;
+}
+
+// Helper private function, size of the instruction that starts with op, 0 if op is unknown
+static uint32_t instruction_size(uint8_t op) {
+    if ((op >= SCRIPT_UP && op <= SCRIPT_RANDOM) || op == SCRIPT_CHASE) return 1;
+    if (op >= SCRIPT_WAIT && op <= SCRIPT_JUMP) return 1 + OPERAND_SIZE;
+    return 0;
+}
+
+// Helper private function, whether op takes a turn of the ghost
+static int is_action(uint8_t op) {
+    return (op >= SCRIPT_UP && op <= SCRIPT_WAIT) || op == SCRIPT_CHASE;
+}
+
+
+void script_builder_init(script_builder_t *builder) {
+    memset(builder, 0, sizeof(script_builder_t));
+}
+
+void script_builder_destroy(script_builder_t *builder) {
+    free(builder->code);
+    builder->code = NULL;
+}
+
+// Helper private function to append one instruction
+static int append(script_builder_t *builder, script_op_t op, uint32_t operand) {
+    uint32_t size = instruction_size(op);
+    if (builder->len + size > builder->capacity) {
+        uint32_t capacity = builder->capacity ? builder->capacity * 2 : 64;
+        uint8_t *code = realloc(builder->code, capacity);
+        if (!code) {
+            builder->error = "out of memory";
+            return -1;
+        }
+        builder->code = code;
+        builder->capacity = capacity;
+    }
+
+    builder->code[builder->len] = (uint8_t)op;
+    if (size > 1) memcpy(builder->code + builder->len + 1, &operand, OPERAND_SIZE);
+    builder->len += size;
+    return 0;
+}
+
+int script_emit(script_builder_t *builder, script_op_t op, uint32_t operand) {
+    if (!is_action(op)) {
+        builder->error = "not an action";
+        return -1;
+    }
+    if (op == SCRIPT_WAIT && operand == 0) {
+        builder->error = "T needs at least one turn";
+        return -1;
+    }
+    builder->actions++;
+    return append(builder, op, operand);
+}
+
+int script_begin_repeat(script_builder_t *builder, uint32_t times) {
+    if (times == 0 || times > UINT16_MAX) {
+        builder->error = "REPEAT count must be between 1 and 65535";
+        return -1;
+    }
+    if (builder->depth == SCRIPT_MAX_DEPTH) {
+        builder->error = "REPEAT nested too deep";
+        return -1;
+    }
+    if (append(builder, SCRIPT_REPEAT, times) == -1) return -1;
+    builder->open[builder->depth++] = builder->len;
+    return 0;
+}
+
+int script_end_repeat(script_builder_t *builder) {
+    if (builder->depth == 0) {
+        builder->error = "END without REPEAT";
+        return -1;
+    }
+    return append(builder, SCRIPT_END_REPEAT, builder->open[--builder->depth]);
+}
+
+int script_mark_loop(script_builder_t *builder) {
+    if (builder->depth > 0) {
+        builder->error = "LOOP inside a REPEAT block";
+        return -1;
+    }
+    builder->loop_at = builder->len;
+    builder->actions = 0;
+    return 0;
+}
+
+int script_finish(script_builder_t *builder, arena_t *arena, const uint8_t **code, uint32_t *len) {
+    if (builder->depth > 0) {
+        builder->error = "REPEAT without END";
+        return -1;
+    }
+    if (builder->actions == 0) {
+        builder->error = "no moves to loop over";
+        return -1;
+    }
+    if (append(builder, SCRIPT_JUMP, builder->loop_at) == -1) return -1;
+
+    // Only the final size goes to the arena
+    uint8_t *copy = arena_copy(arena, builder->code, builder->len);
+    if (!copy) {
+        builder->error = "out of memory";
+        return -1;
+    }
+    *code = copy;
+    *len = builder->len;
+    script_builder_destroy(builder);
+    return 0;
+}
+
+
+int script_validate(const uint8_t *code, uint32_t len) {
+    if (!code || len == 0) return -1;
+
+    // Instruction starts outside of any REPEAT block, the only valid jump targets
+    uint8_t *top_level = calloc(len, 1);
+    if (!top_level) return -1;
+
+    uint32_t open[SCRIPT_MAX_DEPTH];
+    uint32_t depth = 0;
+    uint32_t pc = 0;
+    uint32_t jump_target = len;
+    int valid = 1;
+
+    while (valid && pc < len) {
+        uint8_t op = code[pc];
+        uint32_t size = instruction_size(op);
+        if (size == 0 || pc + size > len) {
+            valid = 0;
+            break;
+        }
+        if (depth == 0) top_level[pc] = 1;
+
+        uint32_t operand = size > 1 ? operand_at(code, pc) : 0;
+        switch (op) {
+            case SCRIPT_WAIT:
+                valid = operand > 0;
+                break;
+            case SCRIPT_REPEAT:
+                valid = operand > 0 && operand <= UINT16_MAX && depth < SCRIPT_MAX_DEPTH;
+                if (valid) open[depth++] = pc + size;
+                break;
+            case SCRIPT_END_REPEAT:
+                valid = depth > 0 && open[depth - 1] == operand;
+                if (valid) depth--;
+                break;
+            case SCRIPT_JUMP:
+                // Only as the last instruction, so control always stays inside the script
+                valid = pc + size == len && depth == 0 && operand < pc && top_level[operand];
+                jump_target = operand;
+                break;
+            default:
+                break;
+        }
+        pc += size;
+    }
+    valid = valid && jump_target < len;
+
+    // Some action must run between the jump target and the jump, or script_step would spin
+    int actions = 0;
+    for (pc = jump_target; valid && pc < len; pc += instruction_size(code[pc])) {
+        if (is_action(code[pc])) actions++;
+    }
+
+    free(top_level);
+    return valid && actions > 0 ? 0 : -1;
+}
+
+
+int script_uses(const uint8_t *code, uint32_t len, script_op_t op) {
+    for (uint32_t pc = 0; pc < len; pc += instruction_size(code[pc])) {
+        if (code[pc] == op) return 1;
+    }
+    return 0;
+}
+
+
+void script_start(script_vm_t *vm, const uint8_t *code) {
+    memset(vm, 0, sizeof(script_vm_t));
+    vm->code = code;
+}
+
+char script_step(script_vm_t *vm) {
+    static const char actions[] = {
+        [SCRIPT_UP] = 'W', [SCRIPT_LEFT] = 'A', [SCRIPT_DOWN] = 'S', [SCRIPT_RIGHT] = 'D',
+        [SCRIPT_CHARGE] = 'C', [SCRIPT_RANDOM] = 'R', [SCRIPT_CHASE] = 'H',
+    };
+
+    while (1) {
+        uint8_t op = vm->code[vm->pc];
+        switch (op) {
+            case SCRIPT_WAIT:
+                if (vm->turns_left == 0) {
+                    vm->turns_left = operand_at(vm->code, vm->pc);
+                }
+                vm->turns_left -= 1;
+                if (vm->turns_left == 0) {
+                    vm->pc += 1 + OPERAND_SIZE; // move on
+                }
+                return 'T';
+            case SCRIPT_REPEAT:
+                vm->repeat_left[vm->depth++] = (uint16_t)operand_at(vm->code, vm->pc);
+                vm->pc += 1 + OPERAND_SIZE;
+                break;
+            case SCRIPT_END_REPEAT:
+                if (--vm->repeat_left[vm->depth - 1] > 0) {
+                    vm->pc = operand_at(vm->code, vm->pc); // run the body again
+                } else {
+                    vm->depth--;
+                    vm->pc += 1 + OPERAND_SIZE;
+                }
+                break;
+            case SCRIPT_JUMP:
+                vm->pc = operand_at(vm->code, vm->pc);
+                break;
+            default:
+                vm->pc += 1;
+                return actions[op];
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#include "stats.h"
+#include "histogram.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+static atomic_ulong connects;
+static atomic_ulong warm_connects;
+static histogram_t first_frame; // recorded by the manager thread of every session
+
+void stats_connect(int warm) {
+    atomic_fetch_add_explicit(&connects, 1, memory_order_relaxed);
+    if (warm) atomic_fetch_add_explicit(&warm_connects, 1, memory_order_relaxed);
+}
+
+void stats_first_frame(long long latency_us) {
+    hist_add(&first_frame, latency_us * 1000);
+}
+
+int stats_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    hist_merged_t latency = {0}; // Snapshot, the counters keep moving while we print
+    hist_merge(&latency, &first_frame);
+    unsigned long total_connects = atomic_load(&connects);
+    unsigned long warm = atomic_load(&warm_connects);
+
+    fprintf(f, "Server Stats\n\n");
+    fprintf(f, "connects: %lu (%lu warm, %lu cold)\n", total_connects, warm, total_connects - warm);
+    fprintf(f, "first frame latency samples: %llu\n", (unsigned long long)latency.count);
+    if (latency.count > 0) {
+        fprintf(f, "first frame latency avg: %.1f us\n", latency.total_ns / 1e3 / latency.count);
+        fprintf(f, "first frame latency p50: %.1f us\n", hist_percentile(&latency, 0.50) / 1e3);
+        fprintf(f, "first frame latency p99: %.1f us\n", hist_percentile(&latency, 0.99) / 1e3);
+        fprintf(f, "first frame latency max: %.1f us\n", latency.max_ns / 1e3);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+void stats_write_json(FILE *f) {
+    hist_merged_t latency = {0};
+    hist_merge(&latency, &first_frame);
+
+    fprintf(f, "{\"connects\":%lu,\"warm_connects\":%lu,\"first_frame\":{\"samples\":%llu",
+            atomic_load(&connects), atomic_load(&warm_connects), (unsigned long long)latency.count);
+    if (latency.count > 0) {
+        fprintf(f, ",\"avg_us\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f",
+                latency.total_ns / 1e3 / latency.count, hist_percentile(&latency, 0.50) / 1e3,
+                hist_percentile(&latency, 0.99) / 1e3, latency.max_ns / 1e3);
+    }
+    fprintf(f, "}}");
+}
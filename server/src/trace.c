@@ -0,0 +1,241 @@
+#include "trace.h"
+#include "board.h"
+#include "utils.h"
+#include <stdalign.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#define TRACE_GRACE_MS 10 // lets a record started just before the window closed finish
+
+typedef struct {
+    uint64_t time_ns; // monotonic_ns()
+    uint16_t name; // trace_name_t
+    char phase; // 'B' or 'E'
+} trace_event_t;
+
+// Ring of one thread, written only by its owner and read once the window is closed
+typedef struct {
+    alignas(CACHE_LINE_SIZE) atomic_ulong head;
+    atomic_int owned;
+    long long last_ns; // newest record, a free ring is reused only if it holds nothing of the open window
+    char thread_name[TRACE_THREAD_NAME_LENGTH];
+    trace_event_t events[TRACE_RING_SIZE];
+} trace_ring_t;
+
+static const char *trace_names[TRACE_NAMES] = {
+    [TRACE_MOVE_PACMAN] = "move_pacman",
+    [TRACE_MOVE_GHOST] = "move_ghost",
+    [TRACE_MOVE_GHOST_CHARGED] = "move_ghost_charged",
+    [TRACE_RENDER] = "get_board_displayed",
+    [TRACE_SEND_FRAME] = "send_frame",
+    [TRACE_LOAD_LEVEL] = "load_level",
+    [TRACE_UNLOAD_LEVEL] = "unload_level",
+    [TRACE_HANDSHAKE] = "handshake",
+    [TRACE_LOCK_WAIT] = "lock_wait",
+};
+
+atomic_int trace_enabled;
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER; // only taken to add a ring
+static trace_ring_t *rings[TRACE_MAX_RINGS];
+static atomic_int n_rings;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key; // releases the ring of a thread when it exits
+static _Thread_local trace_ring_t *thread_ring;
+static _Thread_local char thread_name[TRACE_THREAD_NAME_LENGTH];
+
+// Window state, changed with window_lock held
+static pthread_mutex_t window_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t window_cond = PTHREAD_COND_INITIALIZER;
+static int window_open; // from trace_start until the file is written
+static int window_joinable; // window_tid has not been joined yet
+static int window_cancel;
+static pthread_t window_tid;
+static int window_sec;
+static atomic_llong window_start_ns; // read by the threads claiming a ring
+static char window_path[MAX_FILENAME];
+
+// Helper private function, called at thread exit with the ring of the thread
+static void release_ring(void *ring) {
+    atomic_store_explicit(&((trace_ring_t *)ring)->owned, 0, memory_order_release);
+}
+
+static void create_key(void) {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+// Helper private function to give the calling thread a ring, NULL if none is left
+static trace_ring_t *claim_ring(void) {
+    pthread_once(&key_once, create_key);
+
+    int count = atomic_load_explicit(&n_rings, memory_order_acquire);
+    for (int i = 0; i < count && !thread_ring; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong_explicit(&rings[i]->owned, &expected, 1,
+                                                    memory_order_acquire, memory_order_relaxed)) {
+            if (rings[i]->last_ns < atomic_load_explicit(&window_start_ns, memory_order_relaxed)) {
+                thread_ring = rings[i];
+            }
+            else {
+                release_ring(rings[i]); // Still holds a thread that ended during this window
+            }
+        }
+    }
+
+    if (!thread_ring) {
+        pthread_mutex_lock(&rings_lock);
+        count = atomic_load_explicit(&n_rings, memory_order_relaxed);
+        if (count < TRACE_MAX_RINGS) {
+            trace_ring_t *ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(trace_ring_t));
+            if (ring) {
+                memset(ring, 0, sizeof(trace_ring_t));
+                atomic_store_explicit(&ring->owned, 1, memory_order_relaxed);
+                rings[count] = ring;
+                atomic_store_explicit(&n_rings, count + 1, memory_order_release);
+                thread_ring = ring;
+            }
+        }
+        pthread_mutex_unlock(&rings_lock);
+    }
+
+    if (thread_ring) {
+        memcpy(thread_ring->thread_name, thread_name, TRACE_THREAD_NAME_LENGTH);
+        pthread_setspecific(ring_key, thread_ring);
+    }
+    return thread_ring;
+}
+
+void trace_record(trace_name_t name, char phase) {
+    trace_ring_t *ring = thread_ring ? thread_ring : claim_ring();
+    if (!ring) return;
+
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    trace_event_t *event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+    event->time_ns = monotonic_ns();
+    event->name = name;
+    event->phase = phase;
+    ring->last_ns = event->time_ns;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_thread_name(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(thread_name, sizeof(thread_name), format, args);
+    va_end(args);
+
+    if (thread_ring) {
+        memcpy(thread_ring->thread_name, thread_name, TRACE_THREAD_NAME_LENGTH);
+    }
+}
+
+// Helper private function to write the records of the closed window as Chrome trace-event JSON
+static int write_trace(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    long long start_ns = atomic_load(&window_start_ns);
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Pacmanist\"}}");
+
+    int count = atomic_load_explicit(&n_rings, memory_order_acquire);
+    for (int r = 0; r < count; r++) {
+        trace_ring_t *ring = rings[r];
+        unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        unsigned long first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        if (ring->last_ns < start_ns) continue;
+
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", r + 1,
+                ring->thread_name[0] ? ring->thread_name : "thread");
+        for (unsigned long i = first; i < head; i++) {
+            const trace_event_t *event = &ring->events[i & (TRACE_RING_SIZE - 1)];
+            if ((long long)event->time_ns < start_ns) continue;
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f}", trace_names[event->name],
+                    event->phase, r + 1, ((long long)event->time_ns - start_ns) / 1e3);
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    return fclose(f);
+}
+
+static void *window_thread(void *arg) {
+    (void)arg;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += window_sec;
+
+    pthread_mutex_lock(&window_lock);
+    while (!window_cancel) {
+        if (pthread_cond_timedwait(&window_cond, &window_lock, &deadline) == ETIMEDOUT) break;
+    }
+    int cancelled = window_cancel;
+    pthread_mutex_unlock(&window_lock);
+
+    atomic_store(&trace_enabled, 0);
+    if (!cancelled) {
+        sleep_ms(TRACE_GRACE_MS);
+        if (write_trace(window_path) != 0) {
+            log_error("Error writing trace %s: %s\n", window_path, strerror(errno));
+        }
+        else {
+            log_info("Trace written to %s\n", window_path);
+        }
+    }
+
+    pthread_mutex_lock(&window_lock);
+    window_open = 0;
+    pthread_mutex_unlock(&window_lock);
+    return NULL;
+}
+
+int trace_start(const char *dir, int seconds, char *path, int path_size) {
+    if (seconds < 1) seconds = 1;
+    if (seconds > TRACE_MAX_WINDOW_SEC) seconds = TRACE_MAX_WINDOW_SEC;
+
+    pthread_mutex_lock(&window_lock);
+    if (window_open) {
+        pthread_mutex_unlock(&window_lock);
+        errno = EBUSY;
+        return -1;
+    }
+    if (window_joinable) {
+        pthread_join(window_tid, NULL); // Done with its window, it only has to be reaped
+        window_joinable = 0;
+    }
+
+    snprintf(window_path, sizeof(window_path), "%s/trace.%lld.json", dir, (long long)time(NULL));
+    window_sec = seconds;
+    window_cancel = 0;
+    atomic_store(&window_start_ns, monotonic_ns());
+    atomic_store(&trace_enabled, 1);
+
+    if (pthread_create(&window_tid, NULL, window_thread, NULL) != 0) {
+        atomic_store(&trace_enabled, 0);
+        pthread_mutex_unlock(&window_lock);
+        return -1;
+    }
+    window_open = 1;
+    window_joinable = 1;
+    pthread_mutex_unlock(&window_lock);
+
+    if (path) snprintf(path, path_size, "%s", window_path);
+    return 0;
+}
+
+void trace_shutdown(void) {
+    pthread_mutex_lock(&window_lock);
+    window_cancel = 1;
+    pthread_cond_signal(&window_cond);
+    int joinable = window_joinable;
+    window_joinable = 0;
+    pthread_mutex_unlock(&window_lock);
+
+    if (joinable) pthread_join(window_tid, NULL);
+}
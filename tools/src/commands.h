@@ -0,0 +1,53 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Client command files (the .p files client/bin/client plays) for the tools that
+drive the server without a terminal. The PASSO / POS header, comments and empty
+lines are skipped, every other line is one command, and `T n` waits n turns,
+which the client sends as n 'T' commands. The file becomes that flat string of
+commands, NULL on error or when it has none. The caller frees it
+*/
+static inline char *commands_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+
+    size_t len = 0, capacity = 64;
+    char *commands = malloc(capacity);
+    char line[256];
+    while (commands && fgets(line, sizeof(line), f)) {
+        char *word = strtok(line, " \t\r\n");
+        if (!word || word[0] == '#' || strcmp(word, "PASSO") == 0 || strcmp(word, "POS") == 0) continue;
+
+        char command = (char)toupper((unsigned char)word[0]);
+        long turns = 1;
+        if (command == 'T') {
+            char *arg = strtok(NULL, " \t\r\n");
+            turns = arg ? atol(arg) : 1;
+        }
+        for (long i = 0; i < turns && commands; i++) {
+            if (len + 1 == capacity) {
+                char *grown = realloc(commands, capacity * 2);
+                if (!grown) free(commands);
+                commands = grown;
+                capacity *= 2;
+            }
+            if (commands) commands[len++] = command;
+        }
+    }
+    fclose(f);
+
+    if (commands) commands[len] = '\0';
+    if (commands && len == 0) {
+        free(commands);
+        commands = NULL;
+    }
+    return commands;
+}
+
+#endif
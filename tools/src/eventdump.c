@@ -0,0 +1,94 @@
+/*
+Decoder of the server's game event stream (events.h).
+Reads every given events file, sorts the records by time and prints one per line:
+
+    <time_us> <client_id> <level> <event> <x> <y> <value>
+
+Usage: eventdump <events.N.bin>...
+*/
+#include "events.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *event_names[] = {
+    [EVENT_CONNECT] = "connect",
+    [EVENT_DISCONNECT] = "disconnect",
+    [EVENT_DEATH] = "death",
+    [EVENT_PORTAL] = "portal",
+    [EVENT_CHARGE] = "charge",
+    [EVENT_GAME_END] = "game_end",
+};
+
+static int by_time(const void *a, const void *b) {
+    const event_t *x = a, *y = b;
+    return (x->time_us > y->time_us) - (x->time_us < y->time_us);
+}
+
+// Helper private function to append the records of path to events, -1 on error
+static int read_events(const char *path, event_t **events, size_t *count, size_t *capacity) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    event_file_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, EVENTS_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != EVENTS_VERSION || header.record_size != sizeof(event_t)) {
+        fprintf(stderr, "%s: not an events file of this version\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    while (1) {
+        if (*count == *capacity) {
+            size_t grown = *capacity ? *capacity * 2 : 4096;
+            event_t *resized = realloc(*events, grown * sizeof(event_t));
+            if (!resized) {
+                fclose(f);
+                return -1;
+            }
+            *events = resized;
+            *capacity = grown;
+        }
+        size_t n = fread(*events + *count, sizeof(event_t), *capacity - *count, f);
+        *count += n;
+        if (n == 0) break; // A torn record at the end is left out
+    }
+
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <events.N.bin>...\n", argv[0]);
+        return 1;
+    }
+
+    event_t *events = NULL;
+    size_t count = 0, capacity = 0;
+    for (int i = 1; i < argc; i++) {
+        if (read_events(argv[i], &events, &count, &capacity) != 0) {
+            free(events);
+            return 1;
+        }
+    }
+
+    // Each writer pass groups records by thread, time order is restored here
+    qsort(events, count, sizeof(event_t), by_time);
+
+    for (size_t i = 0; i < count; i++) {
+        const event_t *event = &events[i];
+        const char *name = event->type < sizeof(event_names) / sizeof(event_names[0]) && event_names[event->type]
+                               ? event_names[event->type]
+                               : "unknown";
+        printf("%llu %d %u %s %d %d %d\n", (unsigned long long)event->time_us, event->client_id, event->level,
+               name, event->x, event->y, event->value);
+    }
+
+    free(events);
+    return 0;
+}
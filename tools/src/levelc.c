@@ -0,0 +1,76 @@
+/*
+Offline level compiler.
+Parses every level of a levels directory, validates them and writes a single
+binary pack that the server can mmap instead of parsing text files.
+With -v the parser's debug log goes to stderr.
+
+Usage: levelc [-v] <levels_dir> <output.pack>
+*/
+#include "board.h"
+#include "parser.h"
+#include "levelpack.h"
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+    int verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+    if (argc != 3 + verbose) {
+        fprintf(stderr, "Usage: %s [-v] <levels_dir> <output.pack>\n", argv[0]);
+        return 1;
+    }
+    char *levels_dir = argv[1 + verbose];
+    char *output = argv[2 + verbose];
+
+    if (verbose) {
+        log_open("/dev/stderr", LOG_DEBUG);
+    }
+
+    int count;
+    char **level_names = sort_levels(levels_dir, &count);
+    if (count == 0) {
+        fprintf(stderr, "No .lvl files in %s\n", levels_dir);
+        log_close();
+        return 1;
+    }
+
+    arena_t arena;
+    arena_init(&arena);
+    level_template_t *levels = arena_alloc(&arena, count * sizeof(level_template_t));
+
+    int errors = 0;
+    for (int i = 0; i < count; i++) {
+        char err[256];
+        if (read_level(&levels[i], &arena, level_names[i], levels_dir) < 0) {
+            fprintf(stderr, "%s/%s: could not be parsed\n", levels_dir, level_names[i]);
+            errors++;
+            continue;
+        }
+        if (levelpack_validate(&levels[i], err, sizeof(err)) < 0) {
+            fprintf(stderr, "%s/%s: %s\n", levels_dir, level_names[i], err);
+            errors++;
+            continue;
+        }
+        printf("%-24s %4d x %-4d tempo %-5d ghosts %d\n", level_names[i],
+               levels[i].width, levels[i].height, levels[i].tempo, levels[i].n_ghosts);
+    }
+
+    int result = 0;
+    if (errors) {
+        fprintf(stderr, "%d invalid level(s), %s not written\n", errors, output);
+        result = 1;
+    }
+    else if (levelpack_write(output, levels, count) < 0) {
+        perror(output);
+        result = 1;
+    }
+    else {
+        printf("Wrote %d levels to %s\n", count, output);
+    }
+
+    free_level_names(level_names, count);
+    arena_destroy(&arena);
+    log_close();
+    return result;
+}
@@ -0,0 +1,416 @@
+/*
+Synthetic level generator for scaling benchmarks and load tests.
+Writes a levels directory in the usual text format (.lvl, .p and .m files) that
+the server loads as it is or that levelc packs. The same seed and options always
+give the same files.
+
+    -n levels       levels to write (1)
+    -w width        board width, walls included, up to 10000 (64)
+    -h height       board height, up to 10000 (64)
+    -m random|maze  random walls with -d percent density, or a maze (random)
+    -d percent      random: chance of a wall per cell; maze: share of inner walls knocked
+                    down so corridors loop like hand made levels do (20)
+    -p far|random   portal on the reachable cell farthest from the pacman, or any reachable one (far)
+    -g ghosts       ghosts per level, at most MAX_GHOSTS (4)
+    -l length       commands per ghost script (16)
+    -t tempo        TEMPO of the levels in ms (100)
+    -P passo        PASSO of the pacman (0)
+    -G passo        PASSO of the ghosts (0)
+    -s seed         generator seed (1)
+
+Spawns and the portal are always reachable from each other, so every level
+passes levelpack_validate. Ghost scripts mix moves with the commands designers
+use: charges, random moves, waits, chasing and REPEAT blocks.
+
+Usage: levelgen <output_dir> [options]
+*/
+#include "board.h"
+#include "rng.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define LEVELGEN_MAX_SIDE 10000
+#define LEVELGEN_SPAWN_TRIES 20 // random walls: pacman spawns tried to find a big open region
+#define SEEN 0x80 // BFS mark on top of the CELL_* flags
+
+typedef struct {
+    int n_levels;
+    int width, height;
+    int maze;
+    int density;
+    int portal_far;
+    int n_ghosts;
+    int script_length;
+    int tempo;
+    int pacman_passo, ghost_passo;
+    uint64_t seed;
+} options_t;
+
+typedef struct {
+    int *cells;
+    size_t head, count, capacity; // ring, grows when full
+} queue_t;
+
+// Reachable region of a spawn, with the cells sampled from it
+typedef struct {
+    long size; // reachable cells, the spawn included
+    int farthest;
+    int picks[MAX_GHOSTS + 1]; // uniform sample of the region without the spawn
+    int n_picks;
+} region_t;
+
+static int queue_push(queue_t *queue, int cell) {
+    if (queue->count == queue->capacity) {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : 4096;
+        int *cells = malloc(capacity * sizeof(int));
+        if (!cells) return -1;
+        for (size_t i = 0; i < queue->count; i++) {
+            cells[i] = queue->cells[(queue->head + i) % queue->capacity];
+        }
+        free(queue->cells);
+        queue->cells = cells;
+        queue->head = 0;
+        queue->capacity = capacity;
+    }
+    queue->cells[(queue->head + queue->count++) % queue->capacity] = cell;
+    return 0;
+}
+
+static int queue_pop(queue_t *queue) {
+    int cell = queue->cells[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    return cell;
+}
+
+/*
+Helper private function, breadth first search from start over the open cells.
+Keeps the last cell reached and a reservoir sample of n_picks other cells. Marks are cleared on return.
+-1 if out of memory
+*/
+static int explore(uint8_t *grid, int width, int height, int start, int n_picks, rng_t *rng, region_t *region) {
+    queue_t queue = {0};
+    region->size = 0;
+    region->farthest = start;
+    region->n_picks = 0;
+
+    grid[start] |= SEEN;
+    int result = queue_push(&queue, start);
+    while (result == 0 && queue.count > 0) {
+        int cell = queue_pop(&queue);
+        region->size++;
+        region->farthest = cell;
+        if (cell != start) {
+            long seen = region->size - 1; // cells other than the spawn so far
+            if (region->n_picks < n_picks) region->picks[region->n_picks++] = cell;
+            else if (n_picks > 0 && (long)rng_below(rng, (uint32_t)seen) < n_picks) {
+                region->picks[rng_below(rng, n_picks)] = cell;
+            }
+        }
+
+        int x = cell % width, y = cell / width;
+        const int dx[] = {0, 0, -1, 1}, dy[] = {-1, 1, 0, 0};
+        for (int d = 0; d < 4 && result == 0; d++) {
+            int nx = x + dx[d], ny = y + dy[d];
+            if (nx < 0 || nx >= width || ny < 0 || ny >= height) continue;
+            int next = ny * width + nx;
+            if (grid[next] & (SEEN | CELL_WALL)) continue;
+            grid[next] |= SEEN;
+            result = queue_push(&queue, next);
+        }
+    }
+    free(queue.cells);
+
+    for (long i = 0; i < (long)width * height; i++) grid[i] &= ~SEEN;
+    return result;
+}
+
+// Helper private function, border walls and random inner walls
+static void random_walls(uint8_t *grid, const options_t *options, rng_t *rng) {
+    for (int y = 0; y < options->height; y++) {
+        for (int x = 0; x < options->width; x++) {
+            int border = x == 0 || y == 0 || x == options->width - 1 || y == options->height - 1;
+            grid[y * options->width + x] = border || (int)rng_below(rng, 100) < options->density ? CELL_WALL : 0;
+        }
+    }
+}
+
+/*
+Helper private function, depth first maze over the odd cells, then density percent of the
+inner walls between two corridors knocked down. -1 if out of memory
+*/
+static int maze_walls(uint8_t *grid, const options_t *options, rng_t *rng) {
+    int width = options->width, height = options->height;
+    memset(grid, CELL_WALL, (size_t)width * height);
+
+    size_t capacity = 4096, depth = 0;
+    int *stack = malloc(capacity * sizeof(int));
+    if (!stack) return -1;
+
+    int start = 1 * width + 1;
+    grid[start] = 0;
+    stack[depth++] = start;
+    while (depth > 0) {
+        int cell = stack[depth - 1];
+        int x = cell % width, y = cell / width;
+        int options_found[4], n = 0;
+        const int dx[] = {0, 0, -2, 2}, dy[] = {-2, 2, 0, 0};
+        for (int d = 0; d < 4; d++) {
+            int nx = x + dx[d], ny = y + dy[d];
+            if (nx > 0 && nx < width - 1 && ny > 0 && ny < height - 1 && (grid[ny * width + nx] & CELL_WALL)) {
+                options_found[n++] = d;
+            }
+        }
+        if (n == 0) {
+            depth--;
+            continue;
+        }
+
+        int d = options_found[rng_below(rng, n)];
+        int next = (y + dy[d]) * width + x + dx[d];
+        grid[(y + dy[d] / 2) * width + x + dx[d] / 2] = 0;
+        grid[next] = 0;
+        if (depth == capacity) {
+            int *grown = realloc(stack, capacity * 2 * sizeof(int));
+            if (!grown) {
+                free(stack);
+                return -1;
+            }
+            stack = grown;
+            capacity *= 2;
+        }
+        stack[depth++] = next;
+    }
+    free(stack);
+
+    // Loops: a wall with corridors on two opposite sides
+    for (int y = 1; y < height - 1; y++) {
+        for (int x = 1; x < width - 1; x++) {
+            int cell = y * width + x;
+            if (!(grid[cell] & CELL_WALL)) continue;
+            int across = (!(grid[cell - 1] & CELL_WALL) && !(grid[cell + 1] & CELL_WALL)) ||
+                         (!(grid[cell - width] & CELL_WALL) && !(grid[cell + width] & CELL_WALL));
+            if (across && (int)rng_below(rng, 100) < options->density) grid[cell] = 0;
+        }
+    }
+    return 0;
+}
+
+// Helper private function, a random open inner cell, -1 if there is none
+static int random_open_cell(const uint8_t *grid, const options_t *options, rng_t *rng) {
+    long n_cells = (long)options->width * options->height;
+    for (int tries = 0; tries < 1000; tries++) {
+        long cell = (long)(((uint64_t)rng_next(rng) << 32 | rng_next(rng)) % (uint64_t)n_cells);
+        if (!(grid[cell] & CELL_WALL)) return (int)cell;
+    }
+    for (long cell = 0; cell < n_cells; cell++) {
+        if (!(grid[cell] & CELL_WALL)) return (int)cell;
+    }
+    return -1;
+}
+
+// Helper private function, one command of a ghost script, at most `room` lines
+static int write_command(FILE *f, rng_t *rng, int room) {
+    static const char moves[] = "WASD";
+    uint32_t roll = rng_below(rng, 100);
+    if (roll < 60 || room < 2) {
+        fprintf(f, "%c\n", moves[rng_below(rng, 4)]);
+        return 1;
+    }
+    if (roll < 70) {
+        fprintf(f, "C\n%c\n", moves[rng_below(rng, 4)]); // Charge, then the dash
+        return 2;
+    }
+    if (roll < 80) fprintf(f, "R\n");
+    else if (roll < 90) fprintf(f, "T %u\n", 1 + rng_below(rng, 4));
+    else fprintf(f, "H\n");
+    return 1;
+}
+
+// Helper private function to write a ghost file, -1 on error
+static int write_ghost(const char *path, const options_t *options, int x, int y, rng_t *rng) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    fprintf(f, "PASSO %d\nPOS %d %d\n", options->ghost_passo, x, y);
+    int written = 0;
+    int repeat_at = options->script_length >= 8 ? (int)rng_below(rng, options->script_length - 4) : -1;
+    while (written < options->script_length) {
+        if (written == repeat_at) {
+            int body = 2 + rng_below(rng, 3);
+            fprintf(f, "REPEAT %u\n", 2 + rng_below(rng, 4));
+            for (int i = 0; i < body; i++) fprintf(f, "    %c\n", "WASD"[rng_below(rng, 4)]);
+            fprintf(f, "END\n");
+            written += body;
+            continue;
+        }
+        written += write_command(f, rng, options->script_length - written);
+    }
+    return fclose(f);
+}
+
+// Helper private function to write one level and its entity files, -1 on error
+static int write_level(const char *dir, const char *name, const options_t *options, uint8_t *grid, rng_t *rng) {
+    int width = options->width, height = options->height;
+    int n_picks = options->n_ghosts + 1; // One spare, a pick may be the far portal
+
+    if ((options->maze ? maze_walls(grid, options, rng) : (random_walls(grid, options, rng), 0)) != 0) return -1;
+
+    // The pacman spawn with the biggest region among a few tries, the first open cell of a maze
+    int spawn = options->maze ? width + 1 : -1;
+    region_t region = {0};
+    for (int tries = 0; tries < (options->maze ? 1 : LEVELGEN_SPAWN_TRIES); tries++) {
+        int candidate = options->maze ? spawn : random_open_cell(grid, options, rng);
+        region_t candidate_region;
+        if (candidate == -1) break;
+        if (explore(grid, width, height, candidate, n_picks, rng, &candidate_region) != 0) return -1;
+        if (candidate_region.size > region.size) {
+            spawn = candidate;
+            region = candidate_region;
+        }
+        if (region.size * 2 >= (long)width * height) break; // Most of the board already
+    }
+    if (spawn == -1 || region.n_picks < n_picks) {
+        fprintf(stderr, "%s: not enough open cells for the pacman, %d ghosts and a portal, lower the density\n", name,
+                options->n_ghosts);
+        errno = 0;
+        return -1;
+    }
+
+    int portal = options->portal_far ? region.farthest : region.picks[--region.n_picks];
+    for (int i = 0; i < region.n_picks; i++) {
+        if (region.picks[i] == portal) region.picks[i] = region.picks[--region.n_picks];
+    }
+    grid[portal] |= CELL_PORTAL;
+
+    char path[MAX_FILENAME];
+    snprintf(path, sizeof(path), "%s/%s.p", dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "PASSO %d\nPOS %d %d\n", options->pacman_passo, spawn % width, spawn / width);
+    if (fclose(f) != 0) return -1;
+
+    for (int g = 0; g < options->n_ghosts; g++) {
+        snprintf(path, sizeof(path), "%s/%s_ghost%d.m", dir, name, g);
+        int cell = region.picks[g];
+        if (write_ghost(path, options, cell % width, cell / width, rng) != 0) return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s.lvl", dir, name);
+    f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "DIM %d %d\nTEMPO %d\nPAC %s.p\n", width, height, options->tempo, name);
+    if (options->n_ghosts > 0) {
+        fprintf(f, "MON");
+        for (int g = 0; g < options->n_ghosts; g++) fprintf(f, " %s_ghost%d.m", name, g);
+        fprintf(f, "\n");
+    }
+
+    char *row = malloc(width + 1);
+    if (!row) {
+        fclose(f);
+        return -1;
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t cell = grid[y * width + x];
+            row[x] = cell & CELL_PORTAL ? '@' : cell & CELL_WALL ? 'X' : 'o';
+        }
+        row[width] = '\n';
+        fwrite(row, 1, width + 1, f);
+    }
+    free(row);
+    return fclose(f);
+}
+
+// Helper private function to read a number option between min and max, -1 (and a message) if it is not one
+static int parse_int(const char *text, int min, int max, const char *what, int *out) {
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (!*text || *end != '\0' || value < min || value > max) {
+        fprintf(stderr, "%s must be between %d and %d\n", what, min, max);
+        return -1;
+    }
+    *out = (int)value;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    options_t options = {1, 64, 64, 0, 20, 1, 4, 16, 100, 0, 0, 1};
+    if (argc < 2 || argv[1][0] == '-') {
+        fprintf(stderr, "Usage: %s <output_dir> [-n levels] [-w width] [-h height] [-m random|maze] [-d percent]\n"
+                        "       [-p far|random] [-g ghosts] [-l script_length] [-t tempo] [-P passo] [-G passo] "
+                        "[-s seed]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+
+    for (int i = 2; i < argc; i++) {
+        const char *flag = argv[i];
+        const char *value = i + 1 < argc ? argv[++i] : NULL;
+        int bad = !value || flag[0] != '-' || strlen(flag) != 2;
+        if (!bad) {
+            switch (flag[1]) {
+                case 'n': bad = parse_int(value, 1, 9999, "levels", &options.n_levels); break;
+                case 'w': bad = parse_int(value, 3, LEVELGEN_MAX_SIDE, "width", &options.width); break;
+                case 'h': bad = parse_int(value, 3, LEVELGEN_MAX_SIDE, "height", &options.height); break;
+                case 'd': bad = parse_int(value, 0, 100, "density", &options.density); break;
+                case 'g': bad = parse_int(value, 0, MAX_GHOSTS, "ghosts", &options.n_ghosts); break;
+                case 'l': bad = parse_int(value, 1, 100000, "script length", &options.script_length); break;
+                case 't': bad = parse_int(value, 1, 100000, "tempo", &options.tempo); break;
+                case 'P': bad = parse_int(value, 0, 1000, "pacman passo", &options.pacman_passo); break;
+                case 'G': bad = parse_int(value, 0, 1000, "ghost passo", &options.ghost_passo); break;
+                case 's': options.seed = strtoull(value, NULL, 0); break;
+                case 'm':
+                    options.maze = strcmp(value, "maze") == 0;
+                    bad = !options.maze && strcmp(value, "random") != 0;
+                    break;
+                case 'p':
+                    options.portal_far = strcmp(value, "far") == 0;
+                    bad = !options.portal_far && strcmp(value, "random") != 0;
+                    break;
+                default: bad = 1;
+            }
+        }
+        if (bad) {
+            fprintf(stderr, "Invalid option %s %s\n", flag, value ? value : "");
+            return 1;
+        }
+    }
+
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        perror(dir);
+        return 1;
+    }
+    uint8_t *grid = malloc((size_t)options.width * options.height);
+    if (!grid) {
+        perror("levelgen");
+        return 1;
+    }
+
+    // Level names sort in play order (sort_levels compares them as strings)
+    int digits = snprintf(NULL, 0, "%d", options.n_levels);
+    int result = 0;
+    for (int l = 0; l < options.n_levels && result == 0; l++) {
+        char name[32];
+        snprintf(name, sizeof(name), "%0*d", digits, l + 1);
+
+        rng_t rng;
+        rng_seed(&rng, rng_mix(options.seed + (uint64_t)l)); // Each level on its own, -n does not change the first ones
+        if (write_level(dir, name, &options, grid, &rng) != 0) {
+            if (errno) perror(name);
+            result = 1;
+        }
+        else {
+            printf("%s/%s.lvl %d x %d, %s walls, %d ghosts\n", dir, name, options.width, options.height,
+                   options.maze ? "maze" : "random", options.n_ghosts);
+        }
+    }
+
+    free(grid);
+    return result;
+}
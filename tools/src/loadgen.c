@@ -0,0 +1,412 @@
+/*
+Load generator: one process playing many clients against a running server,
+to find how many sessions a box sustains before the server misses frames.
+
+Clients speak the protocol of client/src/client/api.c without a terminal. Each
+one connects (ids from 10000 up), plays random moves or a repeated script (a
+string of commands, or @file for a recorded client command file) at
+rate commands per second with sequence numbers, and starts a new game when its
+game ends. Clients start evenly over ramp_sec, then everybody plays until
+duration_sec. Every second a line goes to stderr with the clients playing and
+the rates of that second, so the point where frames start arriving late shows
+up against the client count. The totals are printed as JSON on stdout:
+
+    clients requested and started, fewer when a thread cannot be created
+    connects and connects/s, frames and frames/s, bytes/s
+    late frames: more than 1.5 frame intervals after the previous one
+    dropped frames: frame intervals with no frame in those gaps
+    input latency percentiles: PLAY_SEQ until the first frame echoing it
+    connect latency percentiles: register request until the first frame
+
+Usage: loadgen <register_pipe> <clients> [rate] [ramp_sec] [duration_sec] [random|<commands>|@<file>]
+*/
+#include "protocol.h"
+#include "rng.h"
+#include "commands.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define LOADGEN_FIRST_ID 10000
+#define LOADGEN_FRAME_MS 50 // frame interval of the manager thread (game.c)
+#define LOADGEN_SEQ_WINDOW 1024 // inputs in flight per client, power of two
+#define LOADGEN_MAX_CLIENTS 1000
+
+typedef struct {
+    uint32_t *values; // microseconds
+    size_t count, capacity;
+} samples_t;
+
+typedef struct {
+    int id;
+    double start_s; // offset of the first connect from the start of the run
+    rng_t rng;
+    long long sent_us[LOADGEN_SEQ_WINDOW];
+    samples_t input_latency;
+    samples_t connect_latency;
+} client_t;
+
+// Run wide counters, added by every client
+static atomic_long connects, connect_failures, frames, bytes, late_frames, dropped_frames, inputs;
+static atomic_int playing;
+static atomic_int stopping;
+
+static const char *register_pipe;
+static double rate = 10;
+static double ramp_s = 5;
+static double duration_s = 30;
+static const char *script; // NULL for random moves
+static size_t script_len;
+static long long run_start_us;
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void pause_ms(int milliseconds) {
+    struct timespec ts = {milliseconds / 1000, (milliseconds % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+static void sample_add(samples_t *samples, long long us) {
+    if (samples->count == samples->capacity) {
+        size_t capacity = samples->capacity ? samples->capacity * 2 : 1024;
+        uint32_t *values = realloc(samples->values, capacity * sizeof(uint32_t));
+        if (!values) return;
+        samples->values = values;
+        samples->capacity = capacity;
+    }
+    samples->values[samples->count++] = us < 0 ? 0 : (uint32_t)us;
+}
+
+// Helper private function, reads exactly size bytes. 0 on success, -1 on error or end of file
+static int read_full(int fd, void *buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, (char *)buffer + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+// Helper private function, registers the client and opens its pipes. 0 on success
+static int connect_client(client_t *client, int *req_fd, int *notif_fd, long long run_end) {
+    char req_path[MAX_PIPE_PATH_LENGTH] = {0}, notif_path[MAX_PIPE_PATH_LENGTH] = {0};
+    snprintf(req_path, sizeof(req_path), "/tmp/%d_request", client->id);
+    snprintf(notif_path, sizeof(notif_path), "/tmp/%d_notification", client->id);
+    unlink(req_path);
+    unlink(notif_path);
+    if (mkfifo(req_path, 0666) != 0 || mkfifo(notif_path, 0666) != 0) return -1;
+
+    int server = open(register_pipe, O_WRONLY);
+    if (server == -1) return -1;
+
+    char request[1 + sizeof(int) + 2 * MAX_PIPE_PATH_LENGTH]; // One write, never interleaved with other clients
+    request[0] = OP_CODE_CONNECT;
+    memcpy(request + 1, &client->id, sizeof(int));
+    memcpy(request + 1 + sizeof(int), req_path, MAX_PIPE_PATH_LENGTH);
+    memcpy(request + 1 + sizeof(int) + MAX_PIPE_PATH_LENGTH, notif_path, MAX_PIPE_PATH_LENGTH);
+    int sent = write(server, request, sizeof(request)) == (ssize_t)sizeof(request);
+    close(server);
+    if (!sent) return -1;
+
+    // Not blocking in open, a request the server never picks up must not outlive the run
+    *notif_fd = open(notif_path, O_RDONLY | O_NONBLOCK);
+    if (*notif_fd == -1) return -1;
+    struct pollfd pfd = {*notif_fd, POLLIN, 0};
+    while (poll(&pfd, 1, 100) == 0 || (pfd.revents & POLLIN) == 0) {
+        if (atomic_load(&stopping) || now_us() >= run_end) {
+            close(*notif_fd);
+            return -1;
+        }
+    }
+    fcntl(*notif_fd, F_SETFL, fcntl(*notif_fd, F_GETFL) & ~O_NONBLOCK);
+
+    char reply[2];
+    if (read_full(*notif_fd, reply, sizeof(reply)) != 0 || reply[0] != OP_CODE_CONNECT || reply[1] != 0) {
+        close(*notif_fd);
+        return -1;
+    }
+
+    *req_fd = open(req_path, O_WRONLY);
+    if (*req_fd == -1) {
+        close(*notif_fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void remove_pipes(client_t *client) {
+    char path[MAX_PIPE_PATH_LENGTH];
+    snprintf(path, sizeof(path), "/tmp/%d_request", client->id);
+    unlink(path);
+    snprintf(path, sizeof(path), "/tmp/%d_notification", client->id);
+    unlink(path);
+}
+
+static void disconnect_client(client_t *client, int req_fd, int notif_fd) {
+    char op_code = OP_CODE_DISCONNECT;
+    if (write(req_fd, &op_code, 1) != 1) {
+        // Server already gone
+    }
+    close(req_fd);
+    close(notif_fd);
+    remove_pipes(client);
+}
+
+// Helper private function, next command of the client's script or a random move
+static char next_command(client_t *client, long n) {
+    if (script) return script[n % script_len];
+    return "WASD"[rng_below(&client->rng, 4)];
+}
+
+// Plays one game, returns when it ends, the run is over or the server closes the session
+static void play_game(client_t *client, int req_fd, int notif_fd, long long connect_start, long long run_end) {
+    long long interval_us = rate > 0 ? (long long)(1000000 / rate) : -1;
+    long long next_send = now_us();
+    long long last_frame = -1;
+    int seq = 0, acked = -1;
+    long sent = 0;
+
+    while (!atomic_load(&stopping)) {
+        long long now = now_us();
+        if (now >= run_end) break;
+
+        if (interval_us > 0 && now >= next_send) {
+            char message[2 + sizeof(int)];
+            message[0] = OP_CODE_PLAY_SEQ;
+            message[1] = next_command(client, sent++);
+            memcpy(message + 2, &seq, sizeof(int));
+            if (write(req_fd, message, sizeof(message)) != sizeof(message)) break;
+            client->sent_us[seq & (LOADGEN_SEQ_WINDOW - 1)] = now;
+            seq++;
+            atomic_fetch_add_explicit(&inputs, 1, memory_order_relaxed);
+            next_send += interval_us;
+            if (next_send < now) next_send = now; // Fell behind, do not burst
+        }
+
+        int timeout_ms = interval_us > 0 ? (int)((next_send - now + 999) / 1000) : LOADGEN_FRAME_MS;
+        struct pollfd pfd = {notif_fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready <= 0) continue;
+
+        char op_code;
+        int header[6], input_seq = -1; // width, height, tempo, victory, game_over, points
+        if (read_full(notif_fd, &op_code, 1) != 0 ||
+            (op_code != OP_CODE_BOARD && op_code != OP_CODE_BOARD_SEQ) ||
+            read_full(notif_fd, header, sizeof(header)) != 0 ||
+            (op_code == OP_CODE_BOARD_SEQ && read_full(notif_fd, &input_seq, sizeof(int)) != 0)) {
+            break;
+        }
+        int size = header[0] * header[1];
+        char *data = size > 0 ? malloc(size) : NULL;
+        if (!data || read_full(notif_fd, data, size) != 0) {
+            free(data);
+            break;
+        }
+        free(data);
+
+        long long arrival = now_us();
+        if (last_frame == -1) {
+            sample_add(&client->connect_latency, arrival - connect_start);
+        }
+        else {
+            long long gap = arrival - last_frame;
+            if (gap > LOADGEN_FRAME_MS * 1500LL) {
+                atomic_fetch_add_explicit(&late_frames, 1, memory_order_relaxed);
+                atomic_fetch_add_explicit(&dropped_frames, gap / (LOADGEN_FRAME_MS * 1000LL) - 1, memory_order_relaxed);
+            }
+        }
+        last_frame = arrival;
+        atomic_fetch_add_explicit(&frames, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&bytes, 1 + sizeof(header) + (op_code == OP_CODE_BOARD_SEQ ? sizeof(int) : 0) + size,
+                                  memory_order_relaxed);
+
+        // Every input up to the echoed one has been applied
+        for (int s = acked + 1; s <= input_seq && s < seq; s++) {
+            if (seq - s <= LOADGEN_SEQ_WINDOW) {
+                sample_add(&client->input_latency, arrival - client->sent_us[s & (LOADGEN_SEQ_WINDOW - 1)]);
+            }
+        }
+        if (input_seq > acked) acked = input_seq;
+
+        if (header[3] || header[4]) break; // Victory or game over, the server ends the session
+    }
+}
+
+static void *client_thread(void *arg) {
+    client_t *client = arg;
+    long long run_end = run_start_us + (long long)(duration_s * 1e6);
+
+    long long start = run_start_us + (long long)(client->start_s * 1e6);
+    while (!atomic_load(&stopping) && now_us() < start) {
+        pause_ms(10);
+    }
+
+    while (!atomic_load(&stopping) && now_us() < run_end) {
+        int req_fd, notif_fd;
+        long long connect_start = now_us();
+        if (connect_client(client, &req_fd, &notif_fd, run_end) != 0) {
+            remove_pipes(client);
+            if (atomic_load(&stopping) || now_us() >= run_end) break;
+            atomic_fetch_add(&connect_failures, 1);
+            pause_ms(100); // Server full or draining
+            continue;
+        }
+        atomic_fetch_add(&connects, 1);
+
+        atomic_fetch_add(&playing, 1);
+        play_game(client, req_fd, notif_fd, connect_start, run_end);
+        atomic_fetch_sub(&playing, 1);
+        disconnect_client(client, req_fd, notif_fd);
+    }
+    return NULL;
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    atomic_store(&stopping, 1);
+}
+
+static int by_value(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Helper private function to print the percentiles of every client's samples (the field at offset) in ms
+static void print_percentiles(const char *name, client_t *clients, int n, size_t offset, const char *end) {
+    size_t total = 0;
+    for (int i = 0; i < n; i++) total += ((samples_t *)((char *)&clients[i] + offset))->count;
+
+    uint32_t *all = total ? malloc(total * sizeof(uint32_t)) : NULL;
+    size_t count = 0;
+    for (int i = 0; i < n && all; i++) {
+        samples_t *samples = (samples_t *)((char *)&clients[i] + offset);
+        memcpy(all + count, samples->values, samples->count * sizeof(uint32_t));
+        count += samples->count;
+    }
+    if (!count) {
+        printf("  \"%s\": {\"samples\": 0}%s\n", name, end);
+        free(all);
+        return;
+    }
+    qsort(all, count, sizeof(uint32_t), by_value);
+
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    const char *labels[] = {"p50", "p90", "p99", "p999"};
+    printf("  \"%s\": {\"samples\": %zu", name, count);
+    for (int q = 0; q < 4; q++) {
+        printf(", \"%s\": %.2f", labels[q], all[(size_t)(quantiles[q] * (count - 1))] / 1000.0);
+    }
+    printf(", \"max\": %.2f}%s\n", all[count - 1] / 1000.0, end);
+    free(all);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argc > 7) {
+        fprintf(stderr, "Usage: %s <register_pipe> <clients> [rate] [ramp_sec] [duration_sec] [random|<commands>|@<file>]\n",
+                argv[0]);
+        return 1;
+    }
+    register_pipe = argv[1];
+    int n = atoi(argv[2]);
+    if (argc > 3) rate = atof(argv[3]);
+    if (argc > 4) ramp_s = atof(argv[4]);
+    if (argc > 5) duration_s = atof(argv[5]);
+    if (argc > 6 && argv[6][0] == '@') {
+        script = commands_load(argv[6] + 1);
+        if (!script) {
+            fprintf(stderr, "No commands in %s\n", argv[6] + 1);
+            return 1;
+        }
+    }
+    else if (argc > 6 && strcmp(argv[6], "random") != 0) script = argv[6];
+    if (n < 1 || n > LOADGEN_MAX_CLIENTS || rate < 0 || ramp_s < 0 || duration_s <= 0 || (script && !*script)) {
+        fprintf(stderr, "clients must be between 1 and %d, rate and ramp_sec not negative, duration_sec positive\n",
+                LOADGEN_MAX_CLIENTS);
+        return 1;
+    }
+    if (script) script_len = strlen(script);
+
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    client_t *clients = calloc(n, sizeof(client_t));
+    pthread_t *tids = malloc(n * sizeof(pthread_t));
+    if (!clients || !tids) {
+        perror("loadgen");
+        return 1;
+    }
+
+    run_start_us = now_us();
+    int started = 0;
+    for (int i = 0; i < n; i++) {
+        clients[i].id = LOADGEN_FIRST_ID + i;
+        clients[i].start_s = n > 1 ? ramp_s * i / (n - 1) : 0;
+        rng_seed(&clients[i].rng, rng_mix(clients[i].id));
+        int error = pthread_create(&tids[i], NULL, client_thread, &clients[i]);
+        if (error != 0) {
+            // The run goes on with the clients that have a thread
+            fprintf(stderr, "Started %d of %d clients: %s\n", started, n, strerror(error));
+            break;
+        }
+        started++;
+    }
+
+    // One line per second while the clients play
+    long last_connects = 0, last_frames = 0, last_bytes = 0, last_late = 0;
+    for (int second = 1; !atomic_load(&stopping) && second <= (int)(duration_s + 0.999); second++) {
+        sleep(1);
+        long c = atomic_load(&connects), f = atomic_load(&frames), b = atomic_load(&bytes), l = atomic_load(&late_frames);
+        fprintf(stderr, "%4ds playing %4d  connects/s %4ld  frames/s %6ld  KB/s %8.1f  late frames %ld\n", second,
+                atomic_load(&playing), c - last_connects, f - last_frames, (b - last_bytes) / 1024.0, l - last_late);
+        last_connects = c;
+        last_frames = f;
+        last_bytes = b;
+        last_late = l;
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    double elapsed = (now_us() - run_start_us) / 1e6;
+
+    printf("{\n  \"clients\": %d,\n  \"clients_started\": %d,\n  \"rate\": %.2f,\n  \"ramp_sec\": %.2f,\n"
+           "  \"seconds\": %.2f,\n", n, started, rate, ramp_s, elapsed);
+    printf("  \"connects\": %ld,\n  \"connect_failures\": %ld,\n  \"connects_per_sec\": %.2f,\n",
+           atomic_load(&connects), atomic_load(&connect_failures), atomic_load(&connects) / elapsed);
+    printf("  \"frames\": %ld,\n  \"frames_per_sec\": %.2f,\n  \"bytes_per_sec\": %.0f,\n", atomic_load(&frames),
+           atomic_load(&frames) / elapsed, atomic_load(&bytes) / elapsed);
+    printf("  \"late_frames\": %ld,\n  \"dropped_frames\": %ld,\n  \"inputs\": %ld,\n", atomic_load(&late_frames),
+           atomic_load(&dropped_frames), atomic_load(&inputs));
+    print_percentiles("connect_latency_ms", clients, started, offsetof(client_t, connect_latency), ",");
+    print_percentiles("input_latency_ms", clients, started, offsetof(client_t, input_latency), "");
+    printf("}\n");
+
+    for (int i = 0; i < n; i++) {
+        free(clients[i].input_latency.values);
+        free(clients[i].connect_latency.values);
+    }
+    free(clients);
+    free(tids);
+    return 0;
+}
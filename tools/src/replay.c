@@ -0,0 +1,181 @@
+/*
+Replays a client command file (commands.h) as one client against a running
+server and prints how the game ended, for gameplay checks that must not depend
+on the build of the server:
+
+    victory <0|1> game_over <0|1> points <points>
+
+Every command goes out with a sequence number and the next one waits for the
+frame echoing it, so the game does not depend on how fast the server or the box
+is. The run stops at victory, game over or the end of the file (which, unlike
+the client, is not replayed). Exit status 1 when the server closes the session
+early or sends nothing for REPLAY_TIMEOUT_MS.
+
+Usage: replay <register_pipe> <commands_file> [client_id]
+*/
+#include "protocol.h"
+#include "commands.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+
+#define REPLAY_DEFAULT_ID 20000
+#define REPLAY_TIMEOUT_MS 5000
+
+// Helper private function, waits for input on fd. 0 when there is some, -1 on timeout or error
+static int wait_readable(int fd) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int ready;
+    do {
+        ready = poll(&pfd, 1, REPLAY_TIMEOUT_MS);
+    } while (ready < 0 && errno == EINTR);
+    return ready > 0 ? 0 : -1;
+}
+
+// Helper private function, reads exactly size bytes. 0 on success, -1 on error, end of file or timeout
+static int read_full(int fd, void *buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        if (wait_readable(fd) != 0) return -1;
+        ssize_t n = read(fd, (char *)buffer + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+// Helper private function, registers the client and opens its pipes. 0 on success
+static int connect_client(const char *register_pipe, int id, const char *req_path, const char *notif_path,
+                          int *req_fd, int *notif_fd) {
+    unlink(req_path);
+    unlink(notif_path);
+    if (mkfifo(req_path, 0666) != 0 || mkfifo(notif_path, 0666) != 0) return -1;
+
+    int server = open(register_pipe, O_WRONLY | O_NONBLOCK); // No server, no reader
+    if (server == -1) return -1;
+
+    char request[1 + sizeof(int) + 2 * MAX_PIPE_PATH_LENGTH];
+    request[0] = OP_CODE_CONNECT;
+    memcpy(request + 1, &id, sizeof(int));
+    memcpy(request + 1 + sizeof(int), req_path, MAX_PIPE_PATH_LENGTH);
+    memcpy(request + 1 + sizeof(int) + MAX_PIPE_PATH_LENGTH, notif_path, MAX_PIPE_PATH_LENGTH);
+    int sent = write(server, request, sizeof(request)) == (ssize_t)sizeof(request);
+    close(server);
+    if (!sent) return -1;
+
+    *notif_fd = open(notif_path, O_RDONLY | O_NONBLOCK);
+    if (*notif_fd == -1) return -1;
+
+    // The server opens the pipe once a worker takes the request
+    struct pollfd pfd = {*notif_fd, POLLIN, 0};
+    int waited = 0;
+    while (poll(&pfd, 1, 100) == 0 || (pfd.revents & POLLIN) == 0) {
+        waited += 100;
+        if (waited >= REPLAY_TIMEOUT_MS) {
+            close(*notif_fd);
+            return -1;
+        }
+    }
+    fcntl(*notif_fd, F_SETFL, fcntl(*notif_fd, F_GETFL) & ~O_NONBLOCK);
+
+    char reply[2];
+    if (read_full(*notif_fd, reply, sizeof(reply)) != 0 || reply[0] != OP_CODE_CONNECT || reply[1] != 0) {
+        close(*notif_fd);
+        return -1;
+    }
+
+    *req_fd = open(req_path, O_WRONLY);
+    if (*req_fd == -1) {
+        close(*notif_fd);
+        return -1;
+    }
+    return 0;
+}
+
+// Helper private function, reads one frame into header (width, height, tempo, victory, game_over, points). 0 on success
+static int read_frame(int notif_fd, int header[6], int *input_seq) {
+    char op_code;
+    *input_seq = -1;
+    if (read_full(notif_fd, &op_code, 1) != 0 ||
+        (op_code != OP_CODE_BOARD && op_code != OP_CODE_BOARD_SEQ) ||
+        read_full(notif_fd, header, 6 * sizeof(int)) != 0 ||
+        (op_code == OP_CODE_BOARD_SEQ && read_full(notif_fd, input_seq, sizeof(int)) != 0)) {
+        return -1;
+    }
+
+    int size = header[0] * header[1];
+    char *data = size > 0 ? malloc(size) : NULL;
+    int result = data && read_full(notif_fd, data, size) == 0 ? 0 : -1;
+    free(data);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "Usage: %s <register_pipe> <commands_file> [client_id]\n", argv[0]);
+        return 1;
+    }
+    int id = argc > 3 ? atoi(argv[3]) : REPLAY_DEFAULT_ID;
+    char *commands = commands_load(argv[2]);
+    if (!commands) {
+        fprintf(stderr, "No commands in %s\n", argv[2]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    char req_path[MAX_PIPE_PATH_LENGTH] = {0}, notif_path[MAX_PIPE_PATH_LENGTH] = {0};
+    snprintf(req_path, sizeof(req_path), "/tmp/%d_request", id);
+    snprintf(notif_path, sizeof(notif_path), "/tmp/%d_notification", id);
+
+    int req_fd, notif_fd;
+    if (connect_client(argv[1], id, req_path, notif_path, &req_fd, &notif_fd) != 0) {
+        fprintf(stderr, "Could not connect to %s\n", argv[1]);
+        unlink(req_path);
+        unlink(notif_path);
+        free(commands);
+        return 1;
+    }
+
+    int header[6] = {0}, input_seq;
+    int status = read_frame(notif_fd, header, &input_seq); // The first frame comes before any input
+    for (int seq = 0; status == 0 && commands[seq] && !header[3] && !header[4]; seq++) {
+        char message[2 + sizeof(int)];
+        message[0] = OP_CODE_PLAY_SEQ;
+        message[1] = commands[seq];
+        memcpy(message + 2, &seq, sizeof(int));
+        if (write(req_fd, message, sizeof(message)) != sizeof(message)) {
+            status = -1;
+            break;
+        }
+
+        // Frames before the echo still count, a ghost may end the game in between
+        do {
+            status = read_frame(notif_fd, header, &input_seq);
+        } while (status == 0 && input_seq < seq && !header[3] && !header[4]);
+    }
+
+    if (status == 0) {
+        printf("victory %d game_over %d points %d\n", header[3], header[4], header[5]);
+    }
+    else {
+        fprintf(stderr, "The server stopped sending frames before the game ended\n");
+    }
+
+    char op_code = OP_CODE_DISCONNECT;
+    if (write(req_fd, &op_code, 1) != 1) {
+        // Session already over
+    }
+    close(req_fd);
+    close(notif_fd);
+    unlink(req_path);
+    unlink(notif_path);
+    free(commands);
+    return status == 0 ? 0 : 1;
+}
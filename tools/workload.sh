@@ -0,0 +1,89 @@
+#!/bin/sh
+# Drives a built server with the recorded workloads of bench/workload, from the repository root.
+#
+#   workload.sh train <server>   training run of make pgo: the recorded session (session.p) played by
+#                                TRAIN_CLIENTS loadgen clients on the shipped levels, the gameplay
+#                                scenarios, then random clients on bigger levels from levelgen (fixed
+#                                seed), TRAIN_SEC seconds each. The server is stopped with SIGTERM so an
+#                                instrumented build writes its profile
+#   workload.sh check <server>   plays session.p and every scenarios/<name>.p once with replay on the
+#                                shipped levels and compares the result with the <name>.out next to it
+#
+# Each run works in a fresh temporary directory (logs, scores, flight dumps) removed at the end.
+# The training is reproducible up to thread timing: same levels, same commands, same client ids.
+set -u
+
+WORKLOAD=bench/workload
+LEVELS=server/niveis
+TRAIN_CLIENTS=${TRAIN_CLIENTS:-8}
+TRAIN_SEC=${TRAIN_SEC:-15}
+
+mode=${1:-}
+server=${2:-}
+if [ -z "$mode" ] || [ ! -x "$server" ]; then
+    echo "Usage: $0 train|check <server>" >&2
+    exit 1
+fi
+server=$(cd "$(dirname "$server")" && pwd)/$(basename "$server")
+root=$(pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+pid=
+
+# Starts the server on the levels in $1 with the register pipe $work/register
+start_server() {
+    (cd "$work" && exec "$server" "$1" 8 "$work/register" >server.out 2>&1) &
+    pid=$!
+    while [ ! -p "$work/register" ]; do
+        kill -0 "$pid" 2>/dev/null || { cat "$work/server.out" >&2; exit 1; }
+        sleep 0.1
+    done
+}
+
+# Stops the server with SIGTERM and waits for it, its exit writes the profile
+stop_server() {
+    kill -TERM "$pid"
+    wait "$pid"
+}
+
+# Plays every scenario, prints the failures and returns how many
+play_scenarios() {
+    failures=0
+    for scenario in "$root/$WORKLOAD"/session.p "$root/$WORKLOAD"/scenarios/*.p; do
+        name=$(basename "$scenario" .p)
+        got=$("$root/tools/bin/replay" "$work/register" "$scenario")
+        expected=$(cat "${scenario%.p}.out")
+        if [ "$got" = "$expected" ]; then
+            echo "ok   $name: $got"
+        else
+            echo "FAIL $name: got '$got', expected '$expected'"
+            failures=$((failures + 1))
+        fi
+    done
+    return $failures
+}
+
+case "$mode" in
+train)
+    start_server "$root/$LEVELS"
+    tools/bin/loadgen "$work/register" "$TRAIN_CLIENTS" 10 2 "$TRAIN_SEC" "@$WORKLOAD/session.p" >/dev/null
+    play_scenarios
+    stop_server
+
+    tools/bin/levelgen "$work/levels" -n 3 -w 64 -h 32 -m maze -g 4 -s 1 >/dev/null
+    start_server "$work/levels"
+    tools/bin/loadgen "$work/register" "$TRAIN_CLIENTS" 10 2 "$TRAIN_SEC" random >/dev/null
+    stop_server
+    ;;
+check)
+    start_server "$root/$LEVELS"
+    play_scenarios
+    failures=$?
+    stop_server
+    [ "$failures" -eq 0 ] || exit 1
+    ;;
+*)
+    echo "Usage: $0 train|check <server>" >&2
+    exit 1
+    ;;
+esac